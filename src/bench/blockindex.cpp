@@ -0,0 +1,65 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "random.h"
+#include "txdb.h"
+#include "validation.h"
+
+// Length of the synthetic chain
+static const int BLOCK_INDEX_ENTRIES = 20000;
+
+// Load a synthetic block index from an in-memory block tree db into mapBlockIndex,
+// as LoadBlockIndexDB does at startup, then unload it.
+static void BlockIndexLoad(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    FastRandomContext rng(true);
+    CBlockTreeDB db(1 << 26, true);
+
+    // PoS headers (no PoW check on load) with V2 stake modifiers
+    std::vector<std::unique_ptr<CBlockIndex>> vChain;
+    std::vector<uint256> vHashes(BLOCK_INDEX_ENTRIES);
+    std::vector<const CBlockIndex*> vIndex;
+    for (int i = 0; i < BLOCK_INDEX_ENTRIES; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = i > 0 ? vHashes[i - 1] : rng.rand256();
+        header.hashMerkleRoot = rng.rand256();
+        header.hashFinalSaplingRoot = rng.rand256();
+        header.nTime = 1600000000 + i * 60;
+        header.nBits = 0x1e0ffff0;
+        vHashes[i] = header.GetHash();
+        vChain.emplace_back(std::make_unique<CBlockIndex>(header));
+        CBlockIndex* pindex = vChain.back().get();
+        pindex->phashBlock = &vHashes[i];
+        pindex->pprev = i > 0 ? vChain[i - 1].get() : nullptr;
+        pindex->nHeight = 1000 + i;
+        pindex->nStatus = BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_VALID_SCRIPTS;
+        pindex->nTx = 2;
+        pindex->nDataPos = 1000 * i;
+        pindex->nUndoPos = 100 * i;
+        pindex->SetProofOfStake();
+        pindex->SetStakeModifier(rng.rand256());
+        vIndex.push_back(pindex);
+    }
+    assert(db.WriteBatchSync({}, 0, vIndex));
+
+    // The first load hashes every header and writes the block hash checkpoint:
+    // the timed ones are the usual startup, which trusts it.
+    WITH_LOCK(cs_main, assert(db.LoadBlockIndexGuts(InsertBlockIndex, false)); );
+    UnloadBlockIndex();
+
+    while (state.KeepRunning()) {
+        {
+            LOCK(cs_main);
+            mapBlockIndex.reserve(BLOCK_INDEX_ENTRIES + 1);
+            assert(db.LoadBlockIndexGuts(InsertBlockIndex, false));
+            assert(mapBlockIndex.size() == BLOCK_INDEX_ENTRIES + 1);
+        }
+        UnloadBlockIndex();
+    }
+}
+
+BENCHMARK(BlockIndexLoad, 10);
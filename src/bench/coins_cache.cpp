@@ -0,0 +1,87 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "random.h"
+
+// Number of coins in the cache: a few blocks worth of outputs
+static const int COINS_CACHE_ENTRIES = 100000;
+
+static std::vector<COutPoint> RandomOutpoints(FastRandomContext& rng)
+{
+    std::vector<COutPoint> vOutpoints;
+    vOutpoints.reserve(COINS_CACHE_ENTRIES);
+    for (int i = 0; i < COINS_CACHE_ENTRIES; i++) {
+        vOutpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return vOutpoints;
+}
+
+static void FillCache(CCoinsViewCache& cache, const std::vector<COutPoint>& vOutpoints)
+{
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        Coin coin;
+        coin.out.nValue = 1000 + i;
+        coin.out.scriptPubKey.assign(25, (unsigned char)0x76); // P2PKH-sized
+        coin.nHeight = 1;
+        cache.AddCoin(vOutpoints[i], std::move(coin), false);
+    }
+}
+
+// Fill an empty coins cache, as the outputs of the connected blocks do during IBD
+static void CoinsCacheInsert(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<COutPoint> vOutpoints = RandomOutpoints(rng);
+    CCoinsView base;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&base);
+        FillCache(cache, vOutpoints);
+        assert(cache.GetCacheSize() == vOutpoints.size());
+    }
+}
+
+// Look up cached coins, half of them missing from the cache
+static void CoinsCacheLookup(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<COutPoint> vOutpoints = RandomOutpoints(rng);
+    const std::vector<COutPoint> vMissing = RandomOutpoints(rng);
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    FillCache(cache, vOutpoints);
+    while (state.KeepRunning()) {
+        size_t nFound = 0;
+        for (size_t i = 0; i < vOutpoints.size(); i++) {
+            nFound += cache.HaveCoinInCache(vOutpoints[i]);
+            nFound += cache.HaveCoinInCache(vMissing[i]);
+        }
+        assert(nFound == vOutpoints.size());
+    }
+}
+
+// Flush a block-sized cache into its parent, spending half of the parent coins, as ConnectBlock does
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<COutPoint> vOutpoints = RandomOutpoints(rng);
+    const std::vector<COutPoint> vNew = RandomOutpoints(rng);
+    CCoinsView base;
+    while (state.KeepRunning()) {
+        CCoinsViewCache parent(&base);
+        FillCache(parent, vOutpoints);
+        CCoinsViewCache child(&parent);
+        for (size_t i = 0; i < vOutpoints.size(); i += 2) {
+            child.SpendCoin(vOutpoints[i]);
+        }
+        FillCache(child, vNew);
+        assert(child.Flush());
+        assert(parent.GetCacheSize() == vOutpoints.size() * 3 / 2);
+    }
+}
+
+BENCHMARK(CoinsCacheInsert, 10);
+BENCHMARK(CoinsCacheLookup, 10);
+BENCHMARK(CoinsCacheFlush, 5);
@@ -5,11 +5,14 @@
 #include <iostream>
 
 #include "bench.h"
+#include "consensus/merkle.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/siphash.h"
+#include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
 
 /* Number of bytes to hash per iteration */
@@ -49,6 +52,68 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+static void MerkleRoot(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(2000);
+    for (auto& leaf : leaves) {
+        leaf = rng.rand256();
+    }
+    while (state.KeepRunning()) {
+        bool mutation = false;
+        uint256 hash = ComputeMerkleRoot(std::vector<uint256>(leaves), &mutation);
+        leaves[mutation] = hash;
+    }
+}
+
+static CBlockHeader BenchHeader(int32_t nVersion)
+{
+    FastRandomContext rng(true);
+    CBlockHeader header;
+    header.nVersion = nVersion;
+    header.hashPrevBlock = rng.rand256();
+    header.hashMerkleRoot = rng.rand256();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0ffff0;
+    return header;
+}
+
+static void QuarkBlockHeader(benchmark::State& state)
+{
+    CBlockHeader header = BenchHeader(3);
+    while (state.KeepRunning()) {
+        header.hashPrevBlock = header.GetHash();
+    }
+}
+
+static void QuarkBlockHeader_256(benchmark::State& state)
+{
+    CBlockHeader header = BenchHeader(3);
+    std::vector<uint256> hashes;
+    while (state.KeepRunning()) {
+        header.GetHashes(256, hashes);
+        header.nNonce += 256;
+    }
+}
+
+static void BlockHeader_256(benchmark::State& state)
+{
+    CBlockHeader header = BenchHeader(CBlockHeader::CURRENT_VERSION);
+    std::vector<uint256> hashes;
+    while (state.KeepRunning()) {
+        header.GetHashes(256, hashes);
+        header.nNonce += 256;
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -81,5 +146,10 @@ BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(MerkleRoot, 800);
+BENCHMARK(QuarkBlockHeader, 100 * 1000);
+BENCHMARK(QuarkBlockHeader_256, 500);
+BENCHMARK(BlockHeader_256, 12 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
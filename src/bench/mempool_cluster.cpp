@@ -0,0 +1,73 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/feerate.h"
+#include "random.h"
+#include "txmempool.h"
+
+// Deep CPFP chains: a low fee parent, paid for by descendants of growing fee
+static const int CPFP_CHAINS = 200;
+static const int CPFP_CHAIN_DEPTH = 25;
+
+static std::vector<CTransactionRef> MakeCpfpChains()
+{
+    FastRandomContext rng(true);
+    std::vector<CTransactionRef> vTxs;
+    for (int i = 0; i < CPFP_CHAINS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(rng.rand256(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        for (int j = 0; j < CPFP_CHAIN_DEPTH; j++) {
+            vTxs.emplace_back(MakeTransactionRef(tx));
+            tx.vin[0].prevout = COutPoint(vTxs.back()->GetHash(), 0);
+        }
+    }
+    return vTxs;
+}
+
+static void AddCpfpChains(CTxMemPool& pool, const std::vector<CTransactionRef>& vTxs)
+{
+    LOCK(pool.cs);
+    for (size_t i = 0; i < vTxs.size(); i++) {
+        const int nDepth = i % CPFP_CHAIN_DEPTH;
+        const CAmount nFee = nDepth == 0 ? 100 : 1000 * nDepth + (CAmount)(i / CPFP_CHAIN_DEPTH);
+        pool.addUnchecked(vTxs[i]->GetHash(), CTxMemPoolEntry(vTxs[i], nFee, 0, 1, false, 1));
+    }
+}
+
+// Linearize the clusters and walk the chunks, as the block assembler does
+static void MempoolClusterChunks(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vTxs = MakeCpfpChains();
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        AddCpfpChains(pool, vTxs);
+        LOCK(pool.cs);
+        uint64_t nSize = 0;
+        for (const CTxMemPool::TxChunk* chunk : pool.GetChunksByFeeRate()) {
+            nSize += chunk->nSize;
+        }
+        assert(nSize == pool.GetTotalTxSize());
+    }
+}
+
+// Evict half of the chains' transactions, worst chunks first
+static void MempoolClusterTrim(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vTxs = MakeCpfpChains();
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        AddCpfpChains(pool, vTxs);
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        assert(pool.size() < vTxs.size());
+    }
+}
+
+BENCHMARK(MempoolClusterChunks, 10);
+BENCHMARK(MempoolClusterTrim, 10);
@@ -0,0 +1,49 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/feerate.h"
+#include "random.h"
+#include "txmempool.h"
+
+// Size of a spam wave: short chains of small transactions
+static const int STRESS_TXS = 300000;
+static const int STRESS_CHAIN_LENGTH = 4;
+
+// Load the spam wave into an empty mempool, then evict a third of it
+static void MempoolStress(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<CTransactionRef> vTxs;
+    vTxs.reserve(STRESS_TXS);
+    for (int i = 0; i < STRESS_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % STRESS_CHAIN_LENGTH == 0) {
+            tx.vin[0].prevout = COutPoint(rng.rand256(), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(vTxs.back()->GetHash(), 0);
+        }
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+            out.nValue = COIN;
+        }
+        vTxs.emplace_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        LOCK(pool.cs);
+        for (const CTransactionRef& tx : vTxs) {
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000 + rng.randrange(10000), 0, 1, false, 1));
+        }
+        const size_t nUsage = pool.DynamicMemoryUsage();
+        pool.TrimToSize(nUsage * 2 / 3);
+        assert(pool.DynamicMemoryUsage() <= nUsage * 2 / 3);
+    }
+}
+
+BENCHMARK(MempoolStress, 1);
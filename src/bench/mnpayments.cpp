@@ -0,0 +1,63 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "key.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "random.h"
+
+// Size of the masternode list and of the synthetic chain (the legacy payment queue looks back 1.25x the list)
+static const int MN_COUNT = 2000;
+static const int CHAIN_LENGTH = MN_COUNT * 5 / 4 + 100;
+
+// Rank every masternode by last payment, as CMasternodeMan::GetNextMasternodeInQueueForPayment does.
+static void MasternodePaymentQueue(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<MasternodeRef> vMasternodes;
+    for (int i = 0; i < MN_COUNT; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        auto mn = std::make_shared<CMasternode>();
+        mn->vin = CTxIn(COutPoint(rng.rand256(), 0));
+        mn->pubKeyCollateralAddress = key.GetPubKey();
+        mn->sigTime = 1600000000 + i;
+        vMasternodes.emplace_back(mn);
+    }
+
+    std::vector<CBlockIndex> vChain(CHAIN_LENGTH);
+    for (int i = 0; i < CHAIN_LENGTH; i++) {
+        vChain[i].pprev = i > 0 ? &vChain[i - 1] : nullptr;
+        vChain[i].nHeight = i;
+        vChain[i].nTime = 1600000000 + i * 60;
+        vChain[i].BuildSkip();
+    }
+    const CBlockIndex* pindexTip = &vChain.back();
+
+    // every block pays the next masternode in round robin, with two votes each
+    for (int h = 1; h < CHAIN_LENGTH; h++) {
+        const CScript payee = vMasternodes[h % MN_COUNT]->GetPayeeScript();
+        for (int v = 0; v < MNPAYMENTS_LASTPAID_VOTES; v++) {
+            CMasternodePaymentWinner winner(CTxIn(COutPoint(rng.rand256(), 0)), h);
+            winner.AddPayee(payee);
+            masternodePayments.AddWinningMasternode(winner);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<std::pair<int64_t, MasternodeRef>> vecMasternodeLastPaid;
+        for (const MasternodeRef& mn : vMasternodes) {
+            vecMasternodeLastPaid.emplace_back(mnodeman.SecondsSincePayment(mn, MN_COUNT, pindexTip), mn);
+        }
+        std::sort(vecMasternodeLastPaid.begin(), vecMasternodeLastPaid.end(), [](const std::pair<int64_t, MasternodeRef>& a, const std::pair<int64_t, MasternodeRef>& b) {
+            return a.first > b.first;
+        });
+    }
+
+    masternodePayments.Clear();
+}
+
+BENCHMARK(MasternodePaymentQueue, 20);
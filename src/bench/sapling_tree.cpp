@@ -0,0 +1,51 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockassembler.h"
+#include "random.h"
+#include "test/util/saplingtree.h"
+
+// Shielded outputs of the template: 500 transactions of 2 outputs
+static const int SAPLING_TREE_TXES = 500;
+static const int SAPLING_TREE_TX_OUTPUTS = 2;
+
+static std::vector<CTransactionRef> ShieldedBlockTxs(FastRandomContext& rng, AnchorView& view)
+{
+    for (int i = 0; i < 100; i++) view.tree.append(rng.rand256());
+    std::vector<CTransactionRef> vtx{MakeTransactionRef(CMutableTransaction())};
+    for (int i = 0; i < SAPLING_TREE_TXES; i++) vtx.emplace_back(ShieldedTx(rng, SAPLING_TREE_TX_OUTPUTS));
+    return vtx;
+}
+
+// Root of a new template: every output is appended to the anchor tree
+static void SaplingTreeRootFull(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    AnchorView view;
+    const std::vector<CTransactionRef> vtx = ShieldedBlockTxs(rng, view);
+    while (state.KeepRunning()) {
+        CSaplingTreeFrontier frontier;
+        frontier.GetRoot(view, vtx);
+        assert(frontier.GetLastAppended() == SAPLING_TREE_TXES * SAPLING_TREE_TX_OUTPUTS);
+    }
+}
+
+// Root of the next template, whose last transaction changed
+static void SaplingTreeRootIncremental(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    AnchorView view;
+    std::vector<CTransactionRef> vtx = ShieldedBlockTxs(rng, view);
+    CSaplingTreeFrontier frontier;
+    frontier.GetRoot(view, vtx);
+    while (state.KeepRunning()) {
+        vtx.back() = ShieldedTx(rng, SAPLING_TREE_TX_OUTPUTS);
+        frontier.GetRoot(view, vtx);
+        assert(frontier.GetLastAppended() == SAPLING_TREE_TX_OUTPUTS);
+    }
+}
+
+BENCHMARK(SaplingTreeRootFull, 20);
+BENCHMARK(SaplingTreeRootIncremental, 2000);
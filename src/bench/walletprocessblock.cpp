@@ -37,6 +37,9 @@ static CMutableTransaction NewCoinbase(const int nHeight, const CScript& scriptP
     return txCoinbase;
 }
 
+// Entries of the fake blocks: mapBlockIndex doesn't own them
+static std::vector<std::unique_ptr<CBlockIndex>> vFakeBlockIndexes;
+
 std::shared_ptr<CBlock> createAndProcessBlock(
         const CChainParams& params,
         const CScript& coinbaseScript,
@@ -56,7 +59,8 @@ std::shared_ptr<CBlock> createAndProcessBlock(
     block.hashFinalSaplingRoot = CalculateSaplingTreeRoot(&block, nextHeight, params);
 
     const auto& blockHash = block.GetHash();
-    CBlockIndex* fakeIndex = new CBlockIndex{block};
+    vFakeBlockIndexes.emplace_back(std::make_unique<CBlockIndex>(block));
+    CBlockIndex* fakeIndex = vFakeBlockIndexes.back().get();
     fakeIndex->nHeight = nextHeight;
     BlockMap::iterator mi = mapBlockIndex.emplace(blockHash, fakeIndex).first;
     fakeIndex->phashBlock = &((*mi).first);
@@ -148,7 +152,7 @@ static void WalletProcessBlockBench(benchmark::State& state)
         }
 
         std::shared_ptr<CBlock> pblock = createAndProcessBlock(params, coinbaseScript, vtx, chainActive.Tip());
-        pwallet->BlockConnected(pblock, mapBlockIndex[pblock->GetHash()]);
+        pwallet->BlockConnected(pblock, mapBlockIndex.at(pblock->GetHash()));
     }
     assert(WITH_LOCK(cs_main, return chainActive.Height();) == gen -1);
     int nextBlockHeight = gen + 1;
@@ -186,7 +190,7 @@ static void WalletProcessBlockBench(benchmark::State& state)
     // The wallet receiving the blocks..
     while (state.KeepRunning()) {
         for (const auto& pblock : blocks) {
-            pwallet->BlockConnected(pblock, mapBlockIndex[pblock->GetHash()]);
+            pwallet->BlockConnected(pblock, mapBlockIndex.at(pblock->GetHash()));
         }
     }
 
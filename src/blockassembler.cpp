@@ -16,6 +16,7 @@
 #include "consensus/validation.h"
 #include "llmq/quorums_blockprocessor.h"
 #include "masternode-payments.h"
+#include "miner.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
@@ -40,6 +41,10 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+// Block space kept for the coinbase (and coinstake) tx
+static const uint64_t COINBASE_RESERVED_SIZE = 1000;
+static const unsigned int COINBASE_RESERVED_SIGOPS = 100;
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -133,6 +138,29 @@ bool CreateCoinbaseTx(CBlock* pblock, const CScript& scriptPubKeyIn, CBlockIndex
     return true;
 }
 
+// LLMQ commitments to include in the block at nHeight
+static std::vector<CTransactionRef> GetMinableCommitments(int nHeight)
+{
+    LOCK(cs_main);
+    std::vector<CTransactionRef> vCommitments;
+    for (const auto& p : Params().GetConsensus().llmqs) {
+        CTransactionRef qcTx;
+        if (llmq::quorumBlockProcessor->GetMinableCommitmentTx(p.first, nHeight, qcTx)) {
+            vCommitments.emplace_back(qcTx);
+        }
+    }
+    return vCommitments;
+}
+
+bool CBlockTemplateTxs::IsValidFor(const CBlockIndex* pindexPrev, const std::vector<CTransactionRef>& vCommitmentsIn) const
+{
+    if (hashPrevBlock != pindexPrev->GetBlockHash() || nCommitments != vCommitmentsIn.size()) return false;
+    for (size_t i = 0; i < nCommitments; i++) {
+        if (vtx[i]->GetHash() != vCommitmentsIn[i]->GetHash()) return false;
+    }
+    return true;
+}
+
 BlockAssembler::BlockAssembler(const CChainParams& _chainparams, const bool _defaultPrintPriority)
         : chainparams(_chainparams), defaultPrintPriority(_defaultPrintPriority)
 {
@@ -144,11 +172,9 @@ BlockAssembler::BlockAssembler(const CChainParams& _chainparams, const bool _def
 
 void BlockAssembler::resetBlock()
 {
-    inBlock.clear();
-
     // Reserve space for coinbase tx
-    nBlockSize = 1000;
-    nBlockSigOps = 100;
+    nBlockSize = COINBASE_RESERVED_SIZE;
+    nBlockSigOps = COINBASE_RESERVED_SIGOPS;
 
     // These counters do not include coinbase tx
     nBlockTx = 0;
@@ -163,7 +189,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                                                bool fTestValidity,
                                                CBlockIndex* prevBlock,
                                                bool stopPoSOnNewBlock,
-                                               bool fIncludeQfc)
+                                               bool fIncludeQfc,
+                                               const CBlockTemplateTxs* pTemplateTxs)
 {
     resetBlock();
 
@@ -191,27 +218,26 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                         : CreateCoinbaseTx(pblock, scriptPubKeyIn, pindexPrev))) {
         return nullptr;
     }
+    if (fProofOfStake) pblocktemplate->nTimeStakeFound = GetTimeMicros();
 
     // After v6 enforcement, add LLMQ commitments if needed
     const Consensus::Params& consensus = Params().GetConsensus();
+    std::vector<CTransactionRef> vCommitments;
     if (consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_V6_0) && fIncludeQfc) {
-        LOCK(cs_main);
-        for (const auto& p : Params().GetConsensus().llmqs) {
-            CTransactionRef qcTx;
-            if (llmq::quorumBlockProcessor->GetMinableCommitmentTx(p.first, nHeight, qcTx)) {
-                pblock->vtx.emplace_back(qcTx);
-                pblocktemplate->vTxFees.emplace_back(0);
-                pblocktemplate->vTxSigOps.emplace_back(0);
-                nBlockSize += qcTx->GetTotalSize();
-                ++nBlockTx;
-            }
-        }
+        vCommitments = GetMinableCommitments(nHeight);
     }
 
-    if (!fNoMempoolTx) {
-        // Add transactions from mempool
-        LOCK2(cs_main,mempool.cs);
-        addPackageTxs();
+    if (!fNoMempoolTx && pTemplateTxs && pTemplateTxs->IsValidFor(pindexPrev, vCommitments)) {
+        AddTemplateTxsToBlock(*pTemplateTxs);
+    } else {
+        for (const CTransactionRef& qcTx : vCommitments) {
+            AddCommitmentToBlock(qcTx);
+        }
+        if (!fNoMempoolTx) {
+            // Add transactions from mempool
+            LOCK2(cs_main,mempool.cs);
+            addPackageTxs();
+        }
     }
 
     if (!fProofOfStake) {
@@ -233,7 +259,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
     pblock->nNonce = 0;
     pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(*(pblock->vtx[0]));
-    appendSaplingTreeRoot();
+    if (pblocktemplate->fFromTemplateTxs && !pblock->vtx[0]->IsShieldedTx() &&
+            (!fProofOfStake || !pblock->vtx[1]->IsShieldedTx())) {
+        pblock->hashFinalSaplingRoot = pTemplateTxs->hashFinalSaplingRoot;
+    } else {
+        appendSaplingTreeRoot();
+    }
 
     if (fProofOfStake) { // this is only for PoS because the IncrementExtraNonce does it for PoW
         pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
@@ -249,7 +280,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         if (prevBlock == nullptr && chainActive.Tip() != pindexPrev) return nullptr; // new block came in, move on
 
         CValidationState state;
-        if (fTestValidity &&
+        if (fTestValidity && !pblocktemplate->fFromTemplateTxs &&
             !TestBlockValidity(state, *pblock, pindexPrev, false, false, false)) {
             throw std::runtime_error(
                     strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
@@ -259,17 +290,39 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
+std::unique_ptr<CBlockTemplateTxs> BlockAssembler::CreateTemplateTxs(CBlockIndex* pindexPrev)
 {
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
+    assert(pindexPrev);
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+    pblock = &pblocktemplate->block;
+    nHeight = pindexPrev->nHeight + 1;
+
+    std::unique_ptr<CBlockTemplateTxs> ptemplateTxs(new CBlockTemplateTxs());
+    ptemplateTxs->hashPrevBlock = pindexPrev->GetBlockHash();
+    if (chainparams.GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_V6_0)) {
+        for (const CTransactionRef& qcTx : GetMinableCommitments(nHeight)) {
+            AddCommitmentToBlock(qcTx);
         }
+        ptemplateTxs->nCommitments = pblock->vtx.size();
     }
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip() != pindexPrev) return nullptr;
+        addPackageTxs();
+        // The coinbase and the coinstake come first in the block, but have no shielded outputs
+        ptemplateTxs->hashFinalSaplingRoot = CalculateSaplingTreeRoot(pblock, nHeight, chainparams);
+    }
+
+    ptemplateTxs->vtx = std::move(pblock->vtx);
+    ptemplateTxs->vTxFees = std::move(pblocktemplate->vTxFees);
+    ptemplateTxs->vTxSigOps = std::move(pblocktemplate->vTxSigOps);
+    ptemplateTxs->nBlockSize = nBlockSize - COINBASE_RESERVED_SIZE;
+    ptemplateTxs->nBlockTx = nBlockTx;
+    ptemplateTxs->nBlockSigOps = nBlockSigOps - COINBASE_RESERVED_SIGOPS;
+    ptemplateTxs->nFees = nFees;
+    return ptemplateTxs;
 }
 
 bool BlockAssembler::TestPackage(uint64_t packageSize, unsigned int packageSigOps)
@@ -282,12 +335,24 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, unsigned int packageSigOp
 }
 
 // Block size and sigops have already been tested.  Check that all transactions
-// are final.
-bool BlockAssembler::TestPackageFinality(const CTxMemPool::setEntries& package)
+// are final, and that the shielded ones fit in their reserved space.
+bool BlockAssembler::TestChunkTxs(const CTxMemPool::TxChunk& chunk)
 {
-    for (const CTxMemPool::txiter& it : package) {
+    unsigned int nChunkSizeShielded = 0;
+    for (const CTxMemPool::txiter& it : chunk) {
         if (!IsFinalTx(it->GetSharedTx(), nHeight))
             return false;
+        if (it->IsShielded())
+            nChunkSizeShielded += it->GetTxSize();
+    }
+    if (nChunkSizeShielded > 0) {
+        // Don't add SHIELD transactions if in maintenance (SPORK_20)
+        if (sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE))
+            return false;
+        // Don't add SHIELD transactions if there's no reserved space left in the block
+        if (nSizeShielded + nChunkSizeShielded > MAX_BLOCK_SHIELDED_TXES_SIZE)
+            return false;
+        nSizeShielded += nChunkSizeShielded;
     }
     return true;
 }
@@ -301,7 +366,6 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     ++nBlockTx;
     nBlockSigOps += iter->GetSigOpCount();
     nFees += iter->GetFee();
-    inBlock.insert(iter);
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", defaultPrintPriority);
     if (fPrintPriority) {
@@ -311,188 +375,50 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-void BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-                                            indexed_modified_transaction_set& mapModifiedTx)
-{
-    for (const CTxMemPool::txiter& it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendants(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set
-        for (CTxMemPool::txiter desc : descendants) {
-            if (alreadyAdded.count(desc))
-                continue;
-            modtxiter mit = mapModifiedTx.find(desc);
-            if (mit == mapModifiedTx.end()) {
-                CTxMemPoolModifiedEntry modEntry(desc);
-                modEntry.nSizeWithAncestors -= it->GetTxSize();
-                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-                modEntry.nSigOpCountWithAncestors -= it->GetSigOpCount();
-                mapModifiedTx.insert(modEntry);
-            } else {
-                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
-            }
-        }
-    }
-}
-
-// Skip entries in mapTx that are already in a block or are present
-// in mapModifiedTx (which implies that the mapTx ancestor state is
-// stale due to ancestor inclusion in the block)
-// Also skip transactions that we've already failed to add. This can happen if
-// we consider a transaction in mapModifiedTx and it fails: we can then
-// potentially consider it again while walking mapTx.  It's currently
-// guaranteed to fail again, but as a belt-and-suspenders check we put it in
-// failedTx and avoid re-evaluation, since the re-evaluation would be using
-// cached size/sigops/fee values that are not actually correct.
-bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
+void BlockAssembler::AddCommitmentToBlock(const CTransactionRef& qcTx)
 {
-    assert (it != mempool.mapTx.end());
-    if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it))
-        return true;
-    return false;
+    pblock->vtx.emplace_back(qcTx);
+    pblocktemplate->vTxFees.emplace_back(0);
+    pblocktemplate->vTxSigOps.emplace_back(0);
+    nBlockSize += qcTx->GetTotalSize();
+    ++nBlockTx;
 }
 
-void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries)
+void BlockAssembler::AddTemplateTxsToBlock(const CBlockTemplateTxs& templateTxs)
 {
-    // Sort package by ancestor count
-    // If a transaction A depends on transaction B, then A's ancestor count
-    // must be greater than B's.  So this is sufficient to validly order the
-    // transactions for block inclusion.
-    sortedEntries.clear();
-    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+    pblock->vtx.insert(pblock->vtx.end(), templateTxs.vtx.begin(), templateTxs.vtx.end());
+    pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), templateTxs.vTxFees.begin(), templateTxs.vTxFees.end());
+    pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), templateTxs.vTxSigOps.begin(), templateTxs.vTxSigOps.end());
+    nBlockSize += templateTxs.nBlockSize;
+    nBlockTx += templateTxs.nBlockTx;
+    nBlockSigOps += templateTxs.nBlockSigOps;
+    nFees += templateTxs.nFees;
+    pblocktemplate->fFromTemplateTxs = true;
 }
 
-// This transaction selection algorithm orders the mempool based
-// on feerate of a transaction including all unconfirmed ancestors.
-// Since we don't remove transactions from the mempool as we select them
-// for block inclusion, we need an alternate method of updating the feerate
-// of a transaction with its not-yet-selected ancestors as we go.
-// This is accomplished by walking the in-mempool descendants of selected
-// transactions and storing a temporary modified state in mapModifiedTxs.
-// Each time through the loop, we compare the best transaction in
-// mapModifiedTxs with the next transaction in the mempool to decide what
-// transaction package to work on next.
+// The mempool keeps its clusters linearized, and their chunks sorted by
+// feerate: a chunk only depends on the previous chunks of its cluster, so the
+// block is filled by walking the chunks in order, skipping the rest of a
+// cluster once one of its chunks could not be added.
 void BlockAssembler::addPackageTxs()
 {
-    // mapModifiedTx will store sorted packages after they are modified
-    // because some of their txs are already in the block
-    indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work
-    CTxMemPool::setEntries failedTx;
-
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
-    CTxMemPool::txiter iter;
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
-    {
-        // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
-            continue;
-        }
-
-        // Now that mi is not stale, determine which transaction to evaluate:
-        // the next entry from mapTx, or the best from mapModifiedTx?
-        bool fUsingModified = false;
-
-        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-            // We're out of entries in mapTx; use the entry from mapModifiedTx
-            iter = modit->iter;
-            fUsingModified = true;
-        } else {
-            // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
-            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-                    CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
-                // The best entry in mapModifiedTx has higher score
-                // than the one from mapTx.
-                // Switch which transaction (package) to consider
-                iter = modit->iter;
-                fUsingModified = true;
-            } else {
-                // Either no entry in mapModifiedTx, or it's worse than mapTx.
-                // Increment mi for the next loop iteration.
-                ++mi;
-            }
-        }
-
-        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-        // contain anything that is inBlock.
-        assert(!inBlock.count(iter));
-
-        uint64_t packageSize = iter->GetSizeWithAncestors();
-        CAmount packageFees = iter->GetModFeesWithAncestors();
-        unsigned int packageSigOps = iter->GetSigOpCountWithAncestors();
-        if (fUsingModified) {
-            packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
-            packageSigOps = modit->nSigOpCountWithAncestors;
-        }
-
-        if (packageFees < ::minRelayTxFee.GetFee(packageSize)) {
+    std::set<uint64_t> setFailedClusters;
+    for (const CTxMemPool::TxChunk* chunk : mempool.GetChunksByFeeRate()) {
+        if (chunk->nModFees < ::minRelayTxFee.GetFee(chunk->nSize)) {
             // Everything else we might consider has a lower fee rate
             return;
         }
-
-        if (!TestPackage(packageSize, packageSigOps)) {
-            if (fUsingModified) {
-                // Since we always look at the best entry in mapModifiedTx,
-                // we must erase failed entries so that we can consider the
-                // next best entry on the next loop iteration
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (setFailedClusters.count(chunk->nCluster))
             continue;
-        }
-
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
 
-        onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
-
-        // Test if all tx's are Final
-        if (!TestPackageFinality(ancestors)) {
-            if (fUsingModified) {
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (!TestPackage(chunk->nSize, chunk->nSigOps) || !TestChunkTxs(*chunk)) {
+            setFailedClusters.insert(chunk->nCluster);
             continue;
         }
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, iter, sortedEntries);
-
-        for (size_t i = 0; i < sortedEntries.size(); ++i) {
-            CTxMemPool::txiter& iterSortedEntries = sortedEntries[i];
-            if (iterSortedEntries->IsShielded()) {
-                // Don't add SHIELD transactions if in maintenance (SPORK_20)
-                if (sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE)) {
-                    break;
-                }
-                // Don't add SHIELD transactions if there's no reserved space left in the block
-                if (nSizeShielded + iterSortedEntries->GetTxSize() > MAX_BLOCK_SHIELDED_TXES_SIZE) {
-                    break;
-                }
-                // Update cumulative size of SHIELD transactions in this block
-                nSizeShielded += iterSortedEntries->GetTxSize();
-            }
-            AddToBlock(iterSortedEntries);
-            // Erase from the modified set, if present
-            mapModifiedTx.erase(iterSortedEntries);
+        for (const CTxMemPool::txiter& it : *chunk) {
+            AddToBlock(it);
         }
-
-        // Update transactions that depend on each of these
-        UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
 }
 
@@ -502,25 +428,98 @@ void BlockAssembler::appendSaplingTreeRoot()
     pblock->hashFinalSaplingRoot = CalculateSaplingTreeRoot(pblock, nHeight, chainparams);
 }
 
-uint256 CalculateSaplingTreeRoot(CBlock* pblock, int nHeight, const CChainParams& chainparams)
+uint256 CSaplingTreeFrontier::GetRoot(const CCoinsView& view, const std::vector<CTransactionRef>& vtx)
 {
-    if (NetworkUpgradeActive(nHeight, chainparams.GetConsensus(), Consensus::UPGRADE_V5_0)) {
+    LOCK(cs);
+    const uint256 hashBestAnchor = view.GetBestAnchor();
+    if (vTrees.empty() || hashAnchor != hashBestAnchor) {
         SaplingMerkleTree sapling_tree;
-        assert(pcoinsTip->GetSaplingAnchorAt(pcoinsTip->GetBestAnchor(), sapling_tree));
-
-        // Update the Sapling commitment tree.
-        for (const auto &tx : pblock->vtx) {
-            if (tx->IsShieldedTx()) {
-                for (const OutputDescription &odesc : tx->sapData->vShieldedOutput) {
-                    sapling_tree.append(odesc.cmu);
-                }
-            }
+        assert(view.GetSaplingAnchorAt(hashBestAnchor, sapling_tree));
+        vTrees.clear();
+        vTrees.emplace_back(UINT256_ZERO, sapling_tree);
+        hashAnchor = hashBestAnchor;
+    }
+
+    // Keep the trees of the transactions shared with the last template
+    auto it = vtx.begin();
+    size_t nShared = 1;
+    for (; it != vtx.end(); ++it) {
+        if (!(*it)->IsShieldedTx() || (*it)->sapData->vShieldedOutput.empty()) continue;
+        if (nShared == vTrees.size() || vTrees[nShared].first != (*it)->GetHash()) break;
+        nShared++;
+    }
+    vTrees.resize(nShared);
+
+    // Update the Sapling commitment tree with the rest.
+    nLastAppended = 0;
+    for (; it != vtx.end(); ++it) {
+        if (!(*it)->IsShieldedTx() || (*it)->sapData->vShieldedOutput.empty()) continue;
+        SaplingMerkleTree sapling_tree = vTrees.back().second;
+        for (const OutputDescription& odesc : (*it)->sapData->vShieldedOutput) {
+            sapling_tree.append(odesc.cmu);
         }
-        return sapling_tree.root();
+        nLastAppended += (*it)->sapData->vShieldedOutput.size();
+        vTrees.emplace_back((*it)->GetHash(), std::move(sapling_tree));
+    }
+    return vTrees.back().second.root();
+}
+
+size_t CSaplingTreeFrontier::GetLastAppended()
+{
+    LOCK(cs);
+    return nLastAppended;
+}
+
+// Tree of the tip extended by the last templates, shared by the template builders
+static CSaplingTreeFrontier saplingTreeFrontier;
+
+uint256 CalculateSaplingTreeRoot(CBlock* pblock, int nHeight, const CChainParams& chainparams)
+{
+    if (NetworkUpgradeActive(nHeight, chainparams.GetConsensus(), Consensus::UPGRADE_V5_0)) {
+        LOCK(cs_main);
+        return saplingTreeFrontier.GetRoot(*pcoinsTip, pblock->vtx);
     }
     return UINT256_ZERO;
 }
 
+void CStakerTemplateCache::Refresh(CBlockIndex* pindexPrev)
+{
+    {
+        LOCK(cs);
+        if (!fStale && ptemplateTxs && ptemplateTxs->hashPrevBlock == pindexPrev->GetBlockHash()) return;
+    }
+    // Notifications from now on make the new transactions stale
+    fStale = false;
+    const int64_t nTimeStart = GetTimeMicros();
+    std::shared_ptr<const CBlockTemplateTxs> ptemplateTxsNew = BlockAssembler(Params(), DEFAULT_PRINTPRIORITY).CreateTemplateTxs(pindexPrev);
+    if (!ptemplateTxsNew) {
+        // The tip moved on
+        fStale = true;
+        return;
+    }
+    LogPrint(BCLog::STAKING, "%s: %u txs (%u bytes) on top of %s in %.2fms\n", __func__,
+             ptemplateTxsNew->nBlockTx, ptemplateTxsNew->nBlockSize, pindexPrev->GetBlockHash().ToString(),
+             0.001 * (GetTimeMicros() - nTimeStart));
+    LOCK(cs);
+    ptemplateTxs = std::move(ptemplateTxsNew);
+}
+
+std::shared_ptr<const CBlockTemplateTxs> CStakerTemplateCache::Get(const CBlockIndex* pindexPrev)
+{
+    LOCK(cs);
+    if (!ptemplateTxs || ptemplateTxs->hashPrevBlock != pindexPrev->GetBlockHash() ||
+            hashRejectedTip == pindexPrev->GetBlockHash()) {
+        return nullptr;
+    }
+    return ptemplateTxs;
+}
+
+void CStakerTemplateCache::Reject(const uint256& hashPrevBlock)
+{
+    LOCK(cs);
+    hashRejectedTip = hashPrevBlock;
+}
+
 bool SolveBlock(std::shared_ptr<CBlock>& pblock, int nHeight)
 {
     unsigned int extraNonce = 0;
@@ -8,12 +8,13 @@
 #define MARIA_BLOCKASSEMBLER_H
 
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
+#include "validationinterface.h"
 
+#include <atomic>
 #include <stdint.h>
 #include <memory>
-#include "boost/multi_index_container.hpp"
-#include "boost/multi_index/ordered_index.hpp"
 
 class CBlockIndex;
 class CChainParams;
@@ -29,107 +30,35 @@ struct CBlockTemplate
     CBlock block;
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOps;
+    // Time (in microseconds) the coinstake was found, for proof-of-stake blocks
+    int64_t nTimeStakeFound{0};
+    // Whether the transactions after the coinbase and coinstake come from a CBlockTemplateTxs
+    bool fFromTemplateTxs{false};
 };
 
-// Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-struct CTxMemPoolModifiedEntry {
-    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
-    {
-        iter = entry;
-        nSizeWithAncestors = entry->GetSizeWithAncestors();
-        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
-    }
-
-    CTxMemPool::txiter iter;
-    uint64_t nSizeWithAncestors;
-    CAmount nModFeesWithAncestors;
-    unsigned int nSigOpCountWithAncestors;
-};
-
-/** Comparator for CTxMemPool::txiter objects.
- *  It simply compares the internal memory address of the CTxMemPoolEntry object
- *  pointed to. This means it has no meaning, and is only useful for using them
- *  as key in other indexes.
+/**
+ * The transactions of a block after its coinbase and coinstake (LLMQ
+ * commitments, then the mempool selection), assembled ahead of time.
  */
-struct CompareCTxMemPoolIter {
-    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct modifiedentry_iter {
-    typedef CTxMemPool::txiter result_type;
-    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
-    {
-        return entry.iter;
-    }
-};
-
-// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
-// except operating on CTxMemPoolModifiedEntry.
-// TODO: refactor to avoid duplication of this logic.
-struct CompareModifiedEntry {
-    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
-    {
-        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
-        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
-        if (f1 == f2) {
-            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
-        }
-        return f1 > f2;
-    }
-};
-
-// A comparator that sorts transactions based on number of ancestors.
-// This is sufficient to sort an ancestor package in an order that is valid
-// to appear in a block.
-struct CompareTxIterByAncestorCount {
-    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
-    {
-        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
-            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-        return CTxMemPool::CompareIteratorByHash()(a, b);
-    }
-};
-
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<
-            modifiedentry_iter,
-            CompareCTxMemPoolIter
-        >,
-        // sorted by modified ancestor fee rate
-        boost::multi_index::ordered_non_unique<
-            // Reuse same tag from CTxMemPool's similar index
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareModifiedEntry
-        >
-    >
-> indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
-
-struct update_for_parent_inclusion
+struct CBlockTemplateTxs
 {
-    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-    void operator() (CTxMemPoolModifiedEntry &e)
-    {
-        e.nModFeesWithAncestors -= iter->GetFee();
-        e.nSizeWithAncestors -= iter->GetTxSize();
-        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
-    }
+    uint256 hashPrevBlock;
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    // Number of LLMQ commitments at the front of vtx
+    size_t nCommitments{0};
+    uint64_t nBlockSize{0};
+    uint64_t nBlockTx{0};
+    unsigned int nBlockSigOps{0};
+    CAmount nFees{0};
+    // Sapling tree root after vtx, for a coinbase and coinstake without shielded outputs
+    uint256 hashFinalSaplingRoot;
 
-    CTxMemPool::txiter iter;
+    /** Whether the block on top of pindexPrev with these LLMQ commitments can use them */
+    bool IsValidFor(const CBlockIndex* pindexPrev, const std::vector<CTransactionRef>& vCommitmentsIn) const;
 };
 
-
 /** Generate a new block */
 class BlockAssembler
 {
@@ -147,7 +76,6 @@ private:
     uint64_t nBlockTx{0};
     unsigned int nBlockSigOps{0};
     CAmount nFees{0};
-    CTxMemPool::setEntries inBlock;
 
     // Chain context for the block
     int nHeight{0};
@@ -161,7 +89,9 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams, const bool defaultPrintPriority);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /** Construct a new block template with coinbase to scriptPubKeyIn.
+     *  pTemplateTxs, if valid on the tip, replaces the commitments and the mempool
+     *  selection: the block is then not tested for validity, ProcessNewBlock checks it. */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn,
                                    CWallet* pwallet = nullptr,
                                    bool fProofOfStake = false,
@@ -170,7 +100,10 @@ public:
                                    bool fTestValidity = true,
                                    CBlockIndex* prevBlock = nullptr,
                                    bool stopPoSOnNewBlock = true,
-                                   bool fIncludeQfc = true);
+                                   bool fIncludeQfc = true,
+                                   const CBlockTemplateTxs* pTemplateTxs = nullptr);
+    /** Assemble the transactions of the next block on top of pindexPrev, for the staker */
+    std::unique_ptr<CBlockTemplateTxs> CreateTemplateTxs(CBlockIndex* pindexPrev);
 
 private:
     // utility functions
@@ -178,29 +111,58 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Add a LLMQ commitment tx to the block */
+    void AddCommitmentToBlock(const CTransactionRef& qcTx);
+    /** Add the transactions assembled ahead of time to the block */
+    void AddTemplateTxsToBlock(const CBlockTemplateTxs& templateTxs);
 
     // Methods for how to add transactions to a block.
-    /** Add transactions based on feerate including unconfirmed ancestors */
+    /** Add the chunks of the mempool clusters by feerate */
     void addPackageTxs();
     /** Add the tip updated incremental merkle tree to the header */
     void appendSaplingTreeRoot();
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, unsigned int packageSigOps);
-    /** Test if a set of transactions are all final */
-    bool TestPackageFinality(const CTxMemPool::setEntries& package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-      * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
-    /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-      * state updated assuming given transactions are inBlock. */
-    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+    /** Test if the transactions of a chunk are all final, and its shielded
+     *  transactions can be added (updates nSizeShielded if they can) */
+    bool TestChunkTxs(const CTxMemPool::TxChunk& chunk);
+
+};
+
+/**
+ * Keeps the transactions of the next block assembled while the staker waits for
+ * a kernel, so that the mempool selection, the Sapling tree root and the
+ * validity test are off the path from a found kernel to ProcessNewBlock: a
+ * found stake only needs its coinbase and coinstake to be signed.
+ *
+ * The validation interface notifications mark it stale, and the staker
+ * rebuilds it when idle. A stale selection on the current tip is still valid
+ * (the mempool transactions it holds are not spent by another block), only
+ * possibly less profitable.
+ */
+class CStakerTemplateCache : public CValidationInterface
+{
+private:
+    Mutex cs;
+    std::shared_ptr<const CBlockTemplateTxs> ptemplateTxs GUARDED_BY(cs);
+    // Tip on which a block built from the cache was rejected: not used there any more
+    uint256 hashRejectedTip GUARDED_BY(cs);
+    std::atomic<bool> fStale{true};
 
+public:
+    /** Rebuild the transactions if they are stale or not on top of pindexPrev */
+    void Refresh(CBlockIndex* pindexPrev);
+    /** The transactions for a block on top of pindexPrev, or nullptr */
+    std::shared_ptr<const CBlockTemplateTxs> Get(const CBlockIndex* pindexPrev);
+    /** Stop using the cache on top of hashPrevBlock, after a block built from it was rejected */
+    void Reject(const uint256& hashPrevBlock);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override { fStale = true; }
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override { fStale = true; }
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason) override { fStale = true; }
 };
 
 /** Modify the nonce/extranonce in a block */
@@ -213,6 +175,30 @@ int32_t ComputeBlockVersion(const Consensus::Params& consensusParams, int nHeigh
 bool CreateCoinbaseTx(CBlock* pblock, const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev);
 CMutableTransaction CreateCoinbaseTx(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev);
 
+/**
+ * Sapling commitment tree of the tip, extended with the shielded outputs of
+ * block templates. A template mostly repeats the transactions of the previous
+ * one, in the same order: the tree after each shielded transaction of the last
+ * template is kept, so that the root of the next one only needs the outputs
+ * from the first transaction that differs to be appended.
+ */
+class CSaplingTreeFrontier
+{
+private:
+    Mutex cs;
+    // Best anchor the trees extend
+    uint256 hashAnchor GUARDED_BY(cs);
+    // The anchor tree, then the tree after each shielded transaction of the last template (by txid)
+    std::vector<std::pair<uint256, SaplingMerkleTree>> vTrees GUARDED_BY(cs);
+    // Outputs appended by the last GetRoot
+    size_t nLastAppended GUARDED_BY(cs){0};
+
+public:
+    /** Root of the tree of the best anchor of view, extended with the shielded outputs of vtx */
+    uint256 GetRoot(const CCoinsView& view, const std::vector<CTransactionRef>& vtx);
+    size_t GetLastAppended();
+};
+
 // Visible for testing purposes only
 uint256 CalculateSaplingTreeRoot(CBlock* pblock, int nHeight, const CChainParams& chainparams);
 
@@ -0,0 +1,133 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+#include "chain.h"
+#include "memusage.h"
+
+#include <assert.h>
+#include <new>
+#include <stdexcept>
+
+static_assert(std::is_trivially_destructible<CBlockIndexMap::value_type>::value, "entries are freed without destruction");
+
+size_t CBlockIndexMap::FindSlot(const uint256& hash, size_t nHash) const
+{
+    const size_t mask = nCapacity - 1;
+    for (size_t i = IdealSlot(nHash); table[i].pentry; i = (i + 1) & mask) {
+        if (table[i].nHash == nHash && table[i].pentry->first == hash) return i;
+    }
+    return nCapacity;
+}
+
+CBlockIndexMap::value_type* CBlockIndexMap::NewEntry(const uint256& hash, CBlockIndex* pindex)
+{
+    value_type* p;
+    if (!vFreeEntries.empty()) {
+        p = vFreeEntries.back();
+        vFreeEntries.pop_back();
+    } else {
+        if (nChunkUsed == ENTRIES_PER_CHUNK) {
+            vChunks.push_back(static_cast<value_type*>(::operator new(ENTRIES_PER_CHUNK * sizeof(value_type))));
+            nChunkUsed = 0;
+        }
+        p = vChunks.back() + nChunkUsed++;
+    }
+    return new (p) value_type(hash, pindex);
+}
+
+void CBlockIndexMap::Rehash(size_t nNewCapacity)
+{
+    assert(nNewCapacity >= 16 && (nNewCapacity & (nNewCapacity - 1)) == 0 && !NeedsGrowth(nSize, nNewCapacity));
+    Slot* oldTable = table;
+    const size_t nOldCapacity = nCapacity;
+
+    // Only the slots move: the entries, and the hashes pointed to by phashBlock, stay in place.
+    table = new Slot[nNewCapacity]();
+    nCapacity = nNewCapacity;
+    const size_t mask = nCapacity - 1;
+    for (size_t i = 0; i < nOldCapacity; i++) {
+        if (!oldTable[i].pentry) continue;
+        size_t j = IdealSlot(oldTable[i].nHash);
+        while (table[j].pentry) j = (j + 1) & mask;
+        table[j] = oldTable[i];
+    }
+    delete[] oldTable;
+}
+
+void CBlockIndexMap::clear()
+{
+    delete[] table;
+    table = nullptr;
+    nCapacity = 0;
+    nSize = 0;
+    for (value_type* chunk : vChunks) ::operator delete(chunk);
+    std::vector<value_type*>().swap(vChunks);
+    std::vector<value_type*>().swap(vFreeEntries);
+    nChunkUsed = ENTRIES_PER_CHUNK;
+}
+
+void CBlockIndexMap::reserve(size_t nEntries)
+{
+    size_t nNewCapacity = 16;
+    while (NeedsGrowth(nEntries, nNewCapacity)) nNewCapacity *= 2;
+    if (nNewCapacity > nCapacity) Rehash(nNewCapacity);
+}
+
+CBlockIndex* CBlockIndexMap::at(const uint256& hash) const
+{
+    const size_t i = FindSlot(hash);
+    if (i == nCapacity) throw std::out_of_range("CBlockIndexMap::at: unknown block " + hash.ToString());
+    return table[i].pentry->second;
+}
+
+std::pair<CBlockIndexMap::iterator, bool> CBlockIndexMap::emplace(const uint256& hash, CBlockIndex* pindex)
+{
+    assert(pindex);
+    const size_t nHash = hasher(hash);
+    if (nSize) {
+        const size_t nFound = FindSlot(hash, nHash);
+        if (nFound != nCapacity) return std::make_pair(iterator(table + nFound, table + nCapacity), false);
+    }
+
+    if (nCapacity == 0 || NeedsGrowth(nSize + 1, nCapacity)) {
+        Rehash(nCapacity == 0 ? 16 : nCapacity * 2);
+    }
+    const size_t mask = nCapacity - 1;
+    size_t i = IdealSlot(nHash);
+    while (table[i].pentry) i = (i + 1) & mask;
+    table[i].nHash = nHash;
+    table[i].pentry = NewEntry(hash, pindex);
+    nSize++;
+    return std::make_pair(iterator(table + i, table + nCapacity), true);
+}
+
+size_t CBlockIndexMap::erase(const uint256& hash)
+{
+    size_t i = FindSlot(hash);
+    if (i == nCapacity) return 0;
+    vFreeEntries.push_back(table[i].pentry);
+
+    // Backward-shift deletion: move back the slots of the probe sequence that
+    // would no longer be reachable from their ideal slot once slot i is empty.
+    const size_t mask = nCapacity - 1;
+    for (size_t j = (i + 1) & mask; table[j].pentry; j = (j + 1) & mask) {
+        const size_t k = IdealSlot(table[j].nHash);
+        const bool fReachable = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (fReachable) continue;
+        table[i] = table[j];
+        i = j;
+    }
+    table[i] = Slot();
+    nSize--;
+    return 1;
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vFreeEntries);
+    if (nCapacity) nUsage += memusage::MallocUsage(nCapacity * sizeof(Slot));
+    return nUsage + vChunks.size() * memusage::MallocUsage(ENTRIES_PER_CHUNK * sizeof(value_type));
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_BLOCKINDEXMAP_H
+#define MARIA_BLOCKINDEXMAP_H
+
+#include "saltedhasher.h"
+#include "uint256.h"
+
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Open-addressing (linear probing) hash map from block hash to block index entry.
+ * The slots are stored in a single array and hold the salted hash of the key with
+ * a pointer to the entry: a lookup walks the array, and only compares the keys of
+ * the slots whose hash matches. An insertion doesn't allocate a slot unless the
+ * table has to grow, which reserve() avoids when the number of entries is known
+ * in advance.
+ *
+ * The entries (key and value) are allocated in chunks, and never move: like with the
+ * node-based map it replaces, CBlockIndex::phashBlock points to the key of its entry,
+ * and stays valid when the table grows or other entries are erased (it is read without
+ * cs_main, e.g. by the validation interface clients).
+ * Null values are not allowed.
+ */
+class CBlockIndexMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+
+private:
+    struct Slot {
+        //! Salted hash of the key
+        size_t nHash;
+        //! Null for an empty slot
+        value_type* pentry;
+    };
+
+public:
+    template <typename Value>
+    class Iterator
+    {
+    private:
+        const Slot* pslot{nullptr};
+        const Slot* pend{nullptr};
+
+        void SkipEmpty()
+        {
+            while (pslot != pend && !pslot->pentry) ++pslot;
+        }
+
+        template <typename Other> friend class Iterator;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::remove_const<Value>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        Iterator() {}
+        Iterator(const Slot* pslotIn, const Slot* pendIn) : pslot(pslotIn), pend(pendIn) { SkipEmpty(); }
+        //! iterator to const_iterator
+        template <typename Other, typename = typename std::enable_if<std::is_convertible<Other*, Value*>::value>::type>
+        Iterator(const Iterator<Other>& other) : pslot(other.pslot), pend(other.pend) {}
+
+        Value& operator*() const { return *pslot->pentry; }
+        Value* operator->() const { return pslot->pentry; }
+        Iterator& operator++() { ++pslot; SkipEmpty(); return *this; }
+        Iterator operator++(int) { Iterator copy(*this); ++(*this); return copy; }
+        bool operator==(const Iterator& other) const { return pslot == other.pslot; }
+        bool operator!=(const Iterator& other) const { return pslot != other.pslot; }
+    };
+
+    typedef Iterator<value_type> iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+private:
+    static const size_t ENTRIES_PER_CHUNK = 1024;
+
+    //! nCapacity slots
+    Slot* table{nullptr};
+    //! Zero or a power of two
+    size_t nCapacity{0};
+    size_t nSize{0};
+    SaltedHasher<uint256, SaltedHasherBase> hasher;
+
+    //! Storage of the entries, never moved until clear()
+    std::vector<value_type*> vChunks;
+    //! entries used in the last chunk
+    size_t nChunkUsed{ENTRIES_PER_CHUNK};
+    //! erased entries, reused first
+    std::vector<value_type*> vFreeEntries;
+
+    static bool NeedsGrowth(size_t nEntries, size_t nSlots) { return nEntries * 4 > nSlots * 3; }
+
+    size_t IdealSlot(size_t nHash) const { return nHash & (nCapacity - 1); }
+    //! Slot holding hash, or nCapacity if there is none
+    size_t FindSlot(const uint256& hash, size_t nHash) const;
+    size_t FindSlot(const uint256& hash) const { return nSize ? FindSlot(hash, hasher(hash)) : nCapacity; }
+    value_type* NewEntry(const uint256& hash, CBlockIndex* pindex);
+    void Rehash(size_t nNewCapacity);
+
+public:
+    CBlockIndexMap() {}
+    ~CBlockIndexMap() { clear(); }
+    CBlockIndexMap(const CBlockIndexMap&) = delete;
+    CBlockIndexMap& operator=(const CBlockIndexMap&) = delete;
+
+    iterator begin() { return iterator(table, table + nCapacity); }
+    iterator end() { return iterator(table + nCapacity, table + nCapacity); }
+    const_iterator begin() const { return const_iterator(table, table + nCapacity); }
+    const_iterator end() const { return const_iterator(table + nCapacity, table + nCapacity); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    //! Removes all the entries and frees the table
+    void clear();
+    //! Grows the table so that it holds nEntries without rehashing
+    void reserve(size_t nEntries);
+
+    iterator find(const uint256& hash) { return iterator(table + FindSlot(hash), table + nCapacity); }
+    const_iterator find(const uint256& hash) const { return const_iterator(table + FindSlot(hash), table + nCapacity); }
+    size_t count(const uint256& hash) const { return FindSlot(hash) != nCapacity ? 1 : 0; }
+    //! Throws std::out_of_range if there is no entry for hash
+    CBlockIndex* at(const uint256& hash) const;
+
+    //! Invalidates the iterators (but not the keys of the other entries)
+    std::pair<iterator, bool> emplace(const uint256& hash, CBlockIndex* pindex);
+    std::pair<iterator, bool> insert(const value_type& value) { return emplace(value.first, value.second); }
+    //! Invalidates the iterators and the key of the erased entry (but not the keys of the other entries)
+    size_t erase(const uint256& hash);
+
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // MARIA_BLOCKINDEXMAP_H
@@ -1592,7 +1592,10 @@ bool CheckCollateral(const uint256& nTxCollateralHash, const uint256& nExpectedH
     CTransactionRef txCollateral;
     uint256 nBlockHash;
     if (!GetTransaction(nTxCollateralHash, txCollateral, nBlockHash, true)) {
-        strError = strprintf("Can't find collateral tx %s", nTxCollateralHash.ToString());
+        // Coins and undo data cannot stand in for it here: the check needs the whole
+        // transaction (OP_RETURN output, nLockTime), that a pruned node may no longer have.
+        strError = strprintf("Can't find collateral tx %s%s", nTxCollateralHash.ToString(),
+                             fHavePruned ? " (its block may be pruned)" : "");
         return false;
     }
 
@@ -6,7 +6,12 @@
 
 #include "chain.h"
 #include "legacy/stakemodifier.h"  // for ComputeNextStakeModifier
+#include "memusage.h"
+#include "sync.h"
 
+#include <map>
+
+constexpr CAmount CBlockIndex::CHAIN_SAPLING_VALUE_UNKNOWN;
 
 /**
  * CChain implementation
@@ -121,20 +126,62 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-CBlockIndex::CBlockIndex(const CBlock& block):
+/**
+ * Side table of the accumulator checkpoints, which only zerocoin-era blocks have:
+ * storing them in every entry would cost 32 bytes per block.
+ * It is never destroyed, as block index entries can outlive any other static object.
+ */
+struct AccumulatorCheckpoints
+{
+    Mutex cs;
+    std::map<const CBlockIndex*, uint256> map GUARDED_BY(cs);
+};
+
+static AccumulatorCheckpoints& GetAccumulatorCheckpoints()
+{
+    static AccumulatorCheckpoints* checkpoints = new AccumulatorCheckpoints();
+    return *checkpoints;
+}
+
+static bool HasAccumulatorCheckpoint(int32_t nVersion)
+{
+    return nVersion > 3 && nVersion < 7;
+}
+
+size_t AccumulatorCheckpointsDynamicUsage()
+{
+    AccumulatorCheckpoints& checkpoints = GetAccumulatorCheckpoints();
+    LOCK(checkpoints.cs);
+    return memusage::DynamicUsage(checkpoints.map);
+}
+
+CBlockIndex::CBlockIndex(const CBlockHeader& block):
         nVersion{block.nVersion},
-        hashMerkleRoot{block.hashMerkleRoot},
-        hashFinalSaplingRoot(block.hashFinalSaplingRoot),
         nTime{block.nTime},
         nBits{block.nBits},
-        nNonce{block.nNonce}
+        nNonce{block.nNonce},
+        hashMerkleRoot{block.hashMerkleRoot},
+        hashFinalSaplingRoot(block.hashFinalSaplingRoot)
+{
+    SetAccumulatorCheckpoint(block.nAccumulatorCheckpoint);
+}
+
+CBlockIndex::CBlockIndex(const CBlock& block):
+        CBlockIndex(static_cast<const CBlockHeader&>(block))
 {
-    if(block.nVersion > 3 && block.nVersion < 7)
-        nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
     if (block.IsProofOfStake())
         SetProofOfStake();
 }
 
+CBlockIndex::~CBlockIndex()
+{
+    if (HasAccumulatorCheckpoint(nVersion)) {
+        AccumulatorCheckpoints& checkpoints = GetAccumulatorCheckpoints();
+        LOCK(checkpoints.cs);
+        checkpoints.map.erase(this);
+    }
+}
+
 std::string CBlockIndex::ToString() const
 {
     return strprintf("CBlockIndex(pprev=%p, nHeight=%d, merkle=%s, hashBlock=%s)",
@@ -172,7 +219,7 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     block.nTime = nTime;
     block.nBits = nBits;
     block.nNonce = nNonce;
-    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+    if (HasAccumulatorCheckpoint(nVersion)) block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
     if (nVersion >= 8) block.hashFinalSaplingRoot = hashFinalSaplingRoot;
     return block;
 }
@@ -295,17 +342,47 @@ uint256 CBlockIndex::GetStakeModifierV2() const
     return nStakeModifier;
 }
 
+Optional<CAmount> CBlockIndex::GetChainSaplingValue() const
+{
+    if (nChainSaplingValue == CHAIN_SAPLING_VALUE_UNKNOWN) return nullopt;
+    return nChainSaplingValue;
+}
+
+void CBlockIndex::SetChainSaplingValue(const Optional<CAmount>& nValue)
+{
+    nChainSaplingValue = nValue ? *nValue : CHAIN_SAPLING_VALUE_UNKNOWN;
+}
+
 void CBlockIndex::SetChainSaplingValue()
 {
     // Sapling, update chain value
     if (pprev) {
-        if (pprev->nChainSaplingValue) {
-            nChainSaplingValue = *pprev->nChainSaplingValue + nSaplingValue;
-        } else {
-            nChainSaplingValue = nullopt;
-        }
+        const Optional<CAmount> nPrevValue = pprev->GetChainSaplingValue();
+        SetChainSaplingValue(nPrevValue ? Optional<CAmount>(*nPrevValue + nSaplingValue) : nullopt);
+    } else {
+        SetChainSaplingValue(nSaplingValue);
+    }
+}
+
+uint256 CBlockIndex::GetAccumulatorCheckpoint() const
+{
+    if (!HasAccumulatorCheckpoint(nVersion)) return UINT256_ZERO;
+    AccumulatorCheckpoints& checkpoints = GetAccumulatorCheckpoints();
+    LOCK(checkpoints.cs);
+    const auto it = checkpoints.map.find(this);
+    return it != checkpoints.map.end() ? it->second : UINT256_ZERO;
+}
+
+void CBlockIndex::SetAccumulatorCheckpoint(const uint256& nCheckpoint)
+{
+    if (!HasAccumulatorCheckpoint(nVersion)) return;
+    AccumulatorCheckpoints& checkpoints = GetAccumulatorCheckpoints();
+    LOCK(checkpoints.cs);
+    // Only non-null checkpoints take space
+    if (nCheckpoint.IsNull()) {
+        checkpoints.map.erase(this);
     } else {
-        nChainSaplingValue = nSaplingValue;
+        checkpoints.map[this] = nCheckpoint;
     }
 }
 
@@ -353,3 +430,22 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
 }
 
 
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        const size_t nEntries = (i + 1 == vChunks.size() ? nChunkUsed : ENTRIES_PER_CHUNK);
+        for (size_t j = 0; j < nEntries; j++) {
+            vChunks[i][j].~CBlockIndex();
+        }
+        ::operator delete(vChunks[i]);
+    }
+    vChunks.clear();
+    nChunkUsed = ENTRIES_PER_CHUNK;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(ENTRIES_PER_CHUNK * sizeof(CBlockIndex)) * vChunks.size() +
+           memusage::DynamicUsage(vChunks);
+}
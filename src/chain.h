@@ -13,6 +13,7 @@
 #include "chainparams.h"
 #include "flatfile.h"
 #include "optional.h"
+#include "prevector.h"
 #include "primitives/block.h"
 #include "timedata.h"
 #include "tinyformat.h"
@@ -20,6 +21,7 @@
 #include "util/system.h"
 #include "libzerocoin/Denominations.h"
 
+#include <limits>
 #include <vector>
 
 /**
@@ -138,6 +140,9 @@ enum {
 class CBlockIndex
 {
 public:
+    //! nChainSaplingValue of entries whose chain value is not known (nullopt)
+    static constexpr CAmount CHAIN_SAPLING_VALUE_UNKNOWN = std::numeric_limits<CAmount>::min();
+
     //! pointer to the hash of the block, if any. memory is owned by this CBlockIndex
     const uint256* phashBlock{nullptr};
 
@@ -174,10 +179,7 @@ public:
     //! Verification status of this block. See enum BlockStatus
     uint32_t nStatus{0};
 
-    // proof-of-stake specific fields
-    // char vector holding the stake modifier bytes. It is empty for PoW blocks.
-    // Modifier V1 is 64 bit while modifier V2 is 256 bit.
-    std::vector<unsigned char> vStakeModifier{};
+    // proof-of-stake specific flags
     unsigned int nFlags{0};
 
     //! Change in value held by the Sapling circuit over this block.
@@ -185,18 +187,19 @@ public:
     //! rely on the invariant that every block before this was added had nSaplingValue = 0.
     CAmount nSaplingValue{0};
 
+private:
     //! (memory only) Total value held by the Sapling circuit up to and including this block.
-    //! Will be nullopt if nChainTx is zero.
-   Optional<CAmount> nChainSaplingValue{nullopt};
+    //! CHAIN_SAPLING_VALUE_UNKNOWN if nChainTx is zero. See GetChainSaplingValue.
+    CAmount nChainSaplingValue{CHAIN_SAPLING_VALUE_UNKNOWN};
 
+public:
     //! block header
     int32_t nVersion{0};
-    uint256 hashMerkleRoot{};
-    uint256 hashFinalSaplingRoot{};
     uint32_t nTime{0};
     uint32_t nBits{0};
     uint32_t nNonce{0};
-    uint256 nAccumulatorCheckpoint{};
+    uint256 hashMerkleRoot{};
+    uint256 hashFinalSaplingRoot{};
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId{0};
@@ -204,8 +207,18 @@ public:
     //! (memory only) Maximum nTime in the chain upto and including this block.
     unsigned int nTimeMax{0};
 
+    // proof-of-stake specific fields
+    // bytes of the stake modifier, stored inline. It is empty for PoW blocks.
+    // Modifier V1 is 64 bit while modifier V2 is 256 bit.
+    prevector<32, unsigned char> vStakeModifier{};
+
     CBlockIndex() {}
+    explicit CBlockIndex(const CBlockHeader& block);
     CBlockIndex(const CBlock& block);
+    //! Copies don't share the side table entries of the original (see GetAccumulatorCheckpoint)
+    CBlockIndex(const CBlockIndex& other) = default;
+    CBlockIndex& operator=(const CBlockIndex& other) = default;
+    ~CBlockIndex();
 
     std::string ToString() const;
 
@@ -236,8 +249,15 @@ public:
     uint64_t GetStakeModifierV1() const;
     uint256 GetStakeModifierV2() const;
 
-    // Update Sapling chain value
-    void SetChainSaplingValue();
+    // Sapling chain value
+    Optional<CAmount> GetChainSaplingValue() const;
+    void SetChainSaplingValue(const Optional<CAmount>& nValue);
+    void SetChainSaplingValue();                            // from pprev and nSaplingValue
+
+    // Accumulator checkpoint of zerocoin-era (v4 to v6) blocks, kept in a side table:
+    // it is null for every other block.
+    uint256 GetAccumulatorCheckpoint() const;
+    void SetAccumulatorCheckpoint(const uint256& nCheckpoint);
 
     //! Check whether this block index entry is valid up to the passed validity level.
     bool IsValid(enum BlockStatus nUpTo = BLOCK_VALID_TRANSACTIONS) const;
@@ -251,6 +271,51 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/** Memory held by the accumulator checkpoints side table (see CBlockIndex::GetAccumulatorCheckpoint) */
+size_t AccumulatorCheckpointsDynamicUsage();
+
+/**
+ * Arena for the entries of the block index. Entries are constructed in place in
+ * large chunks, so that loading millions of them needs neither one heap allocation
+ * each nor its bookkeeping. They are never freed one by one: Clear() destroys them
+ * all, when the block index is unloaded.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t ENTRIES_PER_CHUNK = 4096;
+
+    std::vector<CBlockIndex*> vChunks;
+    //! entries constructed in the last chunk
+    size_t nChunkUsed{ENTRIES_PER_CHUNK};
+
+public:
+    CBlockIndexArena() {}
+    ~CBlockIndexArena() { Clear(); }
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    template <typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        if (nChunkUsed == ENTRIES_PER_CHUNK) {
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(ENTRIES_PER_CHUNK * sizeof(CBlockIndex))));
+            nChunkUsed = 0;
+        }
+        CBlockIndex* pindex = new (vChunks.back() + nChunkUsed) CBlockIndex(std::forward<Args>(args)...);
+        nChunkUsed++;
+        return pindex;
+    }
+
+    //! Destroys all the entries. Pointers returned by New() are invalidated.
+    void Clear();
+
+    //! Number of entries
+    size_t Size() const { return vChunks.empty() ? 0 : (vChunks.size() - 1) * ENTRIES_PER_CHUNK + nChunkUsed; }
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /** Find the forking point between two chain tips. */
 const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb);
 
@@ -264,15 +329,18 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    uint256 nAccumulatorCheckpoint;
 
     CDiskBlockIndex()
     {
         hashPrev = UINT256_ZERO;
+        nAccumulatorCheckpoint = UINT256_ZERO;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : UINT256_ZERO);
+        nAccumulatorCheckpoint = pindex->GetAccumulatorCheckpoint();
     }
 
     SERIALIZE_METHODS(CDiskBlockIndex, obj)
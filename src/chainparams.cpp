@@ -203,6 +203,13 @@ public:
         assert(consensus.hashGenesisBlock == uint256S("0x0000040cb60b26f13ffcd2f692d679e172da34096041efe215d8c50cd65dd9f9"));
         assert(genesis.hashMerkleRoot == uint256S("0x5e82501aa4f898173ca938fef4d080f25969109efd7b790fe323bcff9f16dc04"));
 
+        // Update both at each release, together with the checkpoints.
+        // Lower bound of the work up to the last checkpoint (299504): every block, PoW or
+        // PoS, proves at least 2^20, the target limits being 0x00000fff..ff
+        consensus.nMinimumChainWork = uint256S("0x491f100000"); // 299505 << 20
+        consensus.defaultAssumeValid = uint256S("0x673af1c0321b0b9d987a4a110699182332bcbcef9ac09963b7f0101f7cd689a6"); // 299504
+        consensus.defaultAssumeValidHeight = 299504;
+
         consensus.fPowAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
         consensus.powLimit   = uint256S("0x00000fffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
@@ -303,6 +310,7 @@ public:
         pchMessageStart[2] = 0xc6;
         pchMessageStart[3] = 0xd9;
         nDefaultPort = 47773;
+        nPruneAfterHeight = 100000;
 
         // Note that of those with the service bits flag, most only support a subset of possible options
         vSeeds.emplace_back("199.127.140.224", true);     // Primary DNS Seeder
@@ -370,6 +378,10 @@ public:
         assert(consensus.hashGenesisBlock == uint256S("0x0000041e482b9b9691d98eefb48473405c0b8ec31b76df3797c74a78680ef818"));
         assert(genesis.hashMerkleRoot == uint256S("0x1b2ef6e2f28be914103a277377ae7729dcd125dfeb8bf97bd5964ba72b6dc39b"));
 
+        consensus.nMinimumChainWork = uint256S("0x00");
+        consensus.defaultAssumeValid = uint256S("0x00");
+        consensus.defaultAssumeValidHeight = 0;
+
         consensus.fPowAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = false;
         consensus.powLimit   = uint256S("0x00000fffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
@@ -450,6 +462,7 @@ public:
         pchMessageStart[2] = 0xd5;
         pchMessageStart[3] = 0xca;
         nDefaultPort = 51474;
+        nPruneAfterHeight = 1000;
 
         // nodes with support for servicebits filtering should be at the top
         vSeeds.emplace_back("maria-testnet.seed.mariacoin.com", true);
@@ -512,6 +525,10 @@ public:
         assert(consensus.hashGenesisBlock == uint256S("0x7445589c4c8e52b105247b13373e5ee325856aa05d53f429e59ea46b7149ae3f"));
         assert(genesis.hashMerkleRoot == uint256S("0x1b2ef6e2f28be914103a277377ae7729dcd125dfeb8bf97bd5964ba72b6dc39b"));
 
+        consensus.nMinimumChainWork = uint256S("0x00");
+        consensus.defaultAssumeValid = uint256S("0x00");
+        consensus.defaultAssumeValidHeight = 0;
+
         consensus.fPowAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = true;
         consensus.powLimit   = uint256S("0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
@@ -598,6 +615,7 @@ public:
         pchMessageStart[2] = 0x7e;
         pchMessageStart[3] = 0xac;
         nDefaultPort = 51476;
+        nPruneAfterHeight = 1000;
 
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1, 139); // Testnet maria addresses start with 'x' or 'y'
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1, 19);  // Testnet maria script addresses start with '8' or '9'
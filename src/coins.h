@@ -11,6 +11,7 @@
 #include "consensus/consensus.h" // can be removed once policy/ established
 #include "crypto/siphash.h"
 #include "memusage.h"
+#include "pooledhashmap.h"
 #include "sapling/incrementalmerkletree.h"
 #include "script/standard.h"
 #include "serialize.h"
@@ -174,7 +175,7 @@ struct CNullifiersCacheEntry
 typedef std::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedIdHasher> CAnchorsSaplingMap;
 typedef std::unordered_map<uint256, CNullifiersCacheEntry, SaltedIdHasher> CNullifiersMap;
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef PooledHashMap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
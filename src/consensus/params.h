@@ -169,6 +169,12 @@ struct LLMQParams {
  */
 struct Params {
     uint256 hashGenesisBlock;
+    // The best chain should have at least this much work
+    uint256 nMinimumChainWork;
+    // By default assume that the signatures and proofs in ancestors of this block are valid
+    uint256 defaultAssumeValid;
+    // Height of defaultAssumeValid: the headers up to it are stored ahead of their blocks
+    int defaultAssumeValidHeight;
     bool fPowAllowMinDifficultyBlocks;
     bool fPowNoRetargeting;
     uint256 powLimit;
@@ -127,10 +127,10 @@ bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCol
     return true;
 }
 
-bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD)
+bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD, bool fCheckSaplingProofs)
 {
     // Dispatch to Sapling validator
-    if (!SaplingValidation::ContextualCheckTransaction(*tx, state, chainparams, nHeight, isMined, fIBD)) {
+    if (!SaplingValidation::ContextualCheckTransaction(*tx, state, chainparams, nHeight, isMined, fIBD, fCheckSaplingProofs)) {
         return false; // Failure reason has been set in validation state object
     }
 
@@ -20,8 +20,8 @@ class CValidationState;
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fColdStakingActive);
-/** Context-dependent validity checks */
-bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD);
+/** Context-dependent validity checks (Sapling proofs verification can be deferred to the caller) */
+bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD, bool fCheckSaplingProofs = true);
 
 /**
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
@@ -193,14 +193,38 @@ bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx)
     // Now get the chain tx
     CTransactionRef tx;
     uint256 hashBlock;
-    if (!GetTransaction(txHash, tx, hashBlock, true))
-        return false;
+    if (!GetTransaction(txHash, tx, hashBlock, true)) {
+        if (!fHavePruned) return false;
+        // Without the tx index (pruned node), look for the spend in the blocks that can still
+        // be disconnected (always kept on disk). If it is not there, it is deeper in the
+        // active chain: the serial is spent before any fork we may accept.
+        LOCK(cs_main);
+        const int nMaxDepth = gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH);
+        const CBlockIndex* pindex = chainActive.Tip();
+        for (; pindex && chainActive.Height() - pindex->nHeight <= nMaxDepth; pindex = pindex->pprev) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex)) {
+                // cannot tell where, so consider it spent before any fork
+                LogPrintf("%s: block %s not on disk\n", __func__, pindex->GetBlockHash().GetHex());
+                nHeightTx = 0;
+                return true;
+            }
+            for (const auto& txBlock : block.vtx) {
+                if (txBlock->GetHash() == txHash) {
+                    nHeightTx = pindex->nHeight;
+                    return true;
+                }
+            }
+        }
+        nHeightTx = pindex ? pindex->nHeight : 0;
+        return true;
+    }
 
     if (hashBlock.IsNull() || !mapBlockIndex.count(hashBlock)) {
         return false;
     }
 
-    CBlockIndex* pindex = mapBlockIndex[hashBlock];
+    CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
     if (!chainActive.Contains(pindex)) {
         return false;
     }
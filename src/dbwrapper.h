@@ -173,6 +173,12 @@ public:
         return CDataStream(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
     }
 
+    CDataStream GetValue()
+    {
+        leveldb::Slice slValue = piter->value();
+        return CDataStream(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+    }
+
     template<typename V> bool GetValue(V& value)
     {
         leveldb::Slice slValue = piter->value();
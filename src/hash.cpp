@@ -7,6 +7,114 @@
 #include "crypto/common.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/scrypt.h"
+#include "crypto/sph_blake.h"
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_skein.h"
+
+namespace {
+
+/**
+ * Pre-initialized Quark contexts. Each thread keeps its own copy, so a hash
+ * only has to copy the initial states, instead of running the init functions
+ * of the six algorithms (and no synchronization is needed).
+ */
+struct QuarkContexts
+{
+    sph_blake512_context blake;
+    sph_bmw512_context bmw;
+    sph_groestl512_context groestl;
+    sph_jh512_context jh;
+    sph_keccak512_context keccak;
+    sph_skein512_context skein;
+};
+
+static QuarkContexts InitQuarkContexts()
+{
+    QuarkContexts ctx;
+    sph_blake512_init(&ctx.blake);
+    sph_bmw512_init(&ctx.bmw);
+    sph_groestl512_init(&ctx.groestl);
+    sph_jh512_init(&ctx.jh);
+    sph_keccak512_init(&ctx.keccak);
+    sph_skein512_init(&ctx.skein);
+    return ctx;
+}
+
+static thread_local const QuarkContexts quarkInit = InitQuarkContexts();
+
+/** The Quark branches depend on bit 3 of the (little endian) 512-bit intermediate hash */
+inline bool QuarkBit(const unsigned char* hash) { return (hash[0] & 8) != 0; }
+
+} // anon namespace
+
+uint256 HashQuark(const unsigned char* data, size_t len)
+{
+    const QuarkContexts& init = quarkInit;
+    QuarkContexts ctx;
+    unsigned char hash[2][64];
+
+    ctx.blake = init.blake;
+    sph_blake512(&ctx.blake, data, len);
+    sph_blake512_close(&ctx.blake, hash[0]);
+
+    ctx.bmw = init.bmw;
+    sph_bmw512(&ctx.bmw, hash[0], 64);
+    sph_bmw512_close(&ctx.bmw, hash[1]);
+
+    if (QuarkBit(hash[1])) {
+        ctx.groestl = init.groestl;
+        sph_groestl512(&ctx.groestl, hash[1], 64);
+        sph_groestl512_close(&ctx.groestl, hash[0]);
+    } else {
+        ctx.skein = init.skein;
+        sph_skein512(&ctx.skein, hash[1], 64);
+        sph_skein512_close(&ctx.skein, hash[0]);
+    }
+
+    ctx.groestl = init.groestl;
+    sph_groestl512(&ctx.groestl, hash[0], 64);
+    sph_groestl512_close(&ctx.groestl, hash[1]);
+
+    ctx.jh = init.jh;
+    sph_jh512(&ctx.jh, hash[1], 64);
+    sph_jh512_close(&ctx.jh, hash[0]);
+
+    if (QuarkBit(hash[0])) {
+        ctx.blake = init.blake;
+        sph_blake512(&ctx.blake, hash[0], 64);
+        sph_blake512_close(&ctx.blake, hash[1]);
+    } else {
+        ctx.bmw = init.bmw;
+        sph_bmw512(&ctx.bmw, hash[0], 64);
+        sph_bmw512_close(&ctx.bmw, hash[1]);
+    }
+
+    ctx.keccak = init.keccak;
+    sph_keccak512(&ctx.keccak, hash[1], 64);
+    sph_keccak512_close(&ctx.keccak, hash[0]);
+
+    ctx.skein = init.skein;
+    sph_skein512(&ctx.skein, hash[0], 64);
+    sph_skein512_close(&ctx.skein, hash[1]);
+
+    if (QuarkBit(hash[1])) {
+        ctx.keccak = init.keccak;
+        sph_keccak512(&ctx.keccak, hash[1], 64);
+        sph_keccak512_close(&ctx.keccak, hash[0]);
+    } else {
+        ctx.jh = init.jh;
+        sph_jh512(&ctx.jh, hash[1], 64);
+        sph_jh512_close(&ctx.jh, hash[0]);
+    }
+
+    // Truncate to the lower 256 bits
+    uint256 result;
+    memcpy(result.begin(), hash[0], 32);
+    return result;
+}
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
 {
@@ -17,10 +17,12 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockassembler.h"
 #include "bls/bls_wrapper.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
+#include "crypto/sha256.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
@@ -42,6 +44,7 @@
 #include "sporkdb.h"
 #include "tiertwo/init.h"
 #include "txdb.h"
+#include "txprecheck.h"
 #include "torcontrol.h"
 #include "guiinterface.h"
 #include "guiinterfaceutil.h"
@@ -60,6 +63,7 @@
 
 #include <atomic>
 #include <fstream>
+#include <limits>
 #include <stdint.h>
 #include <stdio.h>
 #include <memory>
@@ -227,6 +231,7 @@ void Shutdown()
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
     if (g_connman) g_connman->Stop();
+    StopTxPreCheckThreads();
 
     StopTorControl();
 
@@ -389,6 +394,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", "This help message");
     strUsage += HelpMessageOpt("-version", "Print version and exit");
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)");
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script and Sapling proof verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
     strUsage += HelpMessageOpt("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)");
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)");
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS));
@@ -401,6 +407,8 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", "Specify data directory");
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf("Write the coins cache to disk on a dedicated thread, without stalling block validation. "
+                                                             "The cache can use up to twice -dbcache while a write is in progress (default: %u)", DEFAULT_BACKGROUND_FLUSH));
     if (showDebug) {
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
@@ -418,12 +426,18 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf("Specify pid file (default: %s)", MARIA_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, "
+            "and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks");
     strUsage += HelpMessageOpt("-reindex", "Rebuild block chain index from current blk000??.dat files on startup");
+    strUsage += HelpMessageOpt("-reindexreadahead=<n>", strprintf("Maximum size in megabytes of the block files read ahead by -reindex, held in memory until their blocks are connected (default: %u)", DEFAULT_REINDEX_READAHEAD));
     strUsage += HelpMessageOpt("-resync", "Delete blockchain folders and resync from scratch on startup");
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)");
 #endif
+    strUsage += HelpMessageOpt("-txprecheckthreads=<n>", strprintf("Set the number of threads verifying the signatures and proofs of the transactions received from peers before adding them to the mempool (0 to %d, 0 = verify them in the message handler, default: %d)", MAX_TXPRECHECK_THREADS, DEFAULT_TXPRECHECK_THREADS));
     strUsage += HelpMessageOpt("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt("-forcestart", "Attempt to force blockchain corruption recovery on startup");
 
@@ -495,6 +509,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-limitclustercount=<n>", strprintf("Do not accept transactions that would join a cluster of more than <n> in-mempool transactions (default: %u)", DEFAULT_CLUSTER_LIMIT));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", "Enable spork administration functionality with the appropriate private key.");
         strUsage += HelpMessageOpt("-nuparams=upgradeName:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
     }
@@ -616,6 +631,45 @@ static void BlockNotifyGenesisWait(bool, const CBlockIndex *pBlockIndex)
 ////////////////////////////////////////////////////
 
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    const fs::path blocksdir = GetBlocksDir();
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
+        const std::string strFile = it->path().filename().string();
+        if (fs::is_regular_file(*it) && strFile.length() == 12 && strFile.substr(8, 4) == ".dat") {
+            if (strFile.substr(0, 3) == "blk")
+                mapBlockFiles[strFile.substr(3, 5)] = it->path();
+            else if (strFile.substr(0, 3) == "rev")
+                fs::remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, fs::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        fs::remove(item.second);
+    }
+}
+
 struct CImportingNow {
     CImportingNow()
     {
@@ -638,18 +692,8 @@ void ThreadImport(const std::vector<fs::path>& vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            FlatFilePos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos)))
-                break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
-            nFile++;
-        }
+        if (!ReindexBlockFiles())
+            return; // Shutdown requested: resume the reindex on next start
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -898,6 +942,12 @@ void InitParameterInteraction()
         if (gArgs.SoftSetBoolArg("-discover", false))
             LogPrintf("%s : parameter interaction: -externalip set -> setting -discover=0\n", __func__);
     }
+
+    if (gArgs.GetArg("-prune", 0) > 0) {
+        // the transaction index points into block files that pruning deletes
+        if (gArgs.SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -txindex=0\n", __func__);
+    }
 }
 
 bool InitNUParams()
@@ -1049,6 +1099,38 @@ bool AppInitParameterInteraction()
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
+    nMinimumChainWork = UintToArith256(Params().GetConsensus().nMinimumChainWork);
+    hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", Params().GetConsensus().defaultAssumeValid.GetHex()));
+    nAssumeValidHeight = hashAssumeValid == Params().GetConsensus().defaultAssumeValid ? Params().GetConsensus().defaultAssumeValidHeight : 0;
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid signatures and proofs.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures and proofs for all blocks.\n");
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nPruneArg = gArgs.GetArg("-prune", 0);
+    if (nPruneArg < 0) {
+        return UIError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t) nPruneArg * 1024 * 1024;
+    if (nPruneArg == 1) {  // manual pruning: -prune=1
+        LogPrintf("Block pruning enabled.  Use RPC call pruneblockchain(height) to manually prune block and undo files.\n");
+        nPruneTarget = std::numeric_limits<uint64_t>::max();
+        fPruneMode = true;
+    } else if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return UIError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+    if (fPruneMode) {
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+            return UIError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-reindex-chainstate", false))
+            return UIError(_("Prune mode is incompatible with -reindex-chainstate. Use full -reindex instead."));
+    }
+
     // -mempoollimit limits
     int64_t nMempoolSizeLimit = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t nMempoolDescendantSizeLimit = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
@@ -1147,6 +1229,8 @@ bool AppInitSanityChecks()
     // ********************************************************* Step 4: sanity checks
 
     // Initialize elliptic curve code
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1293,6 +1377,9 @@ bool AppInitMain()
     peerLogic.reset(new PeerLogicValidation(&connman));
     RegisterValidationInterface(peerLogic.get());
 
+    const int nTxPreCheckThreads = std::max(0, std::min((int)gArgs.GetArg("-txprecheckthreads", DEFAULT_TXPRECHECK_THREADS), MAX_TXPRECHECK_THREADS));
+    StartTxPreCheckThreads(nTxPreCheckThreads, [&connman] { connman.WakeMessageHandler(); });
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string& cmt : gArgs.GetArgs("-uacomment")) {
@@ -1470,6 +1557,9 @@ bool AppInitMain()
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                    if (fPruneMode)
+                        CleanupBlockRevFiles();
                 }
 
                 // End loop if shutdown was requested
@@ -1505,6 +1595,13 @@ bool AppInitMain()
                     break;
                 }
 
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk.
                 // This is called again in ThreadImport in the reindex completes.
@@ -1536,6 +1633,9 @@ bool AppInitMain()
 
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                if (gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH)) {
+                    pcoinsdbview->StartFlushThread();
+                }
 
                 InitTierTwoPostCoinsCacheLoad();
 
@@ -1583,6 +1683,11 @@ bool AppInitMain()
                         break;
                     }
 
+                    if (fHavePruned && gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS) > (int64_t)GetPruneKeepDepth()) {
+                        LogPrintf("Prune: pruned datadir may not have more than %d blocks; only checking available blocks\n",
+                                  GetPruneKeepDepth());
+                    }
+
                     if (!CVerifyDB().VerifyDB(pcoinsdbview.get(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                             gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                         strLoadError = _("Corrupted block database detected");
@@ -1642,6 +1747,17 @@ bool AppInitMain()
 #endif
     // ********************************************************* Step 9: import blocks
 
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices = ServiceFlags((nLocalServices & ~NODE_NETWORK) | NODE_NETWORK_LIMITED);
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     if (!CheckDiskSpace(GetDataDir())) {
         UIError(strprintf(_("Error: Disk space is low for %s"), GetDataDir()));
         return false;
@@ -1835,6 +1951,7 @@ bool AppInitMain()
     }
     // StakeMiner thread disabled by default on regtest
     if (!vpwallets.empty() && gArgs.GetBoolArg("-staking", !Params().IsRegTestNet() && DEFAULT_STAKING)) {
+        RegisterValidationInterface(&g_staker_template_cache);
         threadGroup.create_thread(std::bind(&ThreadStakeMinter));
     }
 #endif
@@ -7,6 +7,7 @@
 
 #include "kernel.h"
 
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -17,6 +18,8 @@
 #include "validation.h"
 #include "zmaria/zpos.h"
 
+#include <future>
+
 /**
  * CStakeKernel Constructor
  *
@@ -44,24 +47,30 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
     }
     const CBlockIndex* pindexFrom = stakeInput->GetIndexFrom();
     nTimeBlockFrom = pindexFrom->nTime;
+
+    // Everything but the block time is the same for each time slot
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness;
+    hashPrefix.Write((const unsigned char*)ss.data(), ss.size());
+
+    // Get weighted target
+    bnTarget.SetCompact(nBits);
+    bnTarget *= (arith_uint256(stakeValue) / 100);
 }
 
-// Return stake kernel hash
-uint256 CStakeKernel::GetHash() const
+// Return stake kernel hash with nTimeTx as time of the kernel block
+uint256 CStakeKernel::GetHash(int nTimeTx) const
 {
-    CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
-    return Hash(ss.begin(), ss.end());
+    unsigned char time[4];
+    WriteLE32(time, nTimeTx);
+    uint256 hash;
+    CHash256(hashPrefix).Write(time, sizeof(time)).Finalize(hash.begin());
+    return hash;
 }
 
 // Check that the kernel hash meets the target required
 bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 {
-    // Get weighted target
-    arith_uint256 bnTarget;
-    bnTarget.SetCompact(nBits);
-    bnTarget *= (arith_uint256(stakeValue) / 100);
-
     // Check PoS kernel hash
     const arith_uint256& hashProofOfStake = UintToArith256(GetHash());
     const bool res = hashProofOfStake < bnTarget;
@@ -83,13 +92,56 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 }
 
 
+void CStakeKernelSearch::Reset(const CBlockIndex* _pindexPrev, unsigned int _nBits)
+{
+    pindexPrev = _pindexPrev;
+    nBits = _nBits;
+    vKernels.clear();
+}
+
+void CStakeKernelSearch::Add(CStakeInput* stakeInput)
+{
+    vKernels.emplace_back(pindexPrev, stakeInput, nBits, 0);
+}
+
+void CStakeKernelSearch::Erase(size_t i)
+{
+    vKernels.erase(vKernels.begin() + i);
+}
+
+std::vector<size_t> CStakeKernelSearch::Search(int nTimeTx, int nThreads) const
+{
+    auto search = [this, nTimeTx](size_t nBegin, size_t nEnd) {
+        std::vector<size_t> vFound;
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (vKernels[i].MeetsTarget(nTimeTx)) vFound.push_back(i);
+        }
+        return vFound;
+    };
+
+    // Contiguous ranges, so that concatenating the results keeps them sorted
+    const size_t nRange = vKernels.size() / std::max(1, nThreads) + 1;
+    std::vector<std::future<std::vector<size_t>>> vWorkers;
+    for (size_t nBegin = nRange; nBegin < vKernels.size(); nBegin += nRange) {
+        vWorkers.emplace_back(std::async(std::launch::async, search, nBegin, std::min(vKernels.size(), nBegin + nRange)));
+    }
+    std::vector<size_t> vFound = search(0, std::min(vKernels.size(), nRange));
+    for (auto& w : vWorkers) {
+        const std::vector<size_t> v = w.get();
+        vFound.insert(vFound.end(), v.begin(), v.end());
+    }
+    return vFound;
+}
+
+
 /*
  * PoS Validation
  */
 
 // helper function for CheckProofOfStake and GetStakeKernelHash
-static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& stake, int nHeight)
+static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& stake, const CBlockIndex* pindexPrev)
 {
+    const int nHeight = pindexPrev->nHeight + 1;
     // Check that this is a PoS block
     if (!block.IsProofOfStake())
         return error("called on non PoS block");
@@ -98,35 +150,11 @@ static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& st
     const CTxIn& txin = block.vtx[1]->vin[0];
     stake = txin.IsZerocoinSpend() ?
             std::unique_ptr<CStakeInput>(CLegacyZMariaStake::NewZMariaStake(txin, nHeight)) :
-            std::unique_ptr<CStakeInput>(CMariaStake::NewMariaStake(txin, nHeight, block.nTime));
+            std::unique_ptr<CStakeInput>(CMariaStake::NewMariaStake(txin, nHeight, block.nTime, pindexPrev));
 
     return stake != nullptr;
 }
 
-/*
- * Stake                Check if stakeInput can stake a block on top of pindexPrev
- *
- * @param[in]   pindexPrev      index of the parent block of the block being staked
- * @param[in]   stakeInput      input for the coinstake
- * @param[in]   nBits           target difficulty bits
- * @param[in]   nTimeTx         new blocktime
- * @return      bool            true if stake kernel hash meets target protocol
- */
-bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx)
-{
-    if (!stakeInput) return false;
-
-    // Get the new time slot (and verify it's not the same as previous block)
-    const bool fRegTest = Params().IsRegTestNet();
-    nTimeTx = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
-    if (nTimeTx <= pindexPrev->nTime && !fRegTest) return false;
-
-    // Verify Proof Of Stake
-    CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
-    return stakeKernel.CheckKernelHash(true);
-}
-
-
 /*
  * CheckProofOfStake    Check if block has valid proof of stake
  *
@@ -138,10 +166,9 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
  */
 bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
 {
-    const int nHeight = pindexPrev->nHeight + 1;
     // Initialize stake input
     std::unique_ptr<CStakeInput> stakeInput;
-    if (!LoadStakeInput(block, stakeInput, nHeight)) {
+    if (!LoadStakeInput(block, stakeInput, pindexPrev)) {
         strError = "stake input initialization failed";
         return false;
     }
@@ -189,7 +216,7 @@ bool GetStakeKernelHash(uint256& hashRet, const CBlock& block, const CBlockIndex
 {
     // Initialize stake input
     std::unique_ptr<CStakeInput> stakeInput;
-    if (!LoadStakeInput(block, stakeInput, pindexPrev->nHeight + 1))
+    if (!LoadStakeInput(block, stakeInput, pindexPrev))
         return error("%s : stake input initialization failed", __func__);
 
     CStakeKernel stakeKernel(pindexPrev, stakeInput.get(), block.nBits, block.nTime);
@@ -8,6 +8,8 @@
 #ifndef MARIA_KERNEL_H
 #define MARIA_KERNEL_H
 
+#include "arith_uint256.h"
+#include "hash.h"
 #include "stakeinput.h"
 
 class CStakeKernel {
@@ -23,11 +25,17 @@ public:
     CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int nTimeTx);
 
     // Return stake kernel hash
-    uint256 GetHash() const;
+    uint256 GetHash() const { return GetHash(nTime); }
+
+    // Return stake kernel hash with nTimeTx as time of the kernel block
+    uint256 GetHash(int nTimeTx) const;
 
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
+    // Check that the kernel hash with nTimeTx as block time meets the target (no logging)
+    bool MeetsTarget(int nTimeTx) const { return UintToArith256(GetHash(nTimeTx)) < bnTarget; }
+
 private:
     // kernel message hashed
     CDataStream stakeModifier{CDataStream(SER_GETHASH, 0)};
@@ -37,20 +45,47 @@ private:
     // hash target
     unsigned int nBits{0};     // difficulty for the target
     CAmount stakeValue{0};     // target multiplier
+    // precomputed: hasher fed with the message up to nTime, and weighted target
+    CHash256 hashPrefix;
+    arith_uint256 bnTarget;
 };
 
-/* PoS Validation */
-
 /*
- * Stake                Check if stakeInput can stake a block on top of pindexPrev
- *
- * @param[in]   pindexPrev      index of the parent block of the block being staked
- * @param[in]   stakeInput      input for the coinstake
- * @param[in]   nBits           target difficulty bits
- * @param[in]   nTimeTx         new blocktime
- * @return      bool            true if stake kernel hash meets target protocol
+ * CStakeKernelSearch   Kernels of a set of stake inputs on top of a given block.
+ *                      The part of each kernel that does not depend on the block
+ *                      time is computed once per tip, so that each time slot only
+ *                      hashes the time and compares with the weighted target.
  */
-bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx);
+class CStakeKernelSearch
+{
+public:
+    // Drop the kernels and start over on top of pindexPrev with target nBits
+    void Reset(const CBlockIndex* pindexPrev, unsigned int nBits);
+    // Add the kernel of stakeInput (spent by the block after pindexPrev)
+    void Add(CStakeInput* stakeInput);
+    // Remove the i-th kernel
+    void Erase(size_t i);
+
+    const CBlockIndex* GetPrev() const { return pindexPrev; }
+    unsigned int GetBits() const { return nBits; }
+    size_t Size() const { return vKernels.size(); }
+
+    /*
+     * Search               Check every kernel with block time nTimeTx
+     *
+     * @param[in]   nTimeTx         time of the kernel block
+     * @param[in]   nThreads        number of threads hashing (caller included)
+     * @return      vector          indexes of the kernels meeting the target, in ascending order
+     */
+    std::vector<size_t> Search(int nTimeTx, int nThreads = 1) const;
+
+private:
+    const CBlockIndex* pindexPrev{nullptr};
+    unsigned int nBits{0};
+    std::vector<CStakeKernel> vKernels;
+};
+
+/* PoS Validation */
 
 /*
  * CheckProofOfStake    Check if block has valid proof of stake
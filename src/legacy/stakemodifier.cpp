@@ -43,7 +43,7 @@ static bool SelectBlockFromCandidates(
         if (!mapBlockIndex.count(item.second))
             return error("%s : failed to find block index for candidate block %s", __func__, item.second.ToString().c_str());
 
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
+        const CBlockIndex* pindex = mapBlockIndex.at(item.second);
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
             break;
 
@@ -117,7 +117,7 @@ bool GetOldStakeModifier(CStakeInput* stake, uint64_t& nStakeModifier)
         const int nHeightStop = std::min(chainActive.Height(), Params().GetConsensus().height_last_ZC_AccumCheckpoint-1);
         while (pindexFrom && pindexFrom->nHeight + 1 <= nHeightStop) {
             if (pindexFrom->GetBlockTime() - nTimeBlockFrom > 60 * 60) {
-                nStakeModifier = pindexFrom->nAccumulatorCheckpoint.GetCheapHash();
+                nStakeModifier = pindexFrom->GetAccumulatorCheckpoint().GetCheapHash();
                 return true;
             }
             pindexFrom = chainActive.Next(pindexFrom);
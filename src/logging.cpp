@@ -125,6 +125,8 @@ const CLogCategoryDesc LogCategories[] = {
         {BCLog::LLMQ,           "llmq"},
         {BCLog::NET_MN,         "net_mn"},
         {BCLog::DKG,            "dkg"},
+        {BCLog::PRUNE,          "prune"},
+        {BCLog::CMPCTBLOCK,     "cmpctblock"},
         {BCLog::ALL,            "1"},
         {BCLog::ALL,            "all"},
 };
@@ -66,6 +66,8 @@ namespace BCLog {
         LLMQ        = (1 << 25),
         NET_MN      = (1 << 26),
         DKG         = (1 << 27),
+        PRUNE       = (1 << 28),
+        CMPCTBLOCK  = (1 << 29),
         ALL         = ~(uint32_t)0,
     };
 
@@ -565,7 +565,47 @@ void CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     CTxDestination addr;
     ExtractDestination(winnerIn.payee, addr);
     LogPrint(BCLog::MASTERNODE, "mnw - Adding winner %s for block %d\n", EncodeDestination(addr), winnerIn.nBlockHeight);
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    LOCK(cs_mapMasternodeBlocks);
+    if (mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1) >= MNPAYMENTS_LASTPAID_VOTES) {
+        mapPayeePaidHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    const auto it = mapPayeePaidHeights.find(payee);
+    if (it == mapPayeePaidHeights.end()) return -1;
+    // first height above nMaxHeight, then step back
+    auto hit = it->second.upper_bound(nMaxHeight);
+    if (hit == it->second.begin()) return -1;
+    --hit;
+    return *hit >= nMinHeight ? *hit : -1;
+}
+
+void CMasternodePayments::RebuildPaidHeights()
+{
+    LOCK(cs_mapMasternodeBlocks);
+    mapPayeePaidHeights.clear();
+    for (const auto& it : mapMasternodeBlocks) {
+        for (const CMasternodePayee& p : it.second.vecPayments) {
+            if (p.nVotes >= MNPAYMENTS_LASTPAID_VOTES) mapPayeePaidHeights[p.scriptPubKey].insert(it.first);
+        }
+    }
+}
+
+void CMasternodePayments::EraseBlockPayees(int nHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    const auto it = mapMasternodeBlocks.find(nHeight);
+    if (it == mapMasternodeBlocks.end()) return;
+    for (const CMasternodePayee& p : it->second.vecPayments) {
+        auto pit = mapPayeePaidHeights.find(p.scriptPubKey);
+        if (pit == mapPayeePaidHeights.end()) continue;
+        pit->second.erase(nHeight);
+        if (pit->second.empty()) mapPayeePaidHeights.erase(pit);
+    }
+    mapMasternodeBlocks.erase(it);
 }
 
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew, int nBlockHeight)
@@ -691,7 +731,7 @@ void CMasternodePayments::CleanPaymentList(int mnCount, int nHeight)
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             g_tiertwo_sync_state.EraseSeenMNW((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            EraseBlockPayees(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -24,6 +24,8 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// votes a payee needs in a block to be considered paid there (see CMasternodeMan::GetLastPaid)
+#define MNPAYMENTS_LASTPAID_VOTES 2
 
 bool IsBlockPayeeValid(const CBlock& block, const CBlockIndex* pindexPrev);
 std::string GetRequiredPaymentsString(int nBlockHeight);
@@ -101,19 +103,21 @@ public:
         vecPayments.clear();
     }
 
-    void AddPayee(const CScript& payeeIn, int nIncrement)
+    // Return the votes of the payee after the increment
+    int AddPayee(const CScript& payeeIn, int nIncrement)
     {
         LOCK(cs_vecPayments);
 
         for (CMasternodePayee& payee : vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
                 payee.nVotes += nIncrement;
-                return;
+                return payee.nVotes;
             }
         }
 
         CMasternodePayee c(payeeIn, nIncrement);
         vecPayments.push_back(c);
+        return nIncrement;
     }
 
     bool GetPayee(CScript& payee) const
@@ -222,6 +226,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeePaidHeights.clear();
     }
 
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -238,6 +243,8 @@ public:
     // can be removed after transition to DMN
     bool GetLegacyMasternodeTxOut(int nHeight, std::vector<CTxOut>& voutMasternodePaymentsRet) const;
     bool GetBlockPayee(int nBlockHeight, CScript& payee) const;
+    // Highest height in [nMinHeight, nMaxHeight] where payee has MNPAYMENTS_LASTPAID_VOTES votes, or -1
+    int GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight) const;
 
     bool IsTransactionValid(const CTransaction& txNew, const CBlockIndex* pindexPrev);
     bool IsScheduled(const CMasternode& mn, int nNotBlockHeight);
@@ -248,9 +255,21 @@ public:
     void FillBlockPayee(CMutableTransaction& txCoinbase, CMutableTransaction& txCoinstake, const CBlockIndex* pindexPrev, bool fProofOfStake) const;
     std::string ToString() const;
 
-    SERIALIZE_METHODS(CMasternodePayments, obj) { READWRITE(obj.mapMasternodePayeeVotes, obj.mapMasternodeBlocks); }
+    SERIALIZE_METHODS(CMasternodePayments, obj)
+    {
+        READWRITE(obj.mapMasternodePayeeVotes, obj.mapMasternodeBlocks);
+        SER_READ(obj, obj.RebuildPaidHeights());
+    }
 
 private:
+    // heights of mapMasternodeBlocks where each payee has MNPAYMENTS_LASTPAID_VOTES votes,
+    // so that the last payment of a masternode is found without walking back the chain.
+    // Guarded by cs_mapMasternodeBlocks
+    std::map<CScript, std::set<int>> mapPayeePaidHeights;
+    void RebuildPaidHeights();
+    // erase mapMasternodeBlocks entry at nHeight and its heights in mapPayeePaidHeights
+    void EraseBlockPayees(int nHeight);
+
     // keep track of last voted height for mnw signers
     std::map<COutPoint, int> mapMasternodesLastVote; //prevout, nBlockHeight
 
@@ -1072,23 +1072,18 @@ int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, int count_enabled,
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150;
 
+    // Look back max_depth blocks from BlockReading (not below height 1)
     int max_depth = count_enabled * 1.25;
-    for (int n = 0; n < max_depth; n++) {
-        const auto& it = masternodePayments.mapMasternodeBlocks.find(BlockReading->nHeight);
-        if (it != masternodePayments.mapMasternodeBlocks.end()) {
-            // Search for this payee, with at least 2 votes. This will aid in consensus
-            // allowing the network to converge on the same payees quickly, then keep the same schedule.
-            if (it->second.HasPayeeWithVotes(mnpayee, 2))
-                return BlockReading->nTime + nOffset;
-        }
-        BlockReading = BlockReading->pprev;
-
-        if (BlockReading == nullptr || BlockReading->nHeight <= 0) {
-            break;
-        }
-    }
-
-    return 0;
+    if (max_depth <= 0) return 0;
+    const int nMaxHeight = BlockReading->nHeight;
+    const int nMinHeight = std::min(nMaxHeight, std::max(1, nMaxHeight - max_depth + 1));
+
+    // Search for this payee, with at least 2 votes. This will aid in consensus
+    // allowing the network to converge on the same payees quickly, then keep the same schedule.
+    const int nPaidHeight = masternodePayments.GetLastPaidHeight(mnpayee, nMinHeight, nMaxHeight);
+    if (nPaidHeight < 0) return 0;
+    const CBlockIndex* pindexPaid = BlockReading->GetAncestor(nPaidHeight);
+    return pindexPaid ? pindexPaid->nTime + nOffset : 0;
 }
 
 std::string CMasternodeMan::ToString() const
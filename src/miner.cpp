@@ -95,6 +95,7 @@ bool ProcessBlockFound(const std::shared_ptr<const CBlock>& pblock, CWallet& wal
 
 bool fGenerateBitcoins = false;
 bool fStakeableCoins = false;
+CStakerTemplateCache g_staker_template_cache;
 
 void CheckForCoins(CWallet* pwallet, std::vector<CStakeableOutput>* availableCoins)
 {
@@ -152,6 +153,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             if (pwallet->pStakerStatus &&
                     pwallet->pStakerStatus->GetLastHash() == pindexPrev->GetBlockHash() &&
                     pwallet->pStakerStatus->GetLastTime() >= GetCurrentTimeSlot()) {
+                // Waiting for the next time slot: prepare the transactions of the block
+                g_staker_template_cache.Refresh(pindexPrev);
                 MilliSleep(2000);
                 continue;
             }
@@ -167,17 +170,27 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         //
         unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
 
+        std::shared_ptr<const CBlockTemplateTxs> ptemplateTxs = fProofOfStake ? g_staker_template_cache.Get(pindexPrev) : nullptr;
         std::unique_ptr<CBlockTemplate> pblocktemplate((fProofOfStake ?
-                                                        BlockAssembler(Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(CScript(), pwallet, true, &availableCoins) :
+                                                        BlockAssembler(Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(CScript(), pwallet, true, &availableCoins,
+                                                                                                                       false, true, nullptr, true, true, ptemplateTxs.get()) :
                                                         CreateNewBlockWithKey(pReservekey, pwallet)));
         if (!pblocktemplate) continue;
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
 
         // POS - block found: process it
         if (fProofOfStake) {
+            const int64_t nTimeSigned = GetTimeMicros();
             LogPrintf("%s : proof-of-stake block was signed %s \n", __func__, pblock->GetHash().ToString().c_str());
             SetThreadPriority(THREAD_PRIORITY_NORMAL);
-            if (!ProcessBlockFound(pblock, *pwallet, pReservekey)) {
+            const bool fAccepted = ProcessBlockFound(pblock, *pwallet, pReservekey);
+            LogPrintf("%s: stake found to block signed in %.2fms (%s transactions), to block processed in %.2fms\n", __func__,
+                      0.001 * (nTimeSigned - pblocktemplate->nTimeStakeFound),
+                      pblocktemplate->fFromTemplateTxs ? "prepared" : "selected",
+                      0.001 * (GetTimeMicros() - pblocktemplate->nTimeStakeFound));
+            if (!fAccepted) {
+                // Don't sign another block with the same transactions on this tip
+                if (pblocktemplate->fFromTemplateTxs) g_staker_template_cache.Reject(pblock->hashPrevBlock);
                 LogPrintf("%s: New block orphaned\n", __func__);
                 continue;
             }
@@ -196,12 +209,17 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         //
         int64_t nStart = GetTime();
         arith_uint256& hashTarget = arith_uint256().SetCompact(pblock->nBits);
+        std::vector<uint256> vHashes;
         while (true) {
             unsigned int nHashesDone = 0;
 
+            // Hash the rest of this 256-nonce round in one batch: the header is
+            // serialized once and only the nonce changes between candidates.
             arith_uint256 hash;
-            while (true) {
-                hash = UintToArith256(pblock->GetHash());
+            const uint32_t nBatch = 0x100 - (pblock->nNonce & 0xFF);
+            pblock->GetHashes(nBatch, vHashes);
+            for (const uint256& candidate : vHashes) {
+                hash = UintToArith256(candidate);
                 if (hash <= hashTarget) {
                     // Found a solution
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
@@ -219,8 +237,6 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
                 }
                 pblock->nNonce += 1;
                 nHashesDone += 1;
-                if ((pblock->nNonce & 0xFF) == 0)
-                    break;
             }
 
             // Meter hashes/sec
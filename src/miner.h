@@ -20,6 +20,7 @@ class CScript;
 class CWallet;
 
 struct CBlockTemplate;
+class CStakerTemplateCache;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
@@ -32,6 +33,9 @@ static const bool DEFAULT_PRINTPRIORITY = false;
 
     void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
     void ThreadStakeMinter();
+
+    /** Transactions of the next block, kept up to date for the staker (registered with the staker thread) */
+    extern CStakerTemplateCache g_staker_template_cache;
 #endif // ENABLE_WALLET
 
 extern double dHashesPerSec;
@@ -350,6 +350,8 @@ public:
     TierTwoConnMan* GetTierTwoConnMan() { return m_tiertwo_conn_man.get(); };
     /** Update the node to be a iqr member if needed */
     void UpdateQuorumRelayMemberIfNeeded(CNode* pnode);
+    /** Wake up the message handler thread (e.g. when a transaction pre-check is done) */
+    void WakeMessageHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -376,8 +378,6 @@ private:
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
-    void WakeMessageHandler();
-
     uint64_t CalculateKeyedNetGroup(const CAddress& ad);
 
     CNode* FindNode(const CNetAddr& ip);
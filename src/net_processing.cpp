@@ -7,6 +7,7 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
 #include "evo/deterministicmns.h"
@@ -25,6 +26,7 @@
 #include "sporkdb.h"
 #include "streams.h"
 #include "tiertwo/tiertwo_sync_state.h"
+#include "txprecheck.h"
 #include "validation.h"
 #include "util/validation.h"
 
@@ -35,6 +37,9 @@ static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SH
 /** the maximum percentage of addresses from our addrman to return in response to a getaddr message. */
 static constexpr size_t MAX_PCT_ADDR_TO_SEND = 23;
 
+/** The only compact block encoding version we understand (BIP152 version 1, no segwit) */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+
 struct IteratorComparator
 {
     template<typename I>
@@ -55,6 +60,13 @@ RecursiveMutex g_cs_orphans;
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
 std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
+//! Ring buffer of recent orphans, looked up when reconstructing compact blocks
+static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
+
+// Transactions received from each peer, waiting for their pre-check to be committed
+static Mutex g_cs_pending_txs;
+static std::map<NodeId, std::deque<std::shared_ptr<CTxPreCheck>>> mapPendingTxs GUARDED_BY(g_cs_pending_txs);
 
 void EraseOrphansFor(NodeId peer);
 
@@ -100,6 +112,7 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //! Optional, used for compact block reconstruction.
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -109,6 +122,32 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/** Peers asked to announce new blocks with a cmpctblock (high-bandwidth mode), oldest first. Protected by cs_main. */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+/** The last connected block and its compact encoding, so that it's built once and served from memory. */
+RecursiveMutex cs_most_recent_block;
+std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+
+/** A block downloaded ahead of its parent. */
+struct BufferedBlock {
+    std::shared_ptr<const CBlock> pblock;
+    NodeId nodeid;  //! The peer it came from.
+    int nHeight;
+    size_t nSize;
+};
+
+/**
+ * Blocks are accepted in order (the stake modifier and the stake input checks of a
+ * block need the data of its parent), but they are downloaded from many peers at
+ * once: the ones that arrive before their parent wait here, by hash and by parent
+ * hash, at most MAX_BLOCKS_BUFFERED_SIZE bytes. Protected by cs_main.
+ */
+std::map<uint256, BufferedBlock> mapBlocksBuffered;
+std::multimap<uint256, uint256> mapBlocksBufferedByPrev;
+size_t nBlocksBufferedSize = 0;
+
 } // anon namespace
 
 namespace
@@ -219,6 +258,20 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants new blocks announced with a cmpctblock.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer can serve us compact blocks (sent us a sendcmpct of a version we understand).
+    bool fProvidesHeaderAndIDs;
+    //! Compact block reconstruction counters.
+    CompactBlockStats cmpctStats;
+    //! Block download counters.
+    BlockDownloadStats downloadStats;
+    //! Number of headers messages in a row that didn't connect to our block index.
+    int nUnconnectingHeaders;
+    //! The PoS headers this peer had us store, whose block we don't have yet (see ProcessNewBlockHeaders).
+    std::vector<const CBlockIndex*> vPoSHeaders;
+    //! Whether its last headers were cut at MAX_UNCONNECTED_POS_HEADERS: we ask for the rest once blocks arrive.
+    bool fPoSHeadersPending;
 
     CNodeBlocks nodeBlocks;
 
@@ -233,6 +286,10 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        nUnconnectingHeaders = 0;
+        fPoSHeadersPending = false;
     }
 };
 
@@ -305,19 +362,89 @@ void MarkBlockAsReceived(const uint256& hash)
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
+// Returns false, still setting pit, if the block was already in flight from the same peer.
+// When pit is given, the queued entry gets a PartiallyDownloadedBlock for compact block reconstruction.
+bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr)
 {
     CNodeState* state = State(nodeid);
     assert(state != nullptr);
 
+    // Short-circuit most stuff in case it is from the same node
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        if (pit) {
+            *pit = &itInFlight->second.second;
+        }
+        return false;
+    }
+
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != nullptr};
-    nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
+            {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != nullptr,
+             std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+    nQueuedValidatedHeaders += it->fValidatedHeaders;
     state->nBlocksInFlight++;
-    mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it))).first;
+    if (pit) {
+        *pit = &itInFlight->second.second;
+    }
+    return true;
+}
+
+// Requires cs_main.
+// Account a block received from the peer it was requested from. The time counted is the
+// time since the request, or since the previous block if that is later, so that blocks
+// requested together don't count the same wait several times.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, size_t nSize)
+{
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState* state = State(nodeid);
+    assert(state != nullptr);
+    BlockDownloadStats& stats = state->downloadStats;
+    const int64_t nNow = GetTimeMicros();
+    stats.nBlocks++;
+    stats.nBytes += nSize;
+    stats.nTimeBusy += std::max<int64_t>(0, nNow - std::max(itInFlight->second.second->nTime, stats.nLastReceived));
+    stats.nLastReceived = nNow;
+}
+
+/**
+ * When a peer gave us a new valid block first, ask it to announce the next ones with a
+ * cmpctblock (high-bandwidth mode). At most MAX_HB_CMPCTBLOCK_PEERS peers are kept in
+ * this mode: the one that has been there longest is switched back to low-bandwidth.
+ */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs) {
+        // Never ask from peers who can't provide compact blocks.
+        return;
+    }
+    for (auto it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    connman->ForNode(nodeid, [connman](CNode* pfrom) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        AssertLockHeld(cs_main);
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_HB_CMPCTBLOCK_PEERS) {
+            connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman](CNode* pnodeStop) {
+                connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/false, CMPCTBLOCKS_VERSION));
+                return true;
+            });
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/true, CMPCTBLOCKS_VERSION));
+        lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        return true;
+    });
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -359,6 +486,79 @@ static void UpdateBlockAvailability(NodeId nodeid, const uint256& hash) EXCLUSIV
     }
 }
 
+static void EraseBufferedBlock(std::map<uint256, BufferedBlock>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto range = mapBlocksBufferedByPrev.equal_range(it->second.pblock->hashPrevBlock);
+    for (auto itPrev = range.first; itPrev != range.second; ++itPrev) {
+        if (itPrev->second == it->first) {
+            mapBlocksBufferedByPrev.erase(itPrev);
+            break;
+        }
+    }
+    nBlocksBufferedSize -= it->second.nSize;
+    mapBlocksBuffered.erase(it);
+}
+
+/** Keep a block that arrived before its parent. When the buffer is full, the highest blocks
+ *  are dropped first (they are requested again later): the ones that connect next are kept. */
+static void BufferBlock(const std::shared_ptr<const CBlock>& pblock, int nHeight, NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+
+    const uint256& hash = pblock->GetHash();
+    if (mapBlocksBuffered.count(hash))
+        return;
+    const size_t nSize = ::GetSerializeSize(*pblock, PROTOCOL_VERSION);
+    while (nBlocksBufferedSize + nSize > MAX_BLOCKS_BUFFERED_SIZE && !mapBlocksBuffered.empty()) {
+        auto itHighest = std::max_element(mapBlocksBuffered.begin(), mapBlocksBuffered.end(),
+                [](const std::pair<const uint256, BufferedBlock>& a, const std::pair<const uint256, BufferedBlock>& b) {
+                    return a.second.nHeight < b.second.nHeight;
+                });
+        if (itHighest->second.nHeight <= nHeight)
+            break;
+        LogPrint(BCLog::NET, "block buffer full, dropping block %s (%d)\n", itHighest->first.ToString(), itHighest->second.nHeight);
+        EraseBufferedBlock(itHighest);
+    }
+    if (nBlocksBufferedSize + nSize > MAX_BLOCKS_BUFFERED_SIZE) {
+        LogPrint(BCLog::NET, "block buffer full, dropping block %s (%d) peer=%d\n", hash.ToString(), nHeight, nodeid);
+        return;
+    }
+    mapBlocksBuffered.emplace(hash, BufferedBlock{pblock, nodeid, nHeight, nSize});
+    mapBlocksBufferedByPrev.emplace(pblock->hashPrevBlock, hash);
+    nBlocksBufferedSize += nSize;
+    LogPrint(BCLog::NET, "buffered block %s (%d) peer=%d, waiting for its parent (%u blocks, %u bytes buffered)\n",
+             hash.ToString(), nHeight, nodeid, mapBlocksBuffered.size(), nBlocksBufferedSize);
+}
+
+/** Remove the buffered children of a block from the buffer, and return them. */
+static std::vector<BufferedBlock> TakeBufferedChildren(const uint256& hashParent) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<BufferedBlock> vChildren;
+    auto range = mapBlocksBufferedByPrev.equal_range(hashParent);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto itBlock = mapBlocksBuffered.find(it->second);
+        assert(itBlock != mapBlocksBuffered.end());
+        vChildren.emplace_back(std::move(itBlock->second));
+        nBlocksBufferedSize -= vChildren.back().nSize;
+        mapBlocksBuffered.erase(itBlock);
+    }
+    mapBlocksBufferedByPrev.erase(range.first, range.second);
+    return vChildren;
+}
+
+/** Whether a block was downloaded already and waits for its parent. A buffered block whose
+ *  parent got accepted some other way (e.g. submitblock) is dropped, to be downloaded again. */
+static bool IsBlockBuffered(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto it = mapBlocksBuffered.find(pindex->GetBlockHash());
+    if (it == mapBlocksBuffered.end())
+        return false;
+    if (pindex->pprev && pindex->pprev->nTx == 0)
+        return true;
+    EraseBufferedBlock(it);
+    return false;
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -420,6 +620,10 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                 // We consider the chain that this peer is on invalid.
                 return;
             }
+            if (IsBlockBuffered(pindex)) {
+                // Downloaded already, waiting for its parent.
+                continue;
+            }
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
@@ -445,6 +649,65 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     }
 }
 
+/**
+ * Process a block downloaded from a peer. A block whose parent data hasn't arrived yet
+ * is buffered; once a block is processed, its buffered descendants are processed too
+ * (or dropped, if it was rejected).
+ */
+static void ProcessBlockFromPeer(NodeId nodeid, const std::shared_ptr<const CBlock>& pblock)
+{
+    AssertLockNotHeld(cs_main);
+
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexPrev = LookupBlockIndex(pblock->hashPrevBlock);
+        if (pindexPrev && pindexPrev->nTx == 0) {
+            BufferBlock(pblock, pindexPrev->nHeight + 1, nodeid);
+            return;
+        }
+        mapBlockSource.emplace(pblock->GetHash(), nodeid);
+    }
+
+    std::deque<std::shared_ptr<const CBlock>> queue{pblock};
+    while (!queue.empty()) {
+        std::shared_ptr<const CBlock> pblockNext = std::move(queue.front());
+        queue.pop_front();
+        ProcessNewBlock(pblockNext, nullptr);
+
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(pblockNext->GetHash());
+        const bool fAccepted = pindex && pindex->nTx > 0;
+        std::vector<BufferedBlock> vChildren = TakeBufferedChildren(pblockNext->GetHash());
+        while (!vChildren.empty()) {
+            BufferedBlock child = std::move(vChildren.back());
+            vChildren.pop_back();
+            if (fAccepted) {
+                mapBlockSource.emplace(child.pblock->GetHash(), child.nodeid);
+                queue.push_back(std::move(child.pblock));
+            } else {
+                // The parent was rejected: none of its descendants can be accepted.
+                LogPrint(BCLog::NET, "dropping buffered block %s, its parent was not accepted\n", child.pblock->GetHash().ToString());
+                std::vector<BufferedBlock> vGrandChildren = TakeBufferedChildren(child.pblock->GetHash());
+                std::move(vGrandChildren.begin(), vGrandChildren.end(), std::back_inserter(vChildren));
+            }
+        }
+    }
+}
+
+/** Forget the PoS headers of a peer whose block arrived or was found invalid: they no longer count against its limit. */
+static void PrunePoSHeaders(CNodeState* state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    state->vPoSHeaders.erase(std::remove_if(state->vPoSHeaders.begin(), state->vPoSHeaders.end(), [](const CBlockIndex* pindex) {
+        return (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)) != 0;
+    }), state->vPoSHeaders.end());
+}
+
+/** Whether our tip is recent enough to fetch announced blocks right away, without waiting for their headers. */
+static bool CanDirectFetch() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().GetConsensus().nTargetSpacing * 20;
+}
+
 } // anon namespace
 
 void PeerLogicValidation::InitializeNode(CNode *pnode) {
@@ -472,9 +735,13 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         fUpdateConnectionTime = true;
     }
 
-    for (const QueuedBlock& entry : state->vBlocksInFlight)
+    for (const QueuedBlock& entry : state->vBlocksInFlight) {
+        nQueuedValidatedHeaders -= entry.fValidatedHeaders;
         mapBlocksInFlight.erase(entry.hash);
+    }
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
     EraseOrphansFor(nodeid);
+    WITH_LOCK(g_cs_pending_txs, mapPendingTxs.erase(nodeid); );
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
@@ -493,6 +760,10 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.fPreferHeaderAndIDs = state->fPreferHeaderAndIDs;
+    stats.fProvidesHeaderAndIDs = state->fProvidesHeaderAndIDs;
+    stats.cmpctStats = state->cmpctStats;
+    stats.downloadStats = state->downloadStats;
     return true;
 }
 
@@ -501,6 +772,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
 // mapOrphanTransactions
 //
 
+static void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+{
+    if (vExtraTxnForCompact.size() < MAX_EXTRA_TXN_FOR_COMPACT) {
+        vExtraTxnForCompact.emplace_back(tx->GetHash(), tx);
+    } else {
+        vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetHash(), tx);
+    }
+    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % MAX_EXTRA_TXN_FOR_COMPACT;
+}
+
 bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
     const uint256& hash = tx->GetHash();
@@ -527,6 +808,7 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
     for (const CTxIn& txin : tx->vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
+    AddToCompactExtraTransactions(tx);
 
     LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
         mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
@@ -712,6 +994,11 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
         }
         LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
     }
+
+    // Keep the block around: the tip update that follows announces it with a cmpctblock.
+    LOCK(cs_most_recent_block);
+    most_recent_block = pblock;
+    most_recent_compact_block.reset();
 }
 
 void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
@@ -721,15 +1008,42 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CB
 
     if (!fInitialDownload) {
         const uint256& hashNewTip = pindexNew->GetBlockHash();
+
+        // Build the compact encoding once, for the high-bandwidth peers and for getdata replies.
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block->GetHash() == hashNewTip) {
+                if (!most_recent_compact_block) {
+                    most_recent_compact_block = std::make_shared<const CBlockHeaderAndShortTxIDs>(*most_recent_block);
+                }
+                pcmpctblock = most_recent_compact_block;
+            }
+        }
+
         // Relay inventory, but don't relay old inventory during initial block download.
-        connman->ForEachNode([nNewHeight, hashNewTip](CNode* pnode) {
+        // Peers in high-bandwidth mode get the cmpctblock straight away instead.
+        LOCK(cs_main);
+        connman->ForEachNode([this, nNewHeight, &hashNewTip, &pcmpctblock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
             // Don't sync from MN only connections.
             if (!pnode->CanRelay()) {
                 return;
             }
-            if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
-                pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+            if (nNewHeight <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
+                return;
+            }
+            CNodeState* state = State(pnode->GetId());
+            if (pcmpctblock && state && state->fPreferHeaderAndIDs) {
+                LOCK(pnode->cs_inventory);
+                if (pnode->filterInventoryKnown.contains(hashNewTip)) {
+                    return;
+                }
+                pnode->filterInventoryKnown.insert(hashNewTip);
+                LogPrint(BCLog::CMPCTBLOCK, "%s sending cmpctblock %s to peer=%d\n", __func__, hashNewTip.ToString(), pnode->GetId());
+                connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                return;
             }
+            pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
         });
     }
 
@@ -754,6 +1068,9 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
             // Spam filter
             CheckBlockSpam(it->second, block.GetHash());
         }
+    } else if (state.IsValid() && it != mapBlockSource.end() && !IsInitialBlockDownload()) {
+        // The first peer to give us a new valid block is likely to be fast at it next time too.
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, connman);
     }
 
     if (it != mapBlockSource.end())
@@ -1042,14 +1359,50 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
             }
         }
     }
+    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold.
+    // Add two blocks buffer extension for possible races
+    if (send && !pfrom->fWhitelisted &&
+            (pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) && !(pfrom->GetLocalServices() & NODE_NETWORK) &&
+            chainActive.Height() - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2) {
+        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
+        // disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+        pfrom->fDisconnect = true;
+        send = false;
+    }
     // Don't send not-validated blocks
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA)) {
-        // Send block from disk
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            assert(!"cannot load block from disk");
+        // The new tip is requested by most peers at once: serve it from memory
+        std::shared_ptr<const CBlock> pblock;
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block->GetHash() == inv.hash) {
+                pblock = most_recent_block;
+                pcmpctblock = most_recent_compact_block;
+            }
+        }
+        if (!pblock) {
+            // Send block from disk
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockRead, pindex))
+                assert(!"cannot load block from disk");
+            pblock = pblockRead;
+        }
+        const CBlock& block = *pblock;
         if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        else if (inv.type == MSG_CMPCT_BLOCK) {
+            // A peer far behind the tip won't have the transactions of the block in its mempool
+            if (pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                if (pcmpctblock) {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                } else {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+                }
+            } else {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+            }
+        }
         else // MSG_FILTERED_BLOCK)
         {
             bool send_ = false;
@@ -1155,7 +1508,7 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
 
     if (it != pfrom->vRecvGetData.end() && !pfrom->fPauseSend) {
         const CInv &inv = *it;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             it++;
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
@@ -1175,6 +1528,186 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     }
 }
 
+// Add a transaction received from pfrom to the mempool (the commit stage, after its pre-check if any)
+static bool ProcessTransaction(CNode* pfrom, const CTransactionRef& ptx, CConnman* connman)
+{
+    std::deque<COutPoint> vWorkQueue;
+    std::vector<uint256> vEraseQueue;
+    const CTransaction& tx = *ptx;
+    CInv inv(MSG_TX, tx.GetHash());
+
+    const int64_t nTimeStart = GetTimeMicros();
+    LOCK2(cs_main, g_cs_orphans);
+
+    bool ignoreFees = false;
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv);
+
+    if (ptx->ContainsZerocoins()) {
+        // Don't even try to check zerocoins at all.
+        Misbehaving(pfrom->GetId(), 100, strprintf("received a zc transaction"));
+        return false;
+    }
+
+    const bool fAccepted = AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees);
+    RecordTxCommit(GetTimeMicros() - nTimeStart);
+    if (fAccepted) {
+        mempool.check(pcoinsTip.get());
+        RelayTransaction(tx, connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            vWorkQueue.emplace_back(inv.hash, i);
+        }
+
+        LogPrint(BCLog::MEMPOOL, "%s : peer=%d %s : accepted %s (poolsz %u txn, %u kB)\n",
+                __func__, pfrom->GetId(), pfrom->cleanSubVer, tx.GetHash().ToString(),
+                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        std::set<NodeId> setMisbehaving;
+        while (!vWorkQueue.empty()) {
+            auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+            vWorkQueue.pop_front();
+            if(itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for (auto mi = itByPrev->second.begin();
+                mi != itByPrev->second.end();
+                ++mi) {
+                const CTransactionRef& orphanTx = (*mi)->second.tx;
+                const uint256& orphanHash = orphanTx->GetHash();
+                NodeId fromPeer = (*mi)->second.fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
+                    LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(*orphanTx, connman);
+                    for (unsigned int i = 0; i < orphanTx->vout.size(); i++) {
+                        vWorkQueue.emplace_back(orphanHash, i);
+                    }
+                    vEraseQueue.push_back(orphanHash);
+                } else if (!fMissingInputs2) {
+                    int nDos = 0;
+                    if(stateDummy.IsInvalid(nDos) && nDos > 0) {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee
+                    LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    assert(recentRejects);
+                    recentRejects->insert(orphanHash);
+                }
+                mempool.check(pcoinsTip.get());
+            }
+        }
+
+        for (uint256& hash : vEraseQueue) EraseOrphanTx(hash);
+
+    } else if (fMissingInputs) {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+
+        // Deduplicate parent txids, so that we don't have to loop over
+        // the same parent txid more than once down below.
+        std::vector<uint256> unique_parents;
+        unique_parents.reserve(tx.vin.size());
+        for (const CTxIn& txin : ptx->vin) {
+            // We start with all parents, and then remove duplicates below.
+            unique_parents.emplace_back(txin.prevout.hash);
+        }
+        std::sort(unique_parents.begin(), unique_parents.end());
+        unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
+        for (const uint256& parent_txid : unique_parents) {
+            if (recentRejects->contains(parent_txid)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            for (const uint256& parent_txid : unique_parents) {
+                CInv _inv(MSG_TX, parent_txid);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0)
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+        }
+    } else {
+        // AcceptToMemoryPool() returned false, possibly because the tx is
+        // already in the mempool; if the tx isn't in the mempool that
+        // means it was rejected and we shouldn't ask for it again.
+        if (!mempool.exists(tx.GetHash())) {
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+        }
+        if (pfrom->fWhitelisted) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were rejected from the mempool, allowing the node to
+            // function as a gateway for nodes hidden behind it.
+            //
+            // FIXME: This includes invalid transactions, which means a
+            // whitelisted peer could get us banned! We may want to change
+            // that.
+            RelayTransaction(tx, connman);
+        }
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(), pfrom->cleanSubVer,
+            FormatStateMessage(state));
+        if (nDoS > 0) {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+    return true;
+}
+
+// Commit the transactions of pfrom whose pre-check is done, in the order they
+// were received, and return the number of transactions still pending
+static size_t ProcessPreCheckedTxs(CNode* pfrom, CConnman* connman)
+{
+    std::vector<CTransactionRef> vtx;
+    size_t nPending;
+    {
+        LOCK(g_cs_pending_txs);
+        auto it = mapPendingTxs.find(pfrom->GetId());
+        if (it == mapPendingTxs.end())
+            return 0;
+        auto& queue = it->second;
+        while (!queue.empty() && queue.front()->fDone) {
+            vtx.emplace_back(queue.front()->tx);
+            queue.pop_front();
+        }
+        nPending = queue.size();
+        if (queue.empty())
+            mapPendingTxs.erase(it);
+    }
+    for (const CTransactionRef& tx : vtx) {
+        ProcessTransaction(pfrom, tx, connman);
+    }
+    return nPending;
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -1394,6 +1927,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             CMNAuth::PushMNAUTH(pfrom, *connman);
         }
 
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we can serve compact blocks. New blocks are asked to be announced
+            // with a cmpctblock only by a few peers, see MaybeSetPeerAsAnnouncingHeaderAndIDs.
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/false, CMPCTBLOCKS_VERSION));
+        }
+
         pfrom->fSuccessfullyConnected = true;
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
@@ -1529,9 +2068,20 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    if (pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+                        // Ask for the headers leading to the block: with them it can be downloaded from any
+                        // peer. Near the tip, fetch it right away too, to save a round-trip.
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                        LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                        if (CanDirectFetch() && State(pfrom->GetId())->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                            vToFetch.push_back(inv);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    }
                 }
             } else {
                 // Allowed inv request types while we are in IBD
@@ -1561,8 +2111,14 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         }
 
-        if (!vToFetch.empty())
+        if (!vToFetch.empty()) {
+            // A single new block announced near the tip: its transactions are likely in our
+            // mempool already, so ask for it as a cmpctblock when the peer can serve one.
+            if (vToFetch.size() == 1 && State(pfrom->GetId())->fProvidesHeaderAndIDs && !IsInitialBlockDownload()) {
+                vToFetch[0].type = MSG_CMPCT_BLOCK;
+            }
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
+        }
     }
 
 
@@ -1586,7 +2142,70 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block->GetHash() == req.blockhash) {
+                pblock = most_recent_block;
+            }
+        }
+        bool fSendFullBlock = false;
+        if (!pblock) {
+            LOCK(cs_main);
+            CBlockIndex* pindex = LookupBlockIndex(req.blockhash);
+            if (!pindex || !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+                return true;
+            }
+            if (pindex->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // Answering for old blocks would let a peer trigger disk reads for a few bytes
+                // of bandwidth: make it download the whole block instead.
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+                fSendFullBlock = true;
+            } else {
+                std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockRead, pindex))
+                    assert(!"cannot load block from disk");
+                pblock = pblockRead;
+            }
+        }
+        if (fSendFullBlock) {
+            pfrom->vRecvGetData.emplace_back(MSG_BLOCK, req.blockhash);
+            ProcessGetData(pfrom, connman, interruptMsgProc);
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= pblock->vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100, strprintf("getblocktxn with out-of-bounds tx indices from peer=%d", pfrom->GetId()));
+                return false;
+            }
+            resp.txn[i] = pblock->vtx[req.indexes[i]];
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKS) {
 
         // Don't relay blocks inv to masternode-only connections
         if (!pfrom->CanRelay()) {
@@ -1614,11 +2233,18 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             pindex = chainActive.Next(pindex);
         int nLimit = 500;
         LogPrint(BCLog::NET, "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), nLimit, pfrom->GetId());
+        // If pruning, don't inv blocks unless we have on disk and are likely to still have
+        // for some reasonable time window (1 hour) that block relay might require.
+        const int nPrunedBlocksLikelyToHave = NODE_NETWORK_LIMITED_MIN_BLOCKS - 3600 / Params().GetConsensus().nTargetSpacing;
         for (; pindex; pindex = chainActive.Next(pindex)) {
             if (pindex->GetBlockHash() == hashStop) {
                 LogPrint(BCLog::NET, "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Height() - nPrunedBlocksLikelyToHave)) {
+                LogPrint(BCLog::NET, " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -1631,26 +2257,35 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
+
+        // Don't serve headers to masternode-only connections
+        if (!pfrom->CanRelay()) {
+            LogPrint(BCLog::NET, "getheaders, don't serve headers to masternode connection. peer=%d\n", pfrom->GetId());
+            return true;
+        }
+
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
 
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
+        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+            LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->GetId());
             return true;
+        }
 
         CBlockIndex* pindex = nullptr;
         if (locator.IsNull()) {
             // If locator is null, return the hashStop block
-            CBlockIndex* pindex = LookupBlockIndex(hashStop);
+            pindex = LookupBlockIndex(hashStop);
             if (!pindex)
                 return true;
         } else {
@@ -1663,7 +2298,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->GetId());
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -1674,157 +2309,23 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
 
     else if (strCommand == NetMsgType::TX) {
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransaction tx(deserialize, vRecv);
         CTransactionRef ptx = MakeTransactionRef(tx);
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK2(cs_main, g_cs_orphans);
-
-        bool ignoreFees = false;
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv);
-
-        if (ptx->ContainsZerocoins()) {
-            // Don't even try to check zerocoins at all.
-            Misbehaving(pfrom->GetId(), 100, strprintf("received a zc transaction"));
-            return false;
-        }
-
-        if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
-            mempool.check(pcoinsTip.get());
-            RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
-
-            LogPrint(BCLog::MEMPOOL, "%s : peer=%d %s : accepted %s (poolsz %u txn, %u kB)\n",
-                    __func__, pfrom->GetId(), pfrom->cleanSubVer, tx.GetHash().ToString(),
-                    mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const CTransactionRef& orphanTx = (*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx->GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(*orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx->vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
-                    } else if (!fMissingInputs2) {
-                        int nDos = 0;
-                        if(stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee
-                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip.get());
-                }
-            }
-
-            for (uint256& hash : vEraseQueue) EraseOrphanTx(hash);
-
-        } else if (fMissingInputs) {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-
-            // Deduplicate parent txids, so that we don't have to loop over
-            // the same parent txid more than once down below.
-            std::vector<uint256> unique_parents;
-            unique_parents.reserve(tx.vin.size());
-            for (const CTxIn& txin : ptx->vin) {
-                // We start with all parents, and then remove duplicates below.
-                unique_parents.emplace_back(txin.prevout.hash);
-            }
-            std::sort(unique_parents.begin(), unique_parents.end());
-            unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
-            for (const uint256& parent_txid : unique_parents) {
-                if (recentRejects->contains(parent_txid)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                for (const uint256& parent_txid : unique_parents) {
-                    CInv _inv(MSG_TX, parent_txid);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0)
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-            }
-        } else {
-            // AcceptToMemoryPool() returned false, possibly because the tx is
-            // already in the mempool; if the tx isn't in the mempool that
-            // means it was rejected and we shouldn't ask for it again.
-            if (!mempool.exists(tx.GetHash())) {
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-            }
-            if (pfrom->fWhitelisted) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were rejected from the mempool, allowing the node to
-                // function as a gateway for nodes hidden behind it.
-                //
-                // FIXME: This includes invalid transactions, which means a
-                // whitelisted peer could get us banned! We may want to change
-                // that.
-                RelayTransaction(tx, connman);
-            }
-        }
-
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(), pfrom->cleanSubVer,
-                FormatStateMessage(state));
-            if (nDoS > 0) {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
+        // Verify the signatures and proofs on the pre-check threads, if any:
+        // the transaction is committed by ProcessMessages once it is done.
+        std::shared_ptr<CTxPreCheck> pcheck = QueueTxPreCheck(ptx);
+        if (!pcheck) {
+            return ProcessTransaction(pfrom, ptx, connman);
         }
+        LOCK(g_cs_pending_txs);
+        mapPendingTxs[pfrom->GetId()].emplace_back(std::move(pcheck));
     }
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -1841,44 +2342,72 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = nullptr;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-                Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
-                return false;
+
+        std::vector<const CBlockIndex*>* pvPoSHeaders = nullptr;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+
+            // If the headers don't connect to our block index, the peer is on a chain we don't know
+            // about yet (or it announced a block with its header): ask for the headers in between.
+            if (!LookupBlockIndex(headers[0].hashPrevBlock)) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
+                         headers[0].GetHash().ToString(), headers[0].hashPrevBlock.ToString(), pindexBestHeader->nHeight, pfrom->GetId(), nodestate->nUnconnectingHeaders);
+                // The last header is the peer's tip: it becomes downloadable once the headers connect
+                UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+                if (++nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
+                    Misbehaving(pfrom->GetId(), 20, strprintf("%d non-connecting headers", nodestate->nUnconnectingHeaders));
+                }
+                return true;
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0) {
-                        Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
-                    } else {
-                        LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
-                    }
+            uint256 hashLastBlock;
+            for (const CBlockHeader& header : headers) {
+                if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+                    Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
                     return false;
                 }
+                hashLastBlock = header.GetHash();
+            }
+            PrunePoSHeaders(nodestate);
+            pvPoSHeaders = &nodestate->vPoSHeaders;
+        }
+
+        CValidationState state;
+        const CBlockIndex* pindexLast = nullptr;
+        if (!ProcessNewBlockHeaders(headers, state, &pindexLast, pvPoSHeaders)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                LOCK(cs_main);
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
+                } else {
+                    LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
+                }
+                return false;
             }
         }
 
+        LOCK(cs_main);
+        State(pfrom->GetId())->nUnconnectingHeaders = 0;
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        if (!pindexLast || pindexLast->GetBlockHash() != headers.back().GetHash()) {
+            // Too many of this peer's PoS headers are waiting for their block: the rest is requested
+            // from SendMessages once they are downloaded.
+            LogPrint(BCLog::NET, "peer=%d has %u PoS headers without their block, getheaders later\n", pfrom->GetId(), pvPoSHeaders->size());
+            State(pfrom->GetId())->fPoSHeadersPending = true;
+            return true;
+        }
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS) {
             // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
     }
@@ -1893,6 +2422,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+            if (pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+                // Get the headers leading to it: the block is downloaded again once they connect
+                LOCK(cs_main);
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hashBlock));
+                return true;
+            }
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1905,13 +2440,19 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         } else {
             pfrom->AddInventoryKnown(inv);
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
+            bool fNewBlock = false;
+            {
+                LOCK(cs_main);
+                // The header may be known already (headers-first sync), but not the block data
+                const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+                fNewBlock = !pindex || !(pindex->nStatus & BLOCK_HAVE_DATA);
+                if (fNewBlock) {
+                    UpdateBlockDownloadStats(pfrom->GetId(), hashBlock, ::GetSerializeSize(*pblock, PROTOCOL_VERSION));
                     MarkBlockAsReceived(hashBlock);
-                    mapBlockSource.emplace(hashBlock, pfrom->GetId());
                 }
-                ProcessNewBlock(pblock, nullptr);
+            }
+            if (fNewBlock) {
+                ProcessBlockFromPeer(pfrom->GetId(), pblock);
 
                 // Disconnect node if its running an old protocol version,
                 // used during upgrades, when the node is already connected.
@@ -1922,6 +2463,140 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
     }
 
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256& hashBlock = cmpctblock.header.GetHash();
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+        LogPrint(BCLog::CMPCTBLOCK, "received cmpctblock %s (%u txn) peer=%d\n", hashBlock.ToString(), cmpctblock.BlockTxCount(), pfrom->GetId());
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+            if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "%s : Already processed block %s, skipping cmpctblock\n", __func__, hashBlock.GetHex());
+                return true;
+            }
+            CBlockIndex* pindexPrev = LookupBlockIndex(cmpctblock.header.hashPrevBlock);
+            if (!pindexPrev) {
+                // We are missing its parent: ask for the full block, so that the block handler
+                // walks the chain back with this peer.
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, hashBlock)}));
+                return true;
+            }
+            // Check the header, as for headers-first sync, before tracking and reconstructing the block
+            CValidationState state;
+            if ((pindex && (pindex->nStatus & BLOCK_FAILED_MASK)) ||
+                    !CheckBlockHeaderWork(cmpctblock.header, state, pindexPrev) ||
+                    !ContextualCheckBlockHeader(cmpctblock.header, state, pindexPrev)) {
+                int nDoS = 0;
+                if (state.IsInvalid(nDoS) && nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS, strprintf("invalid cmpctblock header %s", hashBlock.ToString()));
+                } else {
+                    LogPrint(BCLog::CMPCTBLOCK, "peer=%d: invalid cmpctblock header %s\n", pfrom->GetId(), hashBlock.ToString());
+                }
+                return false;
+            }
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first != pfrom->GetId()) {
+                LogPrint(BCLog::CMPCTBLOCK, "block %s already in flight from peer=%d, ignoring cmpctblock\n", hashBlock.ToString(), itInFlight->second.first);
+                return true;
+            }
+
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->cmpctStats.nReceived++;
+
+            std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
+            if (!MarkBlockAsInFlight(pfrom->GetId(), hashBlock, nullptr, &queuedBlockIt)) {
+                if ((*queuedBlockIt)->partialBlock) {
+                    LogPrint(BCLog::CMPCTBLOCK, "peer=%d sent us a cmpctblock we were already reconstructing\n", pfrom->GetId());
+                    return true;
+                }
+                (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
+            ReadStatus status = WITH_LOCK(g_cs_orphans, return partialBlock.InitData(cmpctblock, vExtraTxnForCompact); );
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hashBlock); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100, strprintf("invalid compact block from peer=%d", pfrom->GetId()));
+                return false;
+            } else if (status == READ_STATUS_FAILED) {
+                // Uneven short id distribution, the block is in flight from this peer anyway: just request it
+                nodestate->cmpctStats.nFailed++;
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, hashBlock)}));
+                return true;
+            }
+            nodestate->cmpctStats.nTxFromMempool += partialBlock.GetMempoolCount();
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!partialBlock.IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                if (partialBlock.FillBlock(*pblock, {}) != READ_STATUS_OK) {
+                    nodestate->cmpctStats.nFailed++;
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, hashBlock)}));
+                    return true;
+                }
+                nodestate->cmpctStats.nReconstructed++;
+                MarkBlockAsReceived(hashBlock);
+                fBlockReconstructed = true;
+            } else {
+                req.blockhash = hashBlock;
+                nodestate->cmpctStats.nTxnRequested++;
+                nodestate->cmpctStats.nTxMissing += req.indexes.size();
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+            }
+        } // release cs_main
+
+        if (fBlockReconstructed) {
+            ProcessBlockFromPeer(pfrom->GetId(), pblock);
+            pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol());
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            auto itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() ||
+                    !itInFlight->second.second->partialBlock || itInFlight->second.second->partialBlock->header.IsNull()) {
+                LogPrint(BCLog::CMPCTBLOCK, "peer=%d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            CNodeState* nodestate = State(pfrom->GetId());
+            ReadStatus status = itInFlight->second.second->partialBlock->FillBlock(*pblock, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100, strprintf("invalid compact block/non-matching block transactions from peer=%d", pfrom->GetId()));
+                return false;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to the full block (still in flight from this peer)
+                nodestate->cmpctStats.nFailed++;
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, resp.blockhash)}));
+                return true;
+            }
+            nodestate->cmpctStats.nReconstructed++;
+            MarkBlockAsReceived(resp.blockhash);
+        } // release cs_main
+
+        ProcessBlockFromPeer(pfrom->GetId(), pblock);
+        pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol());
+    }
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -2171,6 +2846,8 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, connman, interruptMsgProc);
 
+    const size_t nPendingTxs = ProcessPreCheckedTxs(pfrom, connman);
+
     if (pfrom->fDisconnect)
         return false;
 
@@ -2181,6 +2858,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (pfrom->fPauseSend)
         return false;
 
+    // Let the pre-check threads catch up with the transactions of this peer
+    // (they wake us up when they are done)
+    if (nPendingTxs >= MAX_PENDING_TXS_PER_PEER)
+        return false;
+
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
@@ -2372,10 +3054,25 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (pto->nVersion >= HEADERS_FIRST_VERSION) {
+                    // Only the headers are synced with this peer: the blocks are downloaded from all of them.
+                    // Start one block back, so that the reply is never empty.
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
+            }
+        }
+
+        // Resume the headers sync cut at MAX_UNCONNECTED_POS_HEADERS once half of those blocks arrived
+        if (state.fPoSHeadersPending && !fImporting && !fReindex) {
+            PrunePoSHeaders(&state);
+            if (state.vPoSHeaders.size() <= MAX_UNCONNECTED_POS_HEADERS / 2) {
+                state.fPoSHeadersPending = false;
+                LogPrint(BCLog::NET, "resumed getheaders (%d) to peer=%d\n", pindexBestHeader->nHeight, pto->GetId());
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
             }
         }
 
@@ -2579,5 +3276,8 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        // blocks waiting for their parent
+        mapBlocksBuffered.clear();
+        mapBlocksBufferedByPrev.clear();
     }
 } instance_of_cnetprocessingcleanup;
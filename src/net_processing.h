@@ -31,6 +31,19 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum number of peers asked to announce new blocks with a cmpctblock (high-bandwidth mode) */
+static const unsigned int MAX_HB_CMPCTBLOCK_PEERS = 3;
+/** Number of recently rejected/orphan transactions kept to help compact block reconstruction */
+static const unsigned int MAX_EXTRA_TXN_FOR_COMPACT = 100;
+/** Maximum total size of the blocks downloaded ahead of their parent, kept in memory until it is accepted */
+static const unsigned int MAX_BLOCKS_BUFFERED_SIZE = 32 * 1000 * 1000;
+/** Number of unconnecting headers messages a peer can send before it's considered misbehaving */
+static const int MAX_UNCONNECTING_HEADERS = 10;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -59,11 +72,33 @@ public:
     bool SendMessages(CNode* pto, std::atomic<bool>& interrupt) override EXCLUSIVE_LOCKS_REQUIRED(pto->cs_sendProcessing);
 };
 
+/** Compact block relay counters, per peer */
+struct CompactBlockStats {
+    uint64_t nReceived{0};      //! cmpctblock messages processed
+    uint64_t nReconstructed{0}; //! blocks rebuilt from a cmpctblock (with or without a blocktxn round-trip)
+    uint64_t nTxnRequested{0};  //! getblocktxn round-trips needed
+    uint64_t nFailed{0};        //! reconstructions that fell back to a full block
+    uint64_t nTxFromMempool{0}; //! short ids resolved locally
+    uint64_t nTxMissing{0};     //! short ids requested with getblocktxn
+};
+
+/** Block download counters, per peer */
+struct BlockDownloadStats {
+    uint64_t nBlocks{0};        //! requested blocks received
+    uint64_t nBytes{0};         //! their serialized size
+    int64_t nTimeBusy{0};       //! microseconds spent waiting for them, overlapping requests counted once
+    int64_t nLastReceived{0};   //! time of the last one (in microseconds)
+};
+
 struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    bool fPreferHeaderAndIDs;
+    bool fProvidesHeaderAndIDs;
+    CompactBlockStats cmpctStats;
+    BlockDownloadStats downloadStats;
 };
 
 /** Get statistics from node state */
@@ -0,0 +1,324 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_POOLEDHASHMAP_H
+#define MARIA_POOLEDHASHMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdint.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Open-addressing (linear probing) hash map, for maps with many small entries
+ * (the coins cache).
+ *
+ * The table is a flat array of 8-byte slots: a 32-bit fragment of the key hash,
+ * compared before touching the entry, and the index of the entry in a pool.
+ * The entries are allocated in chunks of growing size and recycled through a
+ * free list: unlike std::unordered_map, there is no heap node (and malloc
+ * overhead) per entry.
+ *
+ * Semantics follow std::unordered_map where the coins code depends on them:
+ * - references to the entries stay valid until they are erased (the pool chunks
+ *   never move), even when the table is rehashed;
+ * - erase(it) returns the next iterator and invalidates no other one (erased
+ *   slots are marked deleted until the next rehash), so that a map can be
+ *   erased while being iterated over, as BatchWrite does;
+ * - insertions may rehash the table, invalidating the iterators.
+ */
+template <typename Key, typename T, typename Hash>
+class PooledHashMap
+{
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Hash hasher;
+
+private:
+    struct Slot
+    {
+        uint32_t nTag;
+        //! EMPTY, DELETED, or FIRST_NODE + the pool index of the entry
+        uint32_t nNode;
+    };
+    enum : uint32_t {
+        EMPTY = 0,
+        DELETED = 1,
+        FIRST_NODE = 2,
+    };
+
+    //! Pool indexes are (chunk << CHUNK_BITS) | offset
+    enum : uint32_t {
+        CHUNK_BITS = 16,
+        MIN_CHUNK_NODES = 16,
+        MAX_CHUNK_NODES = 4096,
+    };
+
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Node;
+    static_assert(sizeof(Node) >= sizeof(uint32_t), "free list link");
+
+    struct Chunk
+    {
+        Node* pnodes;
+        uint32_t nNodes;
+    };
+
+    Hash hash;
+    Slot* slots{nullptr};
+    //! Zero or a power of two
+    size_t nCapacity{0};
+    size_t nSize{0};
+    size_t nDeleted{0};
+
+    std::vector<Chunk> vChunks;
+    //! Nodes handed out from the last chunk
+    uint32_t nLastChunkUsed{0};
+    //! Head of the free list of erased nodes (as a slot value)
+    uint32_t nFreeNode{EMPTY};
+
+    value_type& NodeValue(uint32_t nNode) const
+    {
+        const uint32_t nIndex = nNode - FIRST_NODE;
+        return *reinterpret_cast<value_type*>(&vChunks[nIndex >> CHUNK_BITS].pnodes[nIndex & ((1 << CHUNK_BITS) - 1)]);
+    }
+
+    uint32_t& FreeLink(uint32_t nNode) const
+    {
+        return *reinterpret_cast<uint32_t*>(&NodeValue(nNode));
+    }
+
+    uint32_t AllocateNode()
+    {
+        if (nFreeNode != EMPTY) {
+            const uint32_t nNode = nFreeNode;
+            nFreeNode = FreeLink(nNode);
+            return nNode;
+        }
+        if (vChunks.empty() || nLastChunkUsed == vChunks.back().nNodes) {
+            assert(vChunks.size() < (1 << (32 - CHUNK_BITS)) - 1);
+            const uint32_t nNodes = std::min<uint32_t>(MAX_CHUNK_NODES, MIN_CHUNK_NODES << std::min<size_t>(vChunks.size(), 16));
+            vChunks.push_back(Chunk{new Node[nNodes], nNodes});
+            nLastChunkUsed = 0;
+        }
+        return FIRST_NODE + (((uint32_t)(vChunks.size() - 1) << CHUNK_BITS) | nLastChunkUsed++);
+    }
+
+    void FreeNode(uint32_t nNode)
+    {
+        NodeValue(nNode).~value_type();
+        FreeLink(nNode) = nFreeNode;
+        nFreeNode = nNode;
+    }
+
+    static uint32_t Tag(size_t nHash) { return (uint32_t)(nHash >> (sizeof(size_t) > 4 ? 32 : 0)); }
+
+    //! Slot holding key, or nCapacity if there is none
+    size_t FindSlot(const Key& key) const
+    {
+        if (nSize == 0) return nCapacity;
+        const size_t nHash = hash(key);
+        const uint32_t nTag = Tag(nHash);
+        const size_t mask = nCapacity - 1;
+        for (size_t i = nHash & mask; slots[i].nNode != EMPTY; i = (i + 1) & mask) {
+            if (slots[i].nTag == nTag && slots[i].nNode >= FIRST_NODE && NodeValue(slots[i].nNode).first == key) return i;
+        }
+        return nCapacity;
+    }
+
+    //! First empty or deleted slot of the probe sequence of nHash
+    size_t FreeSlot(size_t nHash) const
+    {
+        const size_t mask = nCapacity - 1;
+        size_t i = nHash & mask;
+        while (slots[i].nNode >= FIRST_NODE) i = (i + 1) & mask;
+        return i;
+    }
+
+    void Rehash(size_t nNewCapacity)
+    {
+        Slot* oldSlots = slots;
+        const size_t nOldCapacity = nCapacity;
+        slots = new Slot[nNewCapacity]();
+        nCapacity = nNewCapacity;
+        nDeleted = 0;
+        for (size_t i = 0; i < nOldCapacity; i++) {
+            if (oldSlots[i].nNode < FIRST_NODE) continue;
+            slots[FreeSlot(hash(NodeValue(oldSlots[i].nNode).first))] = oldSlots[i];
+        }
+        delete[] oldSlots;
+    }
+
+    //! Make room for one more entry: at most 3/4 of the slots are used or deleted
+    void Reserve1()
+    {
+        if (nCapacity != 0 && (nSize + nDeleted + 1) * 4 <= nCapacity * 3) return;
+        // Only purge the deleted slots if the live entries use less than half of the table
+        size_t nNewCapacity = std::max<size_t>(nCapacity, 16);
+        while ((nSize + 1) * 2 > nNewCapacity) nNewCapacity *= 2;
+        Rehash(nNewCapacity);
+    }
+
+    void Release()
+    {
+        for (size_t i = 0; i < nCapacity; i++) {
+            if (slots[i].nNode >= FIRST_NODE) NodeValue(slots[i].nNode).~value_type();
+        }
+        delete[] slots;
+        for (const Chunk& chunk : vChunks) delete[] chunk.pnodes;
+    }
+
+    void Reset()
+    {
+        slots = nullptr;
+        nCapacity = nSize = nDeleted = 0;
+        std::vector<Chunk>().swap(vChunks);
+        nLastChunkUsed = 0;
+        nFreeNode = EMPTY;
+    }
+
+public:
+    template <bool fConst>
+    class Iterator
+    {
+    private:
+        typedef typename std::conditional<fConst, const PooledHashMap, PooledHashMap>::type Map;
+        Map* pmap{nullptr};
+        size_t nSlot{0};
+
+        void SkipFree()
+        {
+            while (nSlot < pmap->nCapacity && pmap->slots[nSlot].nNode < FIRST_NODE) ++nSlot;
+        }
+
+        friend class PooledHashMap;
+        friend class Iterator<!fConst>;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename PooledHashMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<fConst, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<fConst, const value_type&, value_type&>::type reference;
+
+        Iterator() {}
+        Iterator(Map* pmapIn, size_t nSlotIn) : pmap(pmapIn), nSlot(nSlotIn) { SkipFree(); }
+        //! iterator to const_iterator
+        template <bool fOtherConst, typename = typename std::enable_if<fConst && !fOtherConst>::type>
+        Iterator(const Iterator<fOtherConst>& other) : pmap(other.pmap), nSlot(other.nSlot) {}
+
+        reference operator*() const { return pmap->NodeValue(pmap->slots[nSlot].nNode); }
+        pointer operator->() const { return &**this; }
+        Iterator& operator++() { ++nSlot; SkipFree(); return *this; }
+        Iterator operator++(int) { Iterator copy(*this); ++(*this); return copy; }
+        bool operator==(const Iterator& other) const { return nSlot == other.nSlot; }
+        bool operator!=(const Iterator& other) const { return nSlot != other.nSlot; }
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    PooledHashMap() {}
+    ~PooledHashMap() { Release(); }
+
+    PooledHashMap(PooledHashMap&& other) :
+        hash(other.hash), slots(other.slots), nCapacity(other.nCapacity), nSize(other.nSize), nDeleted(other.nDeleted),
+        vChunks(std::move(other.vChunks)), nLastChunkUsed(other.nLastChunkUsed), nFreeNode(other.nFreeNode)
+    {
+        other.Reset();
+    }
+    PooledHashMap(const PooledHashMap&) = delete;
+    PooledHashMap& operator=(const PooledHashMap&) = delete;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, nCapacity); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, nCapacity); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    //! Removes all the entries and frees the table and the pool
+    void clear()
+    {
+        Release();
+        Reset();
+    }
+
+    iterator find(const Key& key) { return iterator(this, FindSlot(key)); }
+    const_iterator find(const Key& key) const { return const_iterator(this, FindSlot(key)); }
+    size_t count(const Key& key) const { return FindSlot(key) != nCapacity ? 1 : 0; }
+
+    //! Constructs the entry in place, as std::unordered_map::emplace (and, as it does, destroys it again if the key exists)
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        const uint32_t nNode = AllocateNode();
+        value_type* pvalue;
+        try {
+            pvalue = new (&NodeValue(nNode)) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            FreeLink(nNode) = nFreeNode;
+            nFreeNode = nNode;
+            throw;
+        }
+        const size_t nFound = FindSlot(pvalue->first);
+        if (nFound != nCapacity) {
+            FreeNode(nNode);
+            return std::make_pair(iterator(this, nFound), false);
+        }
+        Reserve1();
+        const size_t nHash = hash(pvalue->first);
+        const size_t i = FreeSlot(nHash);
+        if (slots[i].nNode == DELETED) nDeleted--;
+        slots[i].nTag = Tag(nHash);
+        slots[i].nNode = nNode;
+        nSize++;
+        return std::make_pair(iterator(this, i), true);
+    }
+
+    T& operator[](const Key& key)
+    {
+        const size_t i = FindSlot(key);
+        if (i != nCapacity) return NodeValue(slots[i].nNode).second;
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    //! Invalidates no other iterator than it
+    iterator erase(const_iterator it)
+    {
+        const size_t i = it.nSlot;
+        assert(i < nCapacity && slots[i].nNode >= FIRST_NODE);
+        FreeNode(slots[i].nNode);
+        slots[i].nNode = DELETED;
+        nSize--;
+        nDeleted++;
+        return iterator(this, i + 1);
+    }
+
+    size_t erase(const Key& key)
+    {
+        const size_t i = FindSlot(key);
+        if (i == nCapacity) return 0;
+        erase(const_iterator(this, i));
+        return 1;
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = nCapacity ? memusage::MallocUsage(nCapacity * sizeof(Slot)) : 0;
+        for (const Chunk& chunk : vChunks) nUsage += memusage::MallocUsage(chunk.nNodes * sizeof(Node));
+        return nUsage + memusage::DynamicUsage(vChunks);
+    }
+};
+
+#endif // MARIA_POOLEDHASHMAP_H
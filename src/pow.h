@@ -14,6 +14,7 @@ class CBlockHeader;
 class CBlockIndex;
 class uint256;
 class arith_uint256;
+namespace Consensus { struct Params; }
 
 // Define difficulty retarget algorithms
 enum DiffMode {
@@ -29,4 +30,7 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 
+/** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
+int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params& params);
+
 #endif // BITCOIN_POW_H
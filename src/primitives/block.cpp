@@ -8,6 +8,7 @@
 
 #include "hash.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "util/system.h"
@@ -32,6 +33,33 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+void CBlockHeader::GetHashes(uint32_t nCount, std::vector<uint256>& vHashes) const
+{
+    static const size_t NONCE_OFFSET = 76;
+
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_GETHASH, PROTOCOL_VERSION, data, 0, *this);
+    assert(data.size() >= NONCE_OFFSET + 4);
+
+    vHashes.resize(nCount);
+    if (nVersion < 4) {
+        for (uint32_t i = 0; i < nCount; i++) {
+            WriteLE32(&data[NONCE_OFFSET], nNonce + i);
+            vHashes[i] = HashQuark(data.data(), NONCE_OFFSET + 4);
+        }
+        return;
+    }
+    // version >= 4: the nonce lives in the second SHA256 block, so the
+    // state after the first 64 bytes is shared by every candidate.
+    CHash256 midstate;
+    midstate.Write(data.data(), 64);
+    for (uint32_t i = 0; i < nCount; i++) {
+        WriteLE32(&data[NONCE_OFFSET], nNonce + i);
+        CHash256 hasher(midstate);
+        hasher.Write(data.data() + 64, data.size() - 64).Finalize(vHashes[i].begin());
+    }
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -69,6 +69,11 @@ public:
 
     uint256 GetHash() const;
 
+    /** Hash the header for nCount consecutive nonces, starting at nNonce.
+     * The header is serialized once and only the nonce bytes are rewritten
+     * per hash; for SHA256d headers the first 64 bytes are hashed only once. */
+    void GetHashes(uint32_t nCount, std::vector<uint256>& vHashes) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -105,7 +105,14 @@ uint256 CTransaction::ComputeHash() const
 
 size_t CTransaction::DynamicMemoryUsage() const
 {
-    return memusage::RecursiveDynamicUsage(vin) + memusage::RecursiveDynamicUsage(vout);
+    size_t nUsage = memusage::RecursiveDynamicUsage(vin) + memusage::RecursiveDynamicUsage(vout);
+    if (sapData) {
+        nUsage += memusage::DynamicUsage(sapData->vShieldedSpend) + memusage::DynamicUsage(sapData->vShieldedOutput);
+    }
+    if (extraPayload) {
+        nUsage += memusage::DynamicUsage(*extraPayload);
+    }
+    return nUsage;
 }
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
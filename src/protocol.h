@@ -215,6 +215,32 @@ extern const char* FILTERCLEAR;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char* SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * @since protocol version 70927 as described by BIP152.
+ */
+extern const char* SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header, the block
+ * signature and a partial list of transactions.
+ * @since protocol version 70927 as described by BIP152.
+ */
+extern const char* CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @since protocol version 70927 as described by BIP152.
+ */
+extern const char* GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @since protocol version 70927 as described by BIP152.
+ */
+extern const char* BLOCKTXN;
 /**
  * The spork message is used to send spork values to connected
  * peers
@@ -317,6 +343,10 @@ enum ServiceFlags : uint64_t {
     // that the node doesn't want to receive master nodes messages. (the 1<<3 was not picked as constant because on bitcoin 0.14 is witness and we want that update here )
     NODE_BLOOM_WITHOUT_MN = (1 << 4),
 
+    // NODE_NETWORK_LIMITED means the same as NODE_NETWORK with the limitation of only
+    // serving the last NODE_NETWORK_LIMITED_MIN_BLOCKS blocks (pruned nodes, see BIP159)
+    NODE_NETWORK_LIMITED = (1 << 10),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -450,7 +480,10 @@ enum GetDataMsg
     MSG_QUORUM_COMPLAINT,
     MSG_QUORUM_JUSTIFICATION,
     MSG_QUORUM_PREMATURE_COMMITMENT,
-    MSG_TYPE_MAX = MSG_QUORUM_PREMATURE_COMMITMENT
+    // Defined in BIP152 (with value 4, already taken here). Only valid in getdata,
+    // for blocks that are to be sent as a cmpctblock message.
+    MSG_CMPCT_BLOCK,
+    MSG_TYPE_MAX = MSG_CMPCT_BLOCK
 };
 
 /** inv message data */
@@ -707,14 +707,17 @@ QString formatServicesStr(quint64 mask)
 {
     QStringList strList;
 
-    // Just scan the last 8 bits for now.
-    for (int i = 0; i < 8; i++) {
+    // Just scan the last 16 bits for now.
+    for (int i = 0; i < 16; i++) {
         uint64_t check = 1 << i;
         if (mask & check) {
             switch (check) {
             case NODE_NETWORK:
                 strList.append(QObject::tr("NETWORK"));
                 break;
+            case NODE_NETWORK_LIMITED:
+                strList.append(QObject::tr("LIMITED"));
+                break;
             case NODE_BLOOM:
             case NODE_BLOOM_WITHOUT_MN:
                 strList.append(QObject::tr("BLOOM"));
@@ -19,6 +19,7 @@
 #include "script/descriptor.h"
 #include "sync.h"
 #include "txdb.h"
+#include "txprecheck.h"
 #include "util/system.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
@@ -126,9 +127,9 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("acc_checkpoint", blockindex->nAccumulatorCheckpoint.GetHex());
+    result.pushKV("acc_checkpoint", blockindex->GetAccumulatorCheckpoint().GetHex());
     // Sapling shield pool value
-    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->nChainSaplingValue, blockindex->nSaplingValue));
+    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->GetChainSaplingValue(), blockindex->nSaplingValue));
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     if (pnext)
@@ -594,6 +595,9 @@ UniValue getblock(const JSONRPCRequest& request)
     if (pblockindex == nullptr)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
     CBlock block;
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
@@ -705,7 +709,7 @@ UniValue getsupplyinfo(const JSONRPCRequest& request)
     const CAmount tSupply = MoneySupply.Get();
     ret.pushKV("updateheight", MoneySupply.GetCacheHeight());
     ret.pushKV("transparentsupply", ValueFromAmount(tSupply));
-    Optional<CAmount> shieldedPoolValue = WITH_LOCK(cs_main, return (chainActive.Tip() ? chainActive.Tip()->nChainSaplingValue : nullopt); );
+    Optional<CAmount> shieldedPoolValue = WITH_LOCK(cs_main, return (chainActive.Tip() ? chainActive.Tip()->GetChainSaplingValue() : nullopt); );
     ret.pushKV("shieldsupply", ValuePoolDesc(shieldedPoolValue, nullopt)["chainValue"]);
     const CAmount totalSupply = tSupply + (shieldedPoolValue ? *shieldedPoolValue : 0);
     ret.pushKV("totalsupply", ValueFromAmount(totalSupply));
@@ -922,6 +926,59 @@ UniValue verifychain(const JSONRPCRequest& request)
     return CVerifyDB().VerifyDB(pcoinsTip.get(), nCheckLevel, nCheckDepth);
 }
 
+UniValue pruneblockchain(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "pruneblockchain height\n"
+            "\nDeletes the block and undo files of the active chain up to the given height.\n"
+            "Blocks within the prune keep depth from the tip are never deleted.\n"
+
+            "\nArguments:\n"
+            "1. \"height\"       (numeric, required) The block height to prune up to. May be set to a discrete height, or a unix timestamp\n"
+            "                  to prune blocks whose block time is at least 2 hours older than the provided timestamp.\n"
+
+            "\nResult:\n"
+            "n    (numeric) Height of the last block pruned.\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("pruneblockchain", "1000") + HelpExampleRpc("pruneblockchain", "1000"));
+
+    if (!fPruneMode)
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot prune blocks because node is not in prune mode.");
+
+    LOCK(cs_main);
+
+    int heightParam = request.params[0].get_int();
+    if (heightParam < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
+
+    // Height value more than a billion is too high to be a block height, and
+    // too low to be a block time (corresponds to timestamp from Sep 2001).
+    if (heightParam > 1000000000) {
+        // Add a 2 hour buffer to include blocks which might have had old timestamps
+        CBlockIndex* pindex = chainActive.FindEarliestAtLeast(heightParam - TIMESTAMP_WINDOW);
+        if (!pindex) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Could not find block with at least the specified timestamp.");
+        }
+        heightParam = pindex->nHeight;
+    }
+
+    unsigned int height = (unsigned int) heightParam;
+    unsigned int chainHeight = (unsigned int) chainActive.Height();
+    if (chainHeight < Params().PruneAfterHeight())
+        throw JSONRPCError(RPC_MISC_ERROR, "Blockchain is too short for pruning.");
+    else if (height > chainHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
+    else if (height > chainHeight - GetPruneKeepDepth()) {
+        LogPrint(BCLog::RPC, "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.\n");
+        height = chainHeight - GetPruneKeepDepth();
+    }
+
+    PruneBlockFilesManual(height);
+    return GetPruneHeight() - 1;
+}
+
 /** Implementation of IsSuperMajority with better feedback */
 static UniValue SoftForkMajorityDesc(int version, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
@@ -1014,6 +1071,11 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "    \"valueDelta\":        (numeric) Change in value held by the Sapling circuit over the chain tip block\n"
             "  },\n"
             "  \"initial_block_downloading\": true|false, (boolean) whether the node is in initial block downloading state or not\n"
+            "  \"size_on_disk\": xxxxxx,       (numeric) the estimated size of the block and undo files on disk\n"
+            "  \"pruned\": xx,                 (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
+            "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
+            "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1050,8 +1112,19 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.pushKV("verificationprogress", Checkpoints::GuessVerificationProgress(pChainTip));
     obj.pushKV("chainwork", pChainTip ? pChainTip->nChainWork.GetHex() : "");
     // Sapling shield pool value
-    obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->nChainSaplingValue, pChainTip->nSaplingValue) : 0);
+    obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->GetChainSaplingValue(), pChainTip->nSaplingValue) : 0);
     obj.pushKV("initial_block_downloading", IsInitialBlockDownload());
+    obj.pushKV("size_on_disk", CalculateCurrentUsage());
+    obj.pushKV("pruned", fPruneMode);
+    if (fPruneMode) {
+        obj.pushKV("pruneheight", GetPruneHeight());
+        // if 0, execution bypasses the whole if block.
+        bool automatic_pruning = (gArgs.GetArg("-prune", 0) != 1);
+        obj.pushKV("automatic_pruning", automatic_pruning);
+        if (automatic_pruning) {
+            obj.pushKV("prune_target_size", nPruneTarget);
+        }
+    }
     UniValue softforks(UniValue::VARR);
     softforks.push_back(SoftForkDesc("bip65", 5, pChainTip));
     obj.pushKV("softforks",             softforks);
@@ -1179,6 +1252,15 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
 
+    const TxAdmissionStats stats = GetTxAdmissionStats();
+    UniValue admission(UniValue::VOBJ);
+    admission.pushKV("prechecked", stats.nPreChecked);
+    admission.pushKV("avgprecheckwait", stats.nPreChecked ? 0.001 * stats.nTimeQueued / stats.nPreChecked : 0.0);
+    admission.pushKV("avgprecheck", stats.nPreChecked ? 0.001 * stats.nTimePreCheck / stats.nPreChecked : 0.0);
+    admission.pushKV("committed", stats.nCommitted);
+    admission.pushKV("avgcommit", stats.nCommitted ? 0.001 * stats.nTimeCommit / stats.nCommitted : 0.0);
+    ret.pushKV("admission", admission);
+
     return ret;
 }
 
@@ -1198,6 +1280,13 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"admission\": {               (json object) Transactions received from peers since startup\n"
+            "     \"prechecked\": xxxxx,       (numeric) Transactions whose signatures and proofs were verified on the pre-check threads\n"
+            "     \"avgprecheckwait\": xxxxx,  (numeric) Average time they waited for a pre-check thread, in milliseconds\n"
+            "     \"avgprecheck\": xxxxx,      (numeric) Average time spent pre-checking them, in milliseconds\n"
+            "     \"committed\": xxxxx,        (numeric) Transactions submitted to the mempool\n"
+            "     \"avgcommit\": xxxxx         (numeric) Average time spent submitting them, holding the chain lock, in milliseconds\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -1227,7 +1316,7 @@ UniValue invalidateblock(const JSONRPCRequest& request)
         if (mapBlockIndex.count(hash) == 0)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-        CBlockIndex* pblockindex = mapBlockIndex[hash];
+        CBlockIndex* pblockindex = mapBlockIndex.at(hash);
         InvalidateBlock(state, Params(), pblockindex);
     }
 
@@ -1267,7 +1356,7 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
         if (mapBlockIndex.count(hash) == 0)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-        CBlockIndex* pblockindex = mapBlockIndex[hash];
+        CBlockIndex* pblockindex = mapBlockIndex.at(hash);
         ReconsiderBlock(state, pblockindex);
     }
 
@@ -1689,6 +1778,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true,  {"force_update"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"nblocks"} },
 
     { "blockchain",         "scantxoutset",           &scantxoutset,           true,  {"action", "scanobjects"} },
@@ -162,6 +162,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "shieldsendmany", 2, "minconf" },
     { "shieldsendmany", 3, "fee" },
     { "shieldsendmany", 4, "subtract_fee_from" },
+    { "pruneblockchain", 0, "height" },
     { "signrawtransaction", 1, "prevtxs" },
     { "signrawtransaction", 2, "privkeys" },
     { "spork", 1, "value" },
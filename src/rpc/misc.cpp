@@ -19,6 +19,7 @@
 #include "timedata.h"
 #include "tiertwo/tiertwo_sync_state.h"
 #include "util/system.h"
+#include "validation.h"
 #ifdef ENABLE_WALLET
 #include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
@@ -93,13 +94,16 @@ UniValue getinfo(const JSONRPCRequest& request)
 #endif
 
     std::string services;
-    for (int i = 0; i < 8; i++) {
+    for (int i = 0; i < 16; i++) {
         uint64_t check = 1 << i;
         if (g_connman->GetLocalServices() & check) {
             switch (check) {
                 case NODE_NETWORK:
                     services+= "NETWORK/";
                     break;
+                case NODE_NETWORK_LIMITED:
+                    services+= "NETWORK_LIMITED/";
+                    break;
                 case NODE_BLOOM:
                 case NODE_BLOOM_WITHOUT_MN:
                     services+= "BLOOM/";
@@ -713,6 +717,16 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBlockIndexMemoryInfo()
+{
+    const BlockIndexMemoryStats stats = WITH_LOCK(cs_main, return GetBlockIndexMemoryStats(); );
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("entries", uint64_t(stats.nEntries));
+    obj.pushKV("entry_size", uint64_t(sizeof(CBlockIndex)));
+    obj.pushKV("usage", uint64_t(stats.nUsage));
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -731,6 +745,11 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockindex\": {           (json object) Information about the entries of the block index\n"
+            "    \"entries\": xxxxx,       (numeric) Number of entries\n"
+            "    \"entry_size\": xxx,      (numeric) Size of an entry in bytes\n"
+            "    \"usage\": xxxxx,         (numeric) Bytes used by the entries, including side tables and the hash map\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -739,6 +758,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("locked", RPCLockedMemoryInfo());
+    obj.pushKV("blockindex", RPCBlockIndexMemoryInfo());
     return obj;
 }
 
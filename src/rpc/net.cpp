@@ -101,6 +101,22 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"cmpctblocks\": {           (object) Compact block relay with this peer\n"
+            "       \"hb_to\": true|false,     (boolean) Whether the peer asked us to announce new blocks with cmpctblock messages\n"
+            "       \"provides\": true|false,  (boolean) Whether the peer can serve us compact blocks\n"
+            "       \"received\": n,          (numeric) The cmpctblock messages processed from this peer\n"
+            "       \"reconstructed\": n,     (numeric) The blocks rebuilt from them\n"
+            "       \"txn_requested\": n,     (numeric) The getblocktxn round-trips needed to rebuild them\n"
+            "       \"failed\": n,            (numeric) The reconstructions that fell back to a full block\n"
+            "       \"hit_rate\": x.xxx,      (numeric) The share of cmpctblock messages rebuilt into a block, without a full block download\n"
+            "       \"mempool_hit_rate\": x.xxx, (numeric) The share of short ids found in our mempool\n"
+            "    }\n"
+            "    \"blockdownload\": {         (object) Blocks requested from this peer\n"
+            "       \"blocks\": n,            (numeric) The blocks received\n"
+            "       \"bytes\": n,             (numeric) Their total size\n"
+            "       \"time\": n,              (numeric) The seconds spent waiting for them\n"
+            "       \"rate\": n,              (numeric) The download rate, in bytes per second\n"
+            "    }\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -166,6 +182,28 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+
+            const CompactBlockStats& cmpct = statestats.cmpctStats;
+            UniValue cmpctObj(UniValue::VOBJ);
+            cmpctObj.pushKV("hb_to", statestats.fPreferHeaderAndIDs);
+            cmpctObj.pushKV("provides", statestats.fProvidesHeaderAndIDs);
+            cmpctObj.pushKV("received", cmpct.nReceived);
+            cmpctObj.pushKV("reconstructed", cmpct.nReconstructed);
+            cmpctObj.pushKV("txn_requested", cmpct.nTxnRequested);
+            cmpctObj.pushKV("failed", cmpct.nFailed);
+            cmpctObj.pushKV("hit_rate", cmpct.nReceived ? (double)cmpct.nReconstructed / cmpct.nReceived : 0.0);
+            const uint64_t nShortIds = cmpct.nTxFromMempool + cmpct.nTxMissing;
+            cmpctObj.pushKV("mempool_hit_rate", nShortIds ? (double)cmpct.nTxFromMempool / nShortIds : 0.0);
+            obj.pushKV("cmpctblocks", cmpctObj);
+
+            const BlockDownloadStats& download = statestats.downloadStats;
+            const double dTimeBusy = download.nTimeBusy / 1e6;
+            UniValue downloadObj(UniValue::VOBJ);
+            downloadObj.pushKV("blocks", download.nBlocks);
+            downloadObj.pushKV("bytes", download.nBytes);
+            downloadObj.pushKV("time", dTimeBusy);
+            downloadObj.pushKV("rate", dTimeBusy > 0 ? (int64_t)(download.nBytes / dTimeBusy) : 0);
+            obj.pushKV("blockdownload", downloadObj);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
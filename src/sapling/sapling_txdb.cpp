@@ -16,6 +16,17 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
         tree = new_tree;
         return true;
     }
+    {
+        LOCK(cs_flush);
+        if (pflushing) {
+            CAnchorsSaplingMap::const_iterator it = pflushing->mapSaplingAnchors.find(rt);
+            if (it != pflushing->mapSaplingAnchors.end()) {
+                if (!it->second.entered) return false;
+                tree = it->second.tree;
+                return true;
+            }
+        }
+    }
 
     bool read = db.Read(std::make_pair(DB_SAPLING_ANCHOR, rt), tree);
 
@@ -23,11 +34,22 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
 }
 
 bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
+    {
+        LOCK(cs_flush);
+        if (pflushing) {
+            CNullifiersMap::const_iterator it = pflushing->mapSaplingNullifiers.find(nf);
+            if (it != pflushing->mapSaplingNullifiers.end()) return it->second.entered;
+        }
+    }
     bool spent = false;
     return db.Read(std::make_pair(DB_SAPLING_NULLIFIER, nf), spent);
 }
 
 uint256 CCoinsViewDB::GetBestAnchor() const {
+    {
+        LOCK(cs_flush);
+        if (pflushing && !pflushing->hashSaplingAnchor.IsNull()) return pflushing->hashSaplingAnchor;
+    }
     uint256 hashBestAnchor;
     if (!db.Read(DB_BEST_SAPLING_ANCHOR, hashBestAnchor))
         return SaplingMerkleTree::empty_root();
@@ -97,6 +97,75 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
     return true;
 }
 
+bool CheckSaplingProofs(const CTransaction& tx, CValidationState& state, int dosLevel)
+{
+    assert(tx.hasSaplingData());
+
+    uint256 dataToBeSigned;
+    // Empty output script.
+    CScript scriptCode;
+    try {
+        dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
+    } catch (const std::logic_error& ex) {
+        // A logic error should never occur because we pass NOT_AN_INPUT and
+        // SIGHASH_ALL to SignatureHash().
+        return state.DoS(100, error("%s: error computing signature hash", __func__ ),
+                         REJECT_INVALID, "error-computing-signature-hash");
+    }
+
+    // Sapling verification process
+    auto ctx = librustzcash_sapling_verification_ctx_init();
+
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
+                ctx,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            return state.DoS(
+                    dosLevel,
+                    error("%s: Sapling spend description invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            // This should be a non-contextual check, but we check it here
+            // as we need to pass over the outputs anyway in order to then
+            // call librustzcash_sapling_final_check().
+            return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
+                             REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
+        }
+    }
+
+    if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin())) {
+        librustzcash_sapling_verification_ctx_free(ctx);
+        return state.DoS(
+                dosLevel,
+                error("%s: Sapling binding signature invalid", __func__ ),
+                REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+    }
+
+    librustzcash_sapling_verification_ctx_free(ctx);
+    return true;
+}
+
 /**
 * Check a transaction contextually against a set of consensus rules valid at a given block height.
 *
@@ -116,7 +185,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool isInitBlockDownload)
+        bool isInitBlockDownload,
+        bool fCheckProofs)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -158,72 +228,27 @@ bool ContextualCheckTransaction(
                     REJECT_INVALID, "bad-cs-has-shielded-data");
     }
 
-    if (hasShieldedData) {
-        uint256 dataToBeSigned;
-        // Empty output script.
-        CScript scriptCode;
-        try {
-            dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
-        } catch (const std::logic_error& ex) {
-            // A logic error should never occur because we pass NOT_AN_INPUT and
-            // SIGHASH_ALL to SignatureHash().
-            return state.DoS(100, error("%s: error computing signature hash", __func__ ),
-                             REJECT_INVALID, "error-computing-signature-hash");
-        }
+    if (hasShieldedData && fCheckProofs) {
+        return CheckSaplingProofs(tx, state, dosLevelPotentiallyRelaxing);
+    }
+    return true;
+}
 
-        // Sapling verification process
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                    ctx,
-                    spend.cv.begin(),
-                    spend.anchor.begin(),
-                    spend.nullifier.begin(),
-                    spend.rk.begin(),
-                    spend.zkproof.begin(),
-                    spend.spendAuthSig.begin(),
-                    dataToBeSigned.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(
-                        dosLevelPotentiallyRelaxing,
-                        error("%s: Sapling spend description invalid", __func__ ),
-                        REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
-        }
+} // End SaplingValidation namespace
 
-        for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                    ctx,
-                    output.cv.begin(),
-                    output.cmu.begin(),
-                    output.ephemeralKey.begin(),
-                    output.zkproof.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                // This should be a non-contextual check, but we check it here
-                // as we need to pass over the outputs anyway in order to then
-                // call librustzcash_sapling_final_check().
-                return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
-                                 REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
-            }
-        }
+bool CSaplingProofCheck::operator()()
+{
+    CValidationState state;
+    return SaplingValidation::CheckSaplingProofs(*ptx, state, 100);
+}
 
-        if (!librustzcash_sapling_final_check(
-                ctx,
-                tx.sapData->valueBalance,
-                tx.sapData->bindingSig.begin(),
-                dataToBeSigned.begin())) {
-            librustzcash_sapling_verification_ctx_free(ctx);
-            return state.DoS(
-                    dosLevelPotentiallyRelaxing,
-                    error("%s: Sapling binding signature invalid", __func__ ),
-                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+bool SaplingProofChecks::Verify(CValidationState& state, int dosLevel) const
+{
+    for (const CSaplingProofCheck& check : vChecks) {
+        const CTransactionRef& ptx = check.GetTx();
+        if (!SaplingValidation::CheckSaplingProofs(*ptx, state, dosLevel)) {
+            return error("%s: Sapling proofs of tx %s invalid", __func__, ptx->GetHash().ToString());
         }
-
-        librustzcash_sapling_verification_ctx_free(ctx);
     }
     return true;
 }
-
-
-} // End SaplingValidation namespace
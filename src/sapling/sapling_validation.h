@@ -7,8 +7,10 @@
 #define MARIA_SAPLING_VALIDATION_H
 
 #include "chainparams.h"
+#include "primitives/transaction.h"
+
+#include <vector>
 
-class CTransaction;
 class CValidationState;
 
 namespace SaplingValidation {
@@ -21,10 +23,59 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: when fCheckProofs is false, the zk-proofs and binding signature verification is left
+// to the caller (see SaplingProofChecks).
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, bool fCheckProofs = true);
+
+/** Verify the spend/output zk-proofs and the binding signature of a shielded transaction */
+bool CheckSaplingProofs(const CTransaction& tx, CValidationState& state, int dosLevel);
 
 }; // End SaplingValidation namespace
 
+/**
+ * Closure representing the verification of the Sapling proofs and binding
+ * signature of a single transaction (same interface as CScriptCheck).
+ */
+class CSaplingProofCheck
+{
+private:
+    CTransactionRef ptx;
+
+public:
+    CSaplingProofCheck() {}
+    explicit CSaplingProofCheck(const CTransactionRef& ptxIn) : ptx(ptxIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingProofCheck& check)
+    {
+        ptx.swap(check.ptx);
+    }
+
+    const CTransactionRef& GetTx() const { return ptx; }
+};
+
+/**
+ * Collects the Sapling proof checks of the shielded transactions of a block, so
+ * that ConnectBlock verifies them after the contextual checks (alongside the
+ * script checks). This is not batch verification: librustzcash only has
+ * per-transaction verification contexts, so each transaction is verified on
+ * its own, one after the other.
+ */
+class SaplingProofChecks
+{
+private:
+    std::vector<CSaplingProofCheck> vChecks;
+
+public:
+    void Add(const CTransactionRef& ptx) { vChecks.emplace_back(ptx); }
+    bool empty() const { return vChecks.empty(); }
+    size_t size() const { return vChecks.size(); }
+
+    /** Verify the collected checks, in order. On failure, state holds the reason of the offending tx. */
+    bool Verify(CValidationState& state, int dosLevel) const;
+};
+
 #endif //MARIA_SAPLING_VALIDATION_H
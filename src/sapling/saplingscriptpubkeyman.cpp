@@ -357,47 +357,77 @@ std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKe
         return {};
     }
 
-    LOCK(wallet->cs_KeyStore);
     const uint256& hash = tx.GetHash();
 
-    mapSaplingNoteData_t noteData;
-    SaplingIncomingViewingKeyMap viewingKeysToAdd;
-
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.sapData->vShieldedOutput[i];
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
-            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
-            }
+    // Use the notes decrypted ahead for the whole block if any, otherwise trial-decrypt
+    // here, without holding cs_KeyStore, with the (output, ivk) pairs spread over threads.
+    std::vector<SaplingDecryptedNote> vDecrypted;
+    if (!GetPrecomputedSaplingNotes(hash, vDecrypted)) {
+        vDecrypted = SaplingTrialDecrypt({MakeTransactionRef(tx)}, GetIncomingViewingKeys())[hash];
+    }
 
-            // Check if we already have it.
-            Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
-            if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                viewingKeysToAdd[address.get()] = ivk;
-            }
-            // We don't cache the nullifier here as computing it requires knowledge of the note position
-            // in the commitment tree, which can only be determined when the transaction has been mined.
-            SaplingOutPoint op {hash, i};
-            SaplingNoteData nd;
-            nd.ivk = ivk;
-            nd.amount = result->value();
-            nd.address = address;
-            const auto& memo = result->memo();
-            // don't save empty memo (starting with 0xF6)
-            if (memo[0] < 0xF6) {
-                nd.memo = memo;
-            }
-            noteData.insert(std::make_pair(op, nd));
-            break;
+    LOCK(wallet->cs_KeyStore);
+    mapSaplingNoteData_t noteData;
+    SaplingIncomingViewingKeyMap viewingKeysToAdd;
+    for (const SaplingDecryptedNote& decrypted : vDecrypted) {
+        const libzcash::SaplingIncomingViewingKey& ivk = decrypted.ivk;
+        const libzcash::SaplingNotePlaintext& result = decrypted.note;
+
+        // Check if we already have it.
+        Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.d);
+        if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
+            viewingKeysToAdd[address.get()] = ivk;
+        }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {hash, decrypted.nOutput};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        nd.amount = result.value();
+        nd.address = address;
+        const auto& memo = result.memo();
+        // don't save empty memo (starting with 0xF6)
+        if (memo[0] < 0xF6) {
+            nd.memo = memo;
         }
+        noteData.insert(std::make_pair(op, nd));
     }
 
     return std::make_pair(noteData, viewingKeysToAdd);
 }
 
+void SaplingScriptPubKeyMan::PrecomputeSaplingNotes(const std::vector<CTransactionRef>& vtx)
+{
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks = GetIncomingViewingKeys();
+    const size_t nIvks = ivks.size();
+    SetPrecomputedSaplingNotes(SaplingTrialDecrypt(vtx, ivks), nIvks);
+}
+
+void SaplingScriptPubKeyMan::SetPrecomputedSaplingNotes(SaplingDecryptedNotesMap&& notes, size_t nIvks)
+{
+    LOCK(wallet->cs_wallet);
+    m_precomputed_notes = std::move(notes);
+    m_precomputed_ivks = nIvks;
+}
+
+void SaplingScriptPubKeyMan::ClearPrecomputedSaplingNotes()
+{
+    LOCK(wallet->cs_wallet);
+    m_precomputed_notes.clear();
+}
+
+bool SaplingScriptPubKeyMan::GetPrecomputedSaplingNotes(const uint256& txid, std::vector<SaplingDecryptedNote>& vNotesRet) const
+{
+    LOCK(wallet->cs_wallet);
+    auto it = m_precomputed_notes.find(txid);
+    if (it == m_precomputed_notes.end()) return false;
+    // Keys are only ever added: the results are stale if the wallet got new ones since
+    if (WITH_LOCK(wallet->cs_KeyStore, return wallet->mapSaplingFullViewingKeys.size(); ) != m_precomputed_ivks) return false;
+    vNotesRet = it->second;
+    return true;
+}
+
 std::vector<libzcash::SaplingPaymentAddress> SaplingScriptPubKeyMan::FindMySaplingAddresses(const CTransaction& tx) const
 {
     LOCK(wallet->cs_KeyStore);
@@ -421,6 +451,17 @@ std::vector<libzcash::SaplingPaymentAddress> SaplingScriptPubKeyMan::FindMySapli
     return ret;
 }
 
+std::vector<libzcash::SaplingIncomingViewingKey> SaplingScriptPubKeyMan::GetIncomingViewingKeys() const
+{
+    LOCK(wallet->cs_KeyStore);
+    std::vector<libzcash::SaplingIncomingViewingKey> ret;
+    ret.reserve(wallet->mapSaplingFullViewingKeys.size());
+    for (const auto& it : wallet->mapSaplingFullViewingKeys) {
+        ret.emplace_back(it.first);
+    }
+    return ret;
+}
+
 void SaplingScriptPubKeyMan::GetNotes(const std::vector<SaplingOutPoint>& saplingOutpoints,
                                       std::vector<SaplingNoteEntry>& saplingEntriesRet) const
 {
@@ -7,6 +7,7 @@
 
 #include "consensus/consensus.h"
 #include "sapling/note.h"
+#include "sapling/trialdecryption.h"
 #include "wallet/hdchain.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
@@ -273,6 +274,15 @@ public:
     //! Find all of the addresses in the given tx that have been sent to a SaplingPaymentAddress in this wallet.
     std::vector<libzcash::SaplingPaymentAddress> FindMySaplingAddresses(const CTransaction& tx) const;
 
+    //! Return the incoming viewing keys of every full viewing key in the wallet
+    std::vector<libzcash::SaplingIncomingViewingKey> GetIncomingViewingKeys() const;
+
+    //! Trial-decrypt the shielded txes of a block at once, for the FindMySaplingNotes calls that follow
+    void PrecomputeSaplingNotes(const std::vector<CTransactionRef>& vtx);
+    //! Same, with notes already decrypted elsewhere (e.g. by the rescan workers) using nIvks keys
+    void SetPrecomputedSaplingNotes(SaplingDecryptedNotesMap&& notes, size_t nIvks);
+    void ClearPrecomputedSaplingNotes();
+
     //! Find notes for the outpoints
     void GetNotes(const std::vector<SaplingOutPoint>& saplingOutpoints,
                   std::vector<SaplingNoteEntry>& saplingEntriesRet) const;
@@ -413,6 +423,11 @@ private:
     Optional<uint256> commonOVK;
     uint256 getCommonOVKFromSeed() const;
 
+    /* Notes decrypted ahead for the block being connected or rescanned, valid
+     * while the wallet has m_precomputed_ivks viewing keys. Guarded by wallet->cs_wallet */
+    SaplingDecryptedNotesMap m_precomputed_notes;
+    size_t m_precomputed_ivks{0};
+    bool GetPrecomputedSaplingNotes(const uint256& txid, std::vector<SaplingDecryptedNote>& vNotesRet) const;
 
     /**
      * Used to keep track of spent Notes, and
@@ -0,0 +1,86 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "sapling/trialdecryption.h"
+
+#include "sync.h"
+#include "util/system.h"
+
+#include <atomic>
+#include <future>
+#include <limits>
+
+namespace {
+
+struct TrialOutput
+{
+    const uint256* txid;
+    uint32_t nOutput;
+    const OutputDescription* output;
+};
+
+} // anon namespace
+
+SaplingDecryptedNotesMap SaplingTrialDecrypt(const std::vector<CTransactionRef>& vtx,
+                                             const std::vector<libzcash::SaplingIncomingViewingKey>& ivks,
+                                             int nThreads)
+{
+    SaplingDecryptedNotesMap ret;
+    std::vector<TrialOutput> vOutputs;
+    for (const CTransactionRef& tx : vtx) {
+        if (!tx->IsShieldedTx()) continue;
+        auto it = ret.emplace(tx->GetHash(), std::vector<SaplingDecryptedNote>()).first;
+        for (uint32_t i = 0; i < tx->sapData->vShieldedOutput.size(); i++) {
+            vOutputs.push_back({&it->first, i, &tx->sapData->vShieldedOutput[i]});
+        }
+    }
+    const size_t nPairs = vOutputs.size() * ivks.size();
+    if (nPairs == 0) return ret;
+
+    // Index in ivks of the first key that decrypted each output (or NONE)
+    static const size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<std::atomic<size_t>> vFirstMatch(vOutputs.size());
+    for (auto& first : vFirstMatch) first = NONE;
+    std::vector<Optional<libzcash::SaplingNotePlaintext>> vNotes(vOutputs.size());
+    Mutex cs_notes;
+
+    if (nThreads <= 0) nThreads = GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_SAPLING_DECRYPT_THREADS));
+    if (nPairs < MIN_SAPLING_DECRYPT_PARALLEL_PAIRS) nThreads = 1;
+    // A few chunks per thread keeps the threads busy until the end of the batch
+    const size_t nChunk = std::max<size_t>(1, nPairs / (nThreads * 4));
+    std::atomic<size_t> nNextChunk{0};
+
+    auto worker = [&]() {
+        for (size_t nBegin = nNextChunk.fetch_add(nChunk); nBegin < nPairs; nBegin = nNextChunk.fetch_add(nChunk)) {
+            const size_t nEnd = std::min(nPairs, nBegin + nChunk);
+            for (size_t p = nBegin; p < nEnd; p++) {
+                const size_t o = p / ivks.size();
+                const size_t k = p % ivks.size();
+                if (k > vFirstMatch[o]) continue;
+                const OutputDescription& output = *vOutputs[o].output;
+                auto note = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivks[k], output.ephemeralKey, output.cmu);
+                if (!note) continue;
+                LOCK(cs_notes);
+                if (k < vFirstMatch[o]) {
+                    vFirstMatch[o] = k;
+                    vNotes[o] = note;
+                }
+            }
+        }
+    };
+
+    std::vector<std::future<void>> vWorkers;
+    for (int i = 1; i < nThreads; i++) {
+        vWorkers.emplace_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto& w : vWorkers) w.get();
+
+    for (size_t o = 0; o < vOutputs.size(); o++) {
+        if (vFirstMatch[o] == NONE) continue;
+        ret[*vOutputs[o].txid].push_back({vOutputs[o].nOutput, ivks[vFirstMatch[o]], *vNotes[o]});
+    }
+    return ret;
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_SAPLING_TRIALDECRYPTION_H
+#define MARIA_SAPLING_TRIALDECRYPTION_H
+
+#include "primitives/transaction.h"
+#include "sapling/address.h"
+#include "sapling/note.h"
+
+#include <map>
+#include <vector>
+
+//! Maximum number of threads used by SaplingTrialDecrypt
+static const int MAX_SAPLING_DECRYPT_THREADS = 8;
+//! Below this many (output, ivk) pairs the batch is decrypted on the calling thread
+static const size_t MIN_SAPLING_DECRYPT_PARALLEL_PAIRS = 16;
+
+/** A shielded output that decrypted with one of the wallet's incoming viewing keys */
+struct SaplingDecryptedNote
+{
+    uint32_t nOutput;
+    libzcash::SaplingIncomingViewingKey ivk;
+    libzcash::SaplingNotePlaintext note;
+};
+
+/** Trial decryption results by txid. Every shielded tx of the batch has an entry, empty if nothing decrypted. */
+typedef std::map<uint256, std::vector<SaplingDecryptedNote>> SaplingDecryptedNotesMap;
+
+/**
+ * Trial-decrypt every shielded output of vtx with every key in ivks.
+ * All (output, ivk) pairs of the batch are split into chunks shared by up to
+ * nThreads threads (the caller included, nThreads <= 0 picks the core count),
+ * so a block with a few outputs and thousands of keys is spread as evenly as
+ * a block with many outputs. Once an output decrypted with a key, pairs with
+ * later keys are skipped; each output reports its first matching key in ivks
+ * order, so the result does not depend on scheduling.
+ */
+SaplingDecryptedNotesMap SaplingTrialDecrypt(const std::vector<CTransactionRef>& vtx,
+                                             const std::vector<libzcash::SaplingIncomingViewingKey>& ivks,
+                                             int nThreads = 0);
+
+#endif // MARIA_SAPLING_TRIALDECRYPTION_H
@@ -19,36 +19,40 @@ static bool HasStakeMinAgeOrDepth(int nHeight, uint32_t nTime, const CBlockIndex
     return true;
 }
 
-CMariaStake* CMariaStake::NewMariaStake(const CTxIn& txin, int nHeight, uint32_t nTime)
+CMariaStake* CMariaStake::NewMariaStake(const CTxIn& txin, int nHeight, uint32_t nTime, const CBlockIndex* pindexPrev)
 {
     if (txin.IsZerocoinSpend()) {
         error("%s: unable to initialize CMariaStake from zerocoin spend", __func__);
         return nullptr;
     }
 
+    CTxOut outFrom;
+    const CBlockIndex* pindexFrom = nullptr;
     // Look for the stake input in the coins cache first
     const Coin& coin = pcoinsTip->AccessCoin(txin.prevout);
     if (!coin.IsSpent()) {
-        const CBlockIndex* pindexFrom = mapBlockIndex.at(chainActive[coin.nHeight]->GetBlockHash());
-        // Check that the stake has the required depth/age
-        if (!HasStakeMinAgeOrDepth(nHeight, nTime, pindexFrom)) {
+        outFrom = coin.out;
+        pindexFrom = chainActive[coin.nHeight];
+    } else {
+        // Otherwise find the previous transaction in database
+        uint256 hashBlock;
+        CTransactionRef txPrev;
+        Coin coinSpent;
+        if (GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
+            outFrom = txPrev->vout[txin.prevout.n];
+            if (mapBlockIndex.count(hashBlock)) {
+                CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
+                if (chainActive.Contains(pindex)) pindexFrom = pindex;
+            }
+        } else if (fHavePruned && GetCoinSpentAfterFork(txin.prevout, pindexPrev, coinSpent)) {
+            // The block of the transaction is pruned, and the input was spent on the
+            // active chain after the fork of the block being staked
+            outFrom = coinSpent.out;
+            pindexFrom = chainActive[coinSpent.nHeight];
+        } else {
+            error("%s : INFO: read txPrev failed, tx id prev: %s", __func__, txin.prevout.hash.GetHex());
             return nullptr;
         }
-        // All good
-        return new CMariaStake(coin.out, txin.prevout, pindexFrom);
-    }
-
-    // Otherwise find the previous transaction in database
-    uint256 hashBlock;
-    CTransactionRef txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
-        error("%s : INFO: read txPrev failed, tx id prev: %s", __func__, txin.prevout.hash.GetHex());
-        return nullptr;
-    }
-    const CBlockIndex* pindexFrom = nullptr;
-    if (mapBlockIndex.count(hashBlock)) {
-        CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
-        if (chainActive.Contains(pindex)) pindexFrom = pindex;
     }
     // Check that the input is in the active chain
     if (!pindexFrom) {
@@ -60,7 +64,7 @@ CMariaStake* CMariaStake::NewMariaStake(const CTxIn& txin, int nHeight, uint32_t
         return nullptr;
     }
     // All good
-    return new CMariaStake(txPrev->vout[txin.prevout.n], txin.prevout, pindexFrom);
+    return new CMariaStake(outFrom, txin.prevout, pindexFrom);
 }
 
 bool CMariaStake::GetTxOutFrom(CTxOut& out) const
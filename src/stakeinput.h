@@ -39,7 +39,7 @@ public:
     CMariaStake(const CTxOut& _from, const COutPoint& _outPointFrom, const CBlockIndex* _pindexFrom) :
             CStakeInput(_pindexFrom), outputFrom(_from), outpointFrom(_outPointFrom) {}
 
-    static CMariaStake* NewMariaStake(const CTxIn& txin, int nHeight, uint32_t nTime);
+    static CMariaStake* NewMariaStake(const CTxIn& txin, int nHeight, uint32_t nTime, const CBlockIndex* pindexPrev);
 
     const CBlockIndex* GetIndexFrom() const override;
     bool GetTxOutFrom(CTxOut& out) const override;
@@ -0,0 +1,63 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_SUPPORT_ALLOCATORS_COUNTING_H
+#define MARIA_SUPPORT_ALLOCATORS_COUNTING_H
+
+#include "memusage.h"
+
+#include <memory>
+
+//
+// Allocator adding up the heap usage of what it allocates (as memusage counts
+// it) in a counter shared by its copies and rebinds, so that a node based
+// container can report its exact usage, whatever the size of its nodes.
+// A default constructed allocator counts nothing.
+// The counter is NOT thread safe: it is guarded by the lock of the container.
+//
+template <typename T>
+struct counting_allocator : public std::allocator<T> {
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    counting_allocator() noexcept {}
+    explicit counting_allocator(size_t* pnUsageIn) noexcept : pnUsage(pnUsageIn) {}
+    counting_allocator(const counting_allocator& a) noexcept : base(a), pnUsage(a.pnUsage) {}
+    template <typename U>
+    counting_allocator(const counting_allocator<U>& a) noexcept : base(a), pnUsage(a.pnUsage)
+    {
+    }
+    ~counting_allocator() noexcept {}
+    template <typename _Other>
+    struct rebind {
+        typedef counting_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        T* p = base::allocate(n);
+        if (pnUsage) *pnUsage += memusage::MallocUsage(sizeof(T) * n);
+        return p;
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (p != nullptr && pnUsage) *pnUsage -= memusage::MallocUsage(sizeof(T) * n);
+        base::deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const counting_allocator<U>& a) const { return pnUsage == a.pnUsage; }
+    template <typename U>
+    bool operator!=(const counting_allocator<U>& a) const { return pnUsage != a.pnUsage; }
+
+    size_t* pnUsage{nullptr};
+};
+
+#endif // MARIA_SUPPORT_ALLOCATORS_COUNTING_H
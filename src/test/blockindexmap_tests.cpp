@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_maria.h"
+
+#include "blockindexmap.h"
+#include "chain.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexmap_tests, BasicTestingSetup)
+
+// Insert an entry owning its hash, as InsertBlockIndex does
+static CBlockIndex* Insert(CBlockIndexMap& map, CBlockIndexArena& arena, const uint256& hash)
+{
+    CBlockIndex* pindex = arena.New();
+    auto ret = map.emplace(hash, pindex);
+    BOOST_CHECK(ret.second);
+    pindex->phashBlock = &ret.first->first;
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(insert_find_erase)
+{
+    CBlockIndexMap map;
+    CBlockIndexArena arena;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+    BOOST_CHECK(map.begin() == map.end());
+
+    // Enough entries to grow the table a few times
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex*> vEntries;
+    std::vector<const uint256*> vHashPtrs;
+    for (int i = 0; i < 1000; i++) {
+        vHashes.push_back(InsecureRand256());
+        vEntries.push_back(Insert(map, arena, vHashes.back()));
+        vEntries.back()->nHeight = i;
+        vHashPtrs.push_back(vEntries.back()->phashBlock);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK(!map.emplace(vHashes[0], vEntries[1]).second);
+    BOOST_CHECK(map.at(vHashes[0]) == vEntries[0]);
+    BOOST_CHECK_THROW(map.at(InsecureRand256()), std::out_of_range);
+
+    // The keys pointed to by phashBlock don't move when the table grows
+    for (int i = 0; i < 1000; i++) {
+        BOOST_CHECK(map.find(vHashes[i])->second == vEntries[i]);
+        BOOST_CHECK(vEntries[i]->GetBlockHash() == vHashes[i]);
+        BOOST_CHECK(&map.find(vHashes[i])->first == vHashPtrs[i]);
+    }
+    size_t nIterated = 0;
+    for (const auto& entry : map) {
+        BOOST_CHECK(entry.first == entry.second->GetBlockHash());
+        nIterated++;
+    }
+    BOOST_CHECK_EQUAL(nIterated, map.size());
+
+    // ... and when it is compacted by erase
+    for (int i = 0; i < 1000; i += 2) {
+        BOOST_CHECK_EQUAL(map.erase(vHashes[i]), 1U);
+        BOOST_CHECK_EQUAL(map.erase(vHashes[i]), 0U);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 500U);
+    for (int i = 0; i < 1000; i++) {
+        BOOST_CHECK_EQUAL(map.count(vHashes[i]), (size_t)(i % 2));
+        if (i % 2) {
+            BOOST_CHECK(vEntries[i]->phashBlock == vHashPtrs[i]);
+            BOOST_CHECK(vEntries[i]->GetBlockHash() == vHashes[i]);
+            BOOST_CHECK_EQUAL(map.at(vHashes[i])->nHeight, i);
+        }
+    }
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(colliding_slots)
+{
+    // With the table three quarters full, the probe sequences run into each
+    // other: erasing from the middle of a cluster must keep the rest reachable.
+    CBlockIndexMap map;
+    CBlockIndexArena arena;
+    map.reserve(48);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 48; i++) {
+        vHashes.push_back(InsecureRand256());
+        Insert(map, arena, vHashes.back());
+    }
+    const size_t nUsage = map.DynamicMemoryUsage();
+    for (int i = 0; i < 48; i += 3) {
+        BOOST_CHECK_EQUAL(map.erase(vHashes[i]), 1U);
+    }
+    for (int i = 0; i < 48; i++) {
+        const auto it = map.find(vHashes[i]);
+        BOOST_CHECK_EQUAL(it != map.end(), i % 3 != 0);
+        if (it != map.end()) BOOST_CHECK(it->second->GetBlockHash() == vHashes[i]);
+    }
+
+    // The erased entries are reused
+    for (int i = 0; i < 48; i += 3) {
+        vHashes[i] = InsecureRand256();
+        Insert(map, arena, vHashes[i]);
+    }
+    for (int i = 0; i < 48; i++) {
+        BOOST_CHECK(map.at(vHashes[i])->GetBlockHash() == vHashes[i]);
+    }
+    // reserve() sized the table for all of them
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), nUsage);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,218 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_maria.h"
+
+#include "clientversion.h"
+#include "pow.h"
+#include "streams.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktreedb_tests, BasicTestingSetup)
+
+// In-memory stand-in for mapBlockIndex / InsertBlockIndex
+struct LoadedIndex
+{
+    std::map<uint256, std::unique_ptr<CBlockIndex>> map;
+
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        if (hash.IsNull()) return nullptr;
+        auto it = map.find(hash);
+        if (it == map.end()) {
+            it = map.emplace(hash, std::make_unique<CBlockIndex>()).first;
+            it->second->phashBlock = &it->first;
+        }
+        return it->second.get();
+    }
+
+    bool Load(CBlockTreeDB& db, bool fVerifyAllHashes)
+    {
+        map.clear();
+        return db.LoadBlockIndexGuts([this](const uint256& hash) { return Insert(hash); }, fVerifyAllHashes);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(block_hash_checkpoint)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    // A short chain of v11 headers above the PoS activation (no PoW check)
+    LoadedIndex chain;
+    std::vector<const CBlockIndex*> vIndex;
+    CBlockIndex* pprev = nullptr;
+    for (int i = 0; i < 10; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = pprev ? pprev->GetBlockHash() : InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1600000000 + i;
+        header.nBits = 0x1e0ffff0;
+        CBlockIndex* pindex = chain.Insert(header.GetHash());
+        pindex->pprev = pprev;
+        pindex->nHeight = 1000 + i;
+        pindex->nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_TRANSACTIONS;
+        pindex->nDataPos = 100 * i;
+        pindex->nVersion = header.nVersion;
+        pindex->hashMerkleRoot = header.hashMerkleRoot;
+        pindex->nTime = header.nTime;
+        pindex->nBits = header.nBits;
+        vIndex.push_back(pindex);
+        pprev = pindex;
+    }
+    BOOST_CHECK(db.WriteBatchSync({}, 0, vIndex));
+
+    // First load hashes every header and writes the checkpoint at the tip
+    CBlockHashCheckpoint checkpoint;
+    BOOST_CHECK(!db.ReadBlockHashCheckpoint(checkpoint));
+    LoadedIndex loaded;
+    BOOST_CHECK(loaded.Load(db, false));
+    BOOST_CHECK_EQUAL(loaded.map.size(), vIndex.size() + 1); // + pprev of the first block
+    BOOST_CHECK(db.ReadBlockHashCheckpoint(checkpoint));
+    BOOST_CHECK_EQUAL(checkpoint.nHeight, 1009);
+    BOOST_CHECK(checkpoint.hashBlock == vIndex.back()->GetBlockHash());
+    BOOST_CHECK_EQUAL(checkpoint.nDataPos, 900U);
+
+    // Second load trusts the stored hashes and gives the same index
+    BOOST_CHECK(loaded.Load(db, false));
+    for (const CBlockIndex* pindex : vIndex) {
+        auto it = loaded.map.find(pindex->GetBlockHash());
+        BOOST_REQUIRE(it != loaded.map.end());
+        BOOST_CHECK_EQUAL(it->second->nHeight, pindex->nHeight);
+        BOOST_CHECK(it->second->GetBlockHeader().GetHash() == pindex->GetBlockHash());
+    }
+
+    // An entry written since the last load is hashed, even below the checkpoint
+    CBlockIndex* pindexSide = chain.Insert(InsecureRand256());
+    pindexSide->nHeight = vIndex[4]->nHeight;
+    pindexSide->nVersion = vIndex[4]->nVersion;
+    pindexSide->hashMerkleRoot = vIndex[4]->hashMerkleRoot;
+    pindexSide->nTime = vIndex[4]->nTime;
+    pindexSide->nBits = vIndex[4]->nBits;
+    BOOST_CHECK(db.WriteBatchSync({}, 0, {pindexSide}));
+    BOOST_CHECK(!loaded.Load(db, false));
+    BOOST_CHECK(db.Erase(std::make_pair('b', pindexSide->GetBlockHash())));
+    BOOST_CHECK(loaded.Load(db, false));
+
+    // An entry stored under the wrong key below the checkpoint is only caught by full verification
+    CDiskBlockIndex bad(vIndex[4]);
+    bad.nNonce = 1;
+    BOOST_CHECK(db.Write(std::make_pair('b', InsecureRand256()), bad));
+    BOOST_CHECK(loaded.Load(db, false));
+    BOOST_CHECK(!loaded.Load(db, true));
+
+    // A checkpoint that no longer matches its block falls back to hashing everything
+    checkpoint.nDataPos = 1;
+    BOOST_CHECK(db.WriteBlockHashCheckpoint(checkpoint));
+    BOOST_CHECK(!loaded.Load(db, false));
+}
+
+BOOST_AUTO_TEST_CASE(batched_load)
+{
+    CBlockTreeDB db(1 << 24, true);
+
+    // More entries than a batch, enough for the parallel decoding
+    const size_t nEntries = BLOCK_INDEX_LOAD_BATCH_SIZE + MIN_BLOCK_INDEX_LOAD_PARALLEL + 1;
+    LoadedIndex chain;
+    std::vector<const CBlockIndex*> vIndex;
+    CBlockIndex* pprev = nullptr;
+    for (size_t i = 0; i < nEntries; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = pprev ? pprev->GetBlockHash() : InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1600000000 + i;
+        header.nBits = 0x1e0ffff0 - (i % 16);
+        CBlockIndex* pindex = chain.Insert(header.GetHash());
+        pindex->pprev = pprev;
+        pindex->nHeight = 1000 + i;
+        pindex->nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_TRANSACTIONS;
+        pindex->nDataPos = 100 * i;
+        pindex->nVersion = header.nVersion;
+        pindex->hashMerkleRoot = header.hashMerkleRoot;
+        pindex->nTime = header.nTime;
+        pindex->nBits = header.nBits;
+        vIndex.push_back(pindex);
+        pprev = pindex;
+    }
+    BOOST_CHECK(db.WriteBatchSync({}, 0, vIndex));
+
+    // Entries are linked whatever batch they were decoded in, and carry their own proof
+    LoadedIndex loaded;
+    for (bool fVerifyAllHashes : {true, false}) {
+        BOOST_CHECK(loaded.Load(db, fVerifyAllHashes));
+        BOOST_CHECK_EQUAL(loaded.map.size(), nEntries + 1);
+        for (const CBlockIndex* pindex : vIndex) {
+            auto it = loaded.map.find(pindex->GetBlockHash());
+            BOOST_REQUIRE(it != loaded.map.end());
+            const CBlockIndex* pindexLoaded = it->second.get();
+            BOOST_CHECK_EQUAL(pindexLoaded->nHeight, pindex->nHeight);
+            BOOST_CHECK_EQUAL(pindexLoaded->nDataPos, pindex->nDataPos);
+            if (pindex->pprev) BOOST_CHECK(pindexLoaded->pprev == loaded.map.at(pindex->pprev->GetBlockHash()).get());
+            BOOST_CHECK(pindexLoaded->nChainWork == GetBlockProof(*pindex));
+        }
+    }
+
+    // A bad entry anywhere fails the load
+    CDiskBlockIndex bad(vIndex[nEntries / 2]);
+    bad.nNonce = 1;
+    BOOST_CHECK(db.Write(std::make_pair('b', InsecureRand256()), bad));
+    BOOST_CHECK(!loaded.Load(db, true));
+}
+
+BOOST_AUTO_TEST_CASE(block_index_layout)
+{
+    const size_t nCheckpointsUsage = AccumulatorCheckpointsDynamicUsage();
+    CBlockIndexArena arena;
+
+    // Zerocoin-era header: the accumulator checkpoint lives in the side table
+    CBlockHeader header;
+    header.nVersion = 5;
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0ffff0;
+    header.nAccumulatorCheckpoint = InsecureRand256();
+    CBlockIndex* pindex = arena.New(header);
+    BOOST_CHECK(pindex->GetAccumulatorCheckpoint() == header.nAccumulatorCheckpoint);
+    BOOST_CHECK(pindex->GetBlockHeader().GetHash() == header.GetHash());
+    BOOST_CHECK(AccumulatorCheckpointsDynamicUsage() > nCheckpointsUsage);
+
+    // Inline stake modifier and accumulator checkpoint survive the disk format
+    pindex->SetStakeModifier(InsecureRand256());
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(pindex);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.vStakeModifier == pindex->vStakeModifier);
+    BOOST_CHECK_EQUAL(diskindex.vStakeModifier.size(), 32U);
+    BOOST_CHECK(diskindex.nAccumulatorCheckpoint == header.nAccumulatorCheckpoint);
+    BOOST_CHECK(diskindex.GetBlockHash() == header.GetHash());
+
+    // Post-zerocoin entries have no checkpoint, whatever the header carries
+    header.nVersion = 8;
+    CBlockIndex* pindexSapling = arena.New(header);
+    BOOST_CHECK(pindexSapling->GetAccumulatorCheckpoint().IsNull());
+    BOOST_CHECK(!pindexSapling->GetChainSaplingValue());
+    pindexSapling->SetChainSaplingValue(-5);
+    BOOST_CHECK(*pindexSapling->GetChainSaplingValue() == -5);
+    pindexSapling->SetChainSaplingValue(nullopt);
+    BOOST_CHECK(!pindexSapling->GetChainSaplingValue());
+
+    // Entries keep their address while the arena grows past a chunk
+    std::vector<CBlockIndex*> vEntries;
+    for (int i = 0; i < 5000; i++) {
+        vEntries.push_back(arena.New());
+        vEntries.back()->nHeight = i;
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), 5002U);
+    for (int i = 0; i < 5000; i++) {
+        BOOST_CHECK_EQUAL(vEntries[i]->nHeight, i);
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(AccumulatorCheckpointsDynamicUsage(), nCheckpointsUsage);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
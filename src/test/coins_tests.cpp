@@ -7,6 +7,7 @@
 
 #include "coins.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -14,6 +15,7 @@
 
 #include "sapling/incrementalmerkletree.h"
 
+#include <future>
 #include <vector>
 #include <map>
 
@@ -1320,4 +1322,60 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+BOOST_AUTO_TEST_CASE(coins_db_background_flush)
+{
+    // Small batches: the coins are written in several steps
+    gArgs.ForceSetArg("-dbbatchsize", "4096");
+    CCoinsViewDB db(1 << 20, true);
+    db.StartFlushThread();
+
+    std::vector<COutPoint> vOutpoints;
+    for (int nBlock = 0; nBlock < 3; nBlock++) {
+        CCoinsViewCache cache(&db);
+        // Spend the coins of the previous block, add new ones
+        for (const COutPoint& outpoint : vOutpoints) {
+            cache.SpendCoin(outpoint);
+        }
+        vOutpoints.clear();
+        for (int i = 0; i < 1000; i++) {
+            Coin coin;
+            coin.out.nValue = InsecureRand32();
+            coin.out.scriptPubKey.assign(InsecureRandBits(6), 0);
+            coin.nHeight = nBlock;
+            vOutpoints.emplace_back(InsecureRand256(), i);
+            cache.AddCoin(vOutpoints.back(), std::move(coin), false);
+        }
+        const uint256 hashBlock = InsecureRand256();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+
+        // Whether or not the write is done, the db shows the flushed state
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+        BOOST_CHECK(db.GetHeadBlocks().empty());
+        for (const COutPoint& outpoint : vOutpoints) {
+            Coin coin;
+            BOOST_CHECK(db.GetCoin(outpoint, coin));
+            BOOST_CHECK_EQUAL(coin.nHeight, (uint32_t)nBlock);
+        }
+
+        std::promise<bool> called;
+        db.AfterFlush([&called, &vOutpoints](CCoinsViewDB& coinsdb) {
+            called.set_value(coinsdb.HaveCoin(vOutpoints[0]));
+        });
+        BOOST_CHECK(db.WaitForFlush());
+        // The callback runs on the flush thread once the waiters are released
+        BOOST_CHECK(called.get_future().get());
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    }
+
+    // Only the last block coins are left
+    size_t nCoins = 0;
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) nCoins++;
+    BOOST_CHECK_EQUAL(nCoins, vOutpoints.size());
+    BOOST_CHECK(!db.FlushFailed());
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "crypto/siphash.h"
 #include "hash.h"
+#include "primitives/block.h"
 #include "utilstrencodings.h"
 #include "test/test_maria.h"
 
@@ -145,4 +146,31 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockheader_gethashes)
+{
+    // Batched nonce hashing must match GetHash() for every nonce, both for
+    // Quark (version < 4) and SHA256d headers of each serialized size.
+    FastRandomContext ctx;
+    for (int32_t nVersion : {1, 3, 4, 7, 8, CBlockHeader::CURRENT_VERSION}) {
+        CBlockHeader header;
+        header.nVersion = nVersion;
+        header.hashPrevBlock = GetRandHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = ctx.rand32();
+        header.nBits = 0x1e0ffff0;
+        header.nNonce = 0xfffffff0; // exercise wrap-around
+        header.nAccumulatorCheckpoint = GetRandHash();
+        header.hashFinalSaplingRoot = GetRandHash();
+
+        std::vector<uint256> vHashes;
+        header.GetHashes(32, vHashes);
+        BOOST_CHECK_EQUAL(vHashes.size(), 32U);
+        const uint32_t nStart = header.nNonce;
+        for (uint32_t i = 0; i < vHashes.size(); i++) {
+            header.nNonce = nStart + i;
+            BOOST_CHECK_EQUAL(vHashes[i], header.GetHash());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
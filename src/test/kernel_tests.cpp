@@ -0,0 +1,61 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_maria.h"
+
+#include "kernel.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search)
+{
+    // Parent block with a v2 stake modifier and an easy target, so that many kernels meet it
+    CBlockIndex indexFrom;
+    indexFrom.nHeight = 900;
+    indexFrom.nTime = 1600000000;
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 1000;
+    indexPrev.nTime = 1600100000;
+    indexPrev.SetStakeModifier(InsecureRand256());
+    const unsigned int nBits = 0x1d3fffff;
+
+    std::vector<CMariaStake> vInputs;
+    for (int i = 0; i < 200; i++) {
+        CTxOut out((1 + InsecureRandRange(50)) * COIN, CScript());
+        vInputs.emplace_back(out, COutPoint(InsecureRand256(), i), &indexFrom);
+    }
+
+    CStakeKernelSearch search;
+    search.Reset(&indexPrev, nBits);
+    for (CMariaStake& input : vInputs) search.Add(&input);
+    BOOST_CHECK_EQUAL(search.Size(), vInputs.size());
+
+    for (int nTime = indexPrev.nTime + 15; nTime < (int) indexPrev.nTime + 15 * 20; nTime += 15) {
+        std::vector<size_t> vExpected;
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            CStakeKernel kernel(&indexPrev, &vInputs[i], nBits, nTime);
+            // Precomputed prefix hashes the same message as the whole kernel
+            CDataStream ss(SER_GETHASH, 0);
+            ss << indexPrev.GetStakeModifierV2() << (int) indexFrom.nTime << vInputs[i].GetUniqueness() << nTime;
+            BOOST_CHECK(kernel.GetHash() == Hash(ss.begin(), ss.end()));
+            if (kernel.CheckKernelHash(true)) vExpected.push_back(i);
+        }
+        BOOST_CHECK(search.Search(nTime, 1) == vExpected);
+        BOOST_CHECK(search.Search(nTime, 4) == vExpected);
+        BOOST_CHECK(search.Search(nTime, 1000) == vExpected);
+    }
+
+    // Erasing a kernel shifts the following ones
+    const int nTime = indexPrev.nTime + 15;
+    std::vector<size_t> vFound = search.Search(nTime);
+    BOOST_REQUIRE(!vFound.empty());
+    search.Erase(0);
+    for (size_t& i : vFound) i--;
+    if (vFound.front() == (size_t) -1) vFound.erase(vFound.begin());
+    BOOST_CHECK(search.Search(nTime) == vFound);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -19,10 +19,12 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include "blockassembler.h"
 #include "sapling/incrementalmerkletree.h"
 #include "sapling/sapling_util.h"
 
 #include "json_test_vectors.h"
+#include "test/util/saplingtree.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -173,4 +175,43 @@ BOOST_AUTO_TEST_CASE(EmptyrootSapling) {
     BOOST_CHECK(SaplingMerkleTree::empty_root() == expected);
 }
 
+static uint256 FullRoot(SaplingMerkleTree tree, const std::vector<CTransactionRef>& vtx)
+{
+    for (const CTransactionRef& tx : vtx) {
+        for (const OutputDescription& odesc : tx->sapData->vShieldedOutput) tree.append(odesc.cmu);
+    }
+    return tree.root();
+}
+
+BOOST_AUTO_TEST_CASE(frontier_incremental)
+{
+    AnchorView view;
+    view.tree.append(GetRandHash());
+    CSaplingTreeFrontier frontier;
+
+    std::vector<CTransactionRef> vtx{MakeTransactionRef(CMutableTransaction()), ShieldedTx(g_insecure_rand_ctx, 2), ShieldedTx(g_insecure_rand_ctx, 3), ShieldedTx(g_insecure_rand_ctx, 1)};
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 6U);
+
+    // Same transactions: nothing to append
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 0U);
+
+    // Only the outputs from the first transaction that differs are appended
+    vtx[3] = ShieldedTx(g_insecure_rand_ctx, 4);
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 4U);
+    vtx.insert(vtx.begin() + 2, ShieldedTx(g_insecure_rand_ctx, 1));
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 8U);
+    vtx.pop_back();
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 0U);
+
+    // A new anchor starts over
+    view.tree.append(GetRandHash());
+    BOOST_CHECK(frontier.GetRoot(view, vtx) == FullRoot(view.tree, vtx));
+    BOOST_CHECK_EQUAL(frontier.GetLastAppended(), 6U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
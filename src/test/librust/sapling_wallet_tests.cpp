@@ -174,6 +174,79 @@ BOOST_AUTO_TEST_CASE(FindMySaplingNotes)
     BOOST_CHECK_EQUAL(2, noteMap.size());
 }
 
+BOOST_AUTO_TEST_CASE(SaplingTrialDecryptBatch)
+{
+    auto consensusParams = Params().GetConsensus();
+
+    auto sk = GetTestMasterSaplingSpendingKey();
+    auto sk2 = sk.Derive(1);
+    auto extfvk = sk.ToXFVK();
+    auto testNote = GetTestSaplingNote(sk.DefaultAddress(), 50000000);
+
+    // Two shielded txes (output + change each) and a transparent one
+    std::vector<CTransactionRef> vtx;
+    for (const auto& pa : {sk.DefaultAddress(), sk2.DefaultAddress()}) {
+        auto builder = TransactionBuilder(consensusParams);
+        builder.AddSaplingSpend(sk.expsk, testNote.note, testNote.tree.root(), testNote.tree.witness());
+        builder.AddSaplingOutput(extfvk.fvk.ovk, pa, 25000000, {});
+        builder.SetFee(10000000);
+        vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+    }
+    vtx.emplace_back(MakeTransactionRef(CMutableTransaction()));
+
+    // Enough decoys to go parallel, with the matching keys in the middle
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    for (int i = 0; i < 20; i++) ivks.emplace_back(InsecureRand256());
+    ivks.emplace_back(sk2.expsk.full_viewing_key().in_viewing_key());
+    ivks.emplace_back(sk.expsk.full_viewing_key().in_viewing_key());
+    for (int i = 0; i < 20; i++) ivks.emplace_back(InsecureRand256());
+
+    const SaplingDecryptedNotesMap serial = SaplingTrialDecrypt(vtx, ivks, 1);
+    BOOST_CHECK_EQUAL(serial.size(), 2U);
+    BOOST_CHECK(!serial.count(vtx[2]->GetHash()));
+    for (size_t i = 0; i < 2; i++) {
+        const auto& tx = vtx[i];
+        auto it = serial.find(tx->GetHash());
+        BOOST_REQUIRE(it != serial.end());
+        BOOST_CHECK_EQUAL(it->second.size(), tx->sapData->vShieldedOutput.size());
+        // Same notes, from the same keys, as the one-by-one decryption
+        for (const SaplingDecryptedNote& decrypted : it->second) {
+            const OutputDescription& output = tx->sapData->vShieldedOutput[decrypted.nOutput];
+            for (const auto& ivk : ivks) {
+                auto note = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
+                if (!note) continue;
+                BOOST_CHECK(ivk == decrypted.ivk);
+                BOOST_CHECK_EQUAL(note->value(), decrypted.note.value());
+                break;
+            }
+        }
+    }
+
+    const SaplingDecryptedNotesMap parallel = SaplingTrialDecrypt(vtx, ivks, MAX_SAPLING_DECRYPT_THREADS);
+    BOOST_CHECK_EQUAL(parallel.size(), serial.size());
+    for (const auto& it : serial) {
+        const auto& notes = parallel.at(it.first);
+        BOOST_REQUIRE_EQUAL(notes.size(), it.second.size());
+        for (size_t i = 0; i < notes.size(); i++) {
+            BOOST_CHECK_EQUAL(notes[i].nOutput, it.second[i].nOutput);
+            BOOST_CHECK(notes[i].ivk == it.second[i].ivk);
+        }
+    }
+
+    // Notes precomputed for a block are used by FindMySaplingNotes, unless the wallet got new keys since
+    CWallet& wallet = m_wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.SetupSPKM(false);
+    SaplingScriptPubKeyMan* sspkm = wallet.GetSaplingScriptPubKeyMan();
+    sspkm->PrecomputeSaplingNotes(vtx);
+    BOOST_CHECK_EQUAL(sspkm->FindMySaplingNotes(*vtx[0]).first.size(), 0U);
+    BOOST_CHECK(wallet.AddSaplingZKey(sk));
+    BOOST_CHECK_EQUAL(sspkm->FindMySaplingNotes(*vtx[0]).first.size(), 2U);
+    sspkm->PrecomputeSaplingNotes(vtx);
+    BOOST_CHECK_EQUAL(sspkm->FindMySaplingNotes(*vtx[1]).first.size(), 1U);
+    sspkm->ClearPrecomputedSaplingNotes();
+}
+
 // Generate note A and spend to create note B, from which we spend to create two conflicting transactions
 BOOST_AUTO_TEST_CASE(GetConflictedSaplingNotes)
 {
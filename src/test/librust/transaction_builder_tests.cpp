@@ -99,6 +99,22 @@ BOOST_AUTO_TEST_CASE(SaplingToSapling)
     BOOST_CHECK_EQUAL(tx2.sapData->valueBalance, 10000000);
     BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx2, state, Params(), 3, true, false));
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // --- Block-level proofs verification of both txes
+    SaplingProofChecks checks;
+    checks.Add(MakeTransactionRef(tx));
+    checks.Add(MakeTransactionRef(tx2));
+    BOOST_CHECK_EQUAL(checks.size(), 2);
+    BOOST_CHECK(checks.Verify(state, 100));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // --- A tampered binding signature makes the checks fail, reporting the culprit
+    CMutableTransaction mtx(tx2);
+    mtx.sapData->bindingSig[0] ^= 1;
+    checks.Add(MakeTransactionRef(mtx));
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(CTransaction(mtx), state, Params(), 3, true, false, false /* fCheckProofs */));
+    BOOST_CHECK(!checks.Verify(state, 100));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-binding-signature-invalid");
 }
 
 BOOST_AUTO_TEST_CASE(ThrowsOnTransparentInputWithoutKeyStore)
@@ -579,4 +579,146 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+// The transactions of the chunks of pool, in mining order
+static std::vector<std::vector<uint256>> GetChunkTxs(CTxMemPool& pool)
+{
+    LOCK(pool.cs);
+    std::vector<std::vector<uint256>> vChunks;
+    for (const CTxMemPool::TxChunk* chunk : pool.GetChunksByFeeRate()) {
+        vChunks.emplace_back();
+        for (const CTxMemPool::txiter& it : *chunk) {
+            vChunks.back().emplace_back(it->GetTx().GetHash());
+        }
+    }
+    return vChunks;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterLinearizationTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // Low fee parent, paid for by its child, with a free grandchild,
+    // and an unrelated transaction (all of the same size)
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_1;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    const uint256 hashParent = txParent.GetHash();
+    CMutableTransaction txChild = txParent;
+    txChild.vin[0].prevout = COutPoint(hashParent, 0);
+    CMutableTransaction txGrandChild = txParent;
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    CMutableTransaction txOther = txParent;
+    txOther.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    const uint256 hashOther = txOther.GetHash();
+    const uint256 hashChild = txChild.GetHash();
+    const uint256 hashGrandChild = txGrandChild.GetHash();
+
+    pool.addUnchecked(hashParent, entry.Fee(1000LL).FromTx(txParent));
+    pool.addUnchecked(hashOther, entry.Fee(5000LL).FromTx(txOther));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashOther}, {hashParent}}));
+
+    pool.addUnchecked(hashChild, entry.Fee(20000LL).FromTx(txChild));
+    pool.addUnchecked(hashGrandChild, entry.Fee(0LL).FromTx(txGrandChild));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashParent, hashChild}, {hashOther}, {hashGrandChild}}));
+
+    // A fee delta re-linearizes the cluster
+    pool.PrioritiseTransaction(hashGrandChild, 100000LL);
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashParent, hashChild, hashGrandChild}, {hashOther}}));
+
+    // ... as does a removal, which may leave a cluster of lower feerate
+    pool.removeRecursive(CTransaction(txChild));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashOther}, {hashParent}}));
+
+    // Eviction starts from the last chunk
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(pool.exists(hashOther));
+    BOOST_CHECK(!pool.exists(hashParent));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashOther}}));
+
+    // Free parent with two children: the one paying the most is linearized
+    // first, the other one pays enough to join their chunk
+    CMutableTransaction txFree = txOther;
+    txFree.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    txFree.vout.resize(2, txFree.vout[0]);
+    const uint256 hashFree = txFree.GetHash();
+    CMutableTransaction txChild1 = txParent;
+    txChild1.vin[0].prevout = COutPoint(hashFree, 0);
+    CMutableTransaction txChild2 = txParent;
+    txChild2.vin[0].prevout = COutPoint(hashFree, 1);
+    const uint256 hashChild1 = txChild1.GetHash();
+    const uint256 hashChild2 = txChild2.GetHash();
+    pool.addUnchecked(hashFree, entry.Fee(0LL).FromTx(txFree));
+    pool.addUnchecked(hashChild1, entry.Fee(5000LL).FromTx(txChild1));
+    pool.addUnchecked(hashChild2, entry.Fee(8000LL).FromTx(txChild2));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashOther}, {hashFree, hashChild2, hashChild1}}));
+
+    // Eviction takes the last transaction off the cluster linearization, and
+    // chunks again the rest of its chunk
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(hashChild1));
+    BOOST_CHECK(GetChunkTxs(pool) == std::vector<std::vector<uint256>>({{hashOther}, {hashFree, hashChild2}}));
+
+    // Spending both clusters merges them
+    CMutableTransaction txJoin = txParent;
+    txJoin.vin.resize(2);
+    txJoin.vin[0].prevout = COutPoint(hashOther, 0);
+    txJoin.vin[1].prevout = COutPoint(hashChild2, 0);
+    const CTxMemPoolEntry entryJoin = entry.Fee(1000LL).FromTx(txJoin);
+    LOCK(pool.cs);
+    CTxMemPool::setEntries setAncestors;
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string errString;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryJoin, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3U);
+    BOOST_CHECK(pool.CalculateClusterSize(setAncestors, 4, errString));
+    BOOST_CHECK(!pool.CalculateClusterSize(setAncestors, 3, errString));
+    BOOST_CHECK(pool.CalculateClusterSize(CTxMemPool::setEntries(), 1, errString));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMemoryUsageTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    const size_t nEmptyUsage = pool.DynamicMemoryUsage();
+
+    // A parent with more children than its links hold in place
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_1;
+    txParent.vout.resize(4);
+    for (int i = 0; i < 4; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        txParent.vout[i].nValue = COIN;
+    }
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000LL).FromTx(txParent));
+    size_t nEntriesUsage = entry.FromTx(txParent).DynamicMemoryUsage();
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction txChild;
+        txChild.vin.resize(1);
+        txChild.vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild.vout.resize(1);
+        txChild.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        txChild.vout[0].nValue = COIN;
+        pool.addUnchecked(txChild.GetHash(), entry.Fee(10000LL).FromTx(txChild));
+        nEntriesUsage += entry.FromTx(txChild).DynamicMemoryUsage();
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 5U);
+    BOOST_CHECK(pool.DynamicMemoryUsage() >= nEmptyUsage + nEntriesUsage + 5 * sizeof(CTxMemPoolEntry));
+
+    // Everything is given back, links included
+    pool.removeRecursive(CTransaction(txParent));
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nEmptyUsage);
+
+    // Shielded descriptions are part of the transaction usage
+    CMutableTransaction txShielded = txParent;
+    const size_t nTransparentUsage = entry.FromTx(txShielded).DynamicMemoryUsage();
+    txShielded.sapData->vShieldedOutput.resize(2);
+    BOOST_CHECK(entry.FromTx(txShielded).DynamicMemoryUsage() >= nTransparentUsage + 2 * sizeof(OutputDescription));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -161,6 +161,24 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).FromTx(tx));
     pblocktemplate = BlockAssembler(chainparams, DEFAULT_PRINTPRIORITY).CreateNewBlock(scriptPubKey);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // The transactions assembled ahead of time for the staker make the same block
+    CBlockIndex* pindexTip = WITH_LOCK(cs_main, return chainActive.Tip());
+    std::unique_ptr<CBlockTemplateTxs> ptemplateTxs = BlockAssembler(chainparams, DEFAULT_PRINTPRIORITY).CreateTemplateTxs(pindexTip);
+    BOOST_CHECK(ptemplateTxs);
+    BOOST_CHECK(ptemplateTxs->IsValidFor(pindexTip, {}));
+    BOOST_CHECK(!ptemplateTxs->IsValidFor(pindexTip->pprev, {}));
+    std::unique_ptr<CBlockTemplate> pblocktemplate2 = BlockAssembler(chainparams, DEFAULT_PRINTPRIORITY).CreateNewBlock(scriptPubKey,
+            nullptr, false, nullptr, false, true, nullptr, true, true, ptemplateTxs.get());
+    BOOST_CHECK(pblocktemplate2->fFromTemplateTxs);
+    BOOST_CHECK(!pblocktemplate->fFromTemplateTxs);
+    BOOST_CHECK_EQUAL(pblocktemplate2->block.vtx.size(), pblocktemplate->block.vtx.size());
+    for (size_t i = 0; i < pblocktemplate->block.vtx.size(); ++i) {
+        BOOST_CHECK(*pblocktemplate2->block.vtx[i] == *pblocktemplate->block.vtx[i]);
+    }
+    BOOST_CHECK(pblocktemplate2->vTxFees == pblocktemplate->vTxFees);
+    BOOST_CHECK(pblocktemplate2->vTxSigOps == pblocktemplate->vTxSigOps);
+    BOOST_CHECK(pblocktemplate2->block.hashFinalSaplingRoot == pblocktemplate->block.hashFinalSaplingRoot);
 }
 
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
@@ -314,4 +314,44 @@ BOOST_FIXTURE_TEST_CASE(mnwinner_test, TestChain100Setup)
     BOOST_CHECK_MESSAGE(stateInternal.IsValid(), stateInternal.GetRejectReason());
 }
 
+BOOST_FIXTURE_TEST_CASE(mnwinner_last_paid_index, BasicTestingSetup)
+{
+    masternodePayments.Clear();
+    const CScript payeeA = CScript() << OP_TRUE;
+    const CScript payeeB = CScript() << OP_FALSE;
+    auto addVotes = [](const CScript& payee, int nHeight, int nVotes) {
+        for (int i = 0; i < nVotes; i++) {
+            CMasternodePaymentWinner winner(CTxIn(COutPoint(InsecureRand256(), 0)), nHeight);
+            winner.AddPayee(payee);
+            masternodePayments.AddWinningMasternode(winner);
+        }
+    };
+
+    // a single vote does not count as paid
+    addVotes(payeeA, 100, 1);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 200), -1);
+    addVotes(payeeA, 100, 1);
+    addVotes(payeeA, 150, 2);
+    addVotes(payeeB, 120, 3);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 200), 150);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 149), 100);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 101, 149), -1);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeB, 1, 200), 120);
+
+    // the index survives a serialization round trip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << masternodePayments;
+    masternodePayments.Clear();
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 200), -1);
+    ss >> masternodePayments;
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 200), 150);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeB, 1, 200), 120);
+
+    // pruned blocks leave the index
+    masternodePayments.CleanPaymentList(0, 1140);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeA, 1, 200), 150);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastPaidHeight(payeeB, 1, 200), -1);
+    masternodePayments.Clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
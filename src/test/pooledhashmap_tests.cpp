@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_maria.h"
+
+#include "pooledhashmap.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pooledhashmap_tests, BasicTestingSetup)
+
+// Hashes only the low bits, so that the keys collide in the table
+struct ModHasher
+{
+    size_t operator()(uint64_t n) const { return n % 64; }
+};
+
+typedef PooledHashMap<uint64_t, std::string, ModHasher> TestMap;
+
+BOOST_AUTO_TEST_CASE(insert_find_erase)
+{
+    TestMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK(map.begin() == map.end());
+
+    // Enough entries to grow the table and the pool a few times
+    std::vector<const std::string*> vValues;
+    for (uint64_t i = 0; i < 1000; i++) {
+        auto ret = map.emplace(i, std::to_string(i));
+        BOOST_CHECK(ret.second);
+        vValues.push_back(&ret.first->second);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK(!map.emplace(0, "x").second);
+    BOOST_CHECK_EQUAL(map[0], "0");
+
+    // References to the entries survive the rehashes
+    for (uint64_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(&map.find(i)->second == vValues[i]);
+        BOOST_CHECK_EQUAL(*vValues[i], std::to_string(i));
+    }
+    size_t nIterated = 0;
+    for (const auto& entry : map) {
+        BOOST_CHECK_EQUAL(entry.second, std::to_string(entry.first));
+        nIterated++;
+    }
+    BOOST_CHECK_EQUAL(nIterated, map.size());
+
+    // Erase every other entry while iterating, as BatchWrite does
+    for (auto it = map.begin(); it != map.end();) {
+        it = (it->first % 2) ? std::next(it) : map.erase(it);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 500U);
+    for (uint64_t i = 0; i < 1000; i++) {
+        BOOST_CHECK_EQUAL(map.count(i), (size_t)(i % 2));
+        if (i % 2) BOOST_CHECK_EQUAL(*vValues[i], std::to_string(i));
+    }
+
+    // Erased nodes are reused before the pool grows
+    const size_t nUsage = map.DynamicMemoryUsage();
+    for (uint64_t i = 0; i < 1000; i += 2) {
+        map[i] = std::to_string(i);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), nUsage);
+    BOOST_CHECK_EQUAL(map.erase(2), 1U);
+    BOOST_CHECK_EQUAL(map.erase(2), 0U);
+
+    TestMap moved(std::move(map));
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(moved.size(), 999U);
+    BOOST_CHECK_EQUAL(moved[1], "1");
+
+    moved.clear();
+    BOOST_CHECK(moved.empty());
+    BOOST_CHECK_EQUAL(moved.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
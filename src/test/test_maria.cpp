@@ -10,6 +10,7 @@
 #include "blockassembler.h"
 #include "consensus/merkle.h"
 #include "bls/bls_wrapper.h"
+#include "crypto/sha256.h"
 #include "guiinterface.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
@@ -67,6 +68,7 @@ std::ostream& operator<<(std::ostream& os, const uint256& num)
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     : m_path_root{fs::temp_directory_path() / "test_maria" / std::to_string(g_insecure_rand_ctx_temp_path.rand32())}
 {
+    SHA256AutoDetect();
     ECC_Start();
     BLSInit();
     SetupEnvironment();
@@ -9,6 +9,7 @@
 #include "pubkey.h"
 #include "random.h"
 #include "script/standard.h"
+#include "txprecheck.h"
 #include "utiltime.h"
 #include "validation.h"
 
@@ -86,4 +87,45 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_precheck_then_mempool, TestChain100Setup)
+{
+    // The pre-check threads only fill the caches: AcceptToMemoryPool
+    // still rejects a transaction that failed its pre-check.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    // Same signature, other output value
+    CMutableTransaction badSpend = spend;
+    badSpend.vout[0].nValue = 12*CENT;
+
+    std::atomic<int> nNotified{0};
+    StartTxPreCheckThreads(2, [&nNotified] { nNotified++; });
+    std::shared_ptr<CTxPreCheck> pcheckBad = QueueTxPreCheck(MakeTransactionRef(badSpend));
+    std::shared_ptr<CTxPreCheck> pcheck = QueueTxPreCheck(MakeTransactionRef(spend));
+    BOOST_REQUIRE(pcheck && pcheckBad);
+    while (!pcheck->fDone || !pcheckBad->fDone) MilliSleep(10);
+    StopTxPreCheckThreads();
+    BOOST_CHECK_EQUAL(nNotified, 2);
+    BOOST_CHECK(GetTxAdmissionStats().nPreChecked >= 2);
+    // No thread left
+    BOOST_CHECK(!QueueTxPreCheck(MakeTransactionRef(spend)));
+
+    BOOST_CHECK(!ToMemPool(badSpend));
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK_EQUAL(mempool.size(), 1);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
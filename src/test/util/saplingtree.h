@@ -0,0 +1,43 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_TEST_UTIL_SAPLINGTREE_H
+#define MARIA_TEST_UTIL_SAPLINGTREE_H
+
+// Header only: shared by the unit tests and the benchmarks, which don't link the test suite
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "sapling/incrementalmerkletree.h"
+
+// View whose best anchor is tree
+class AnchorView : public CCoinsView
+{
+public:
+    SaplingMerkleTree tree;
+
+    uint256 GetBestAnchor() const override { return tree.root(); }
+    bool GetSaplingAnchorAt(const uint256& rt, SaplingMerkleTree& treeOut) const override
+    {
+        if (rt != tree.root()) return false;
+        treeOut = tree;
+        return true;
+    }
+};
+
+// Sapling transaction with nOutputs random note commitments
+inline CTransactionRef ShieldedTx(FastRandomContext& rng, int nOutputs)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = CTransaction::TxVersion::SAPLING;
+    for (int i = 0; i < nOutputs; i++) {
+        OutputDescription odesc;
+        odesc.cmu = rng.rand256();
+        mtx.sapData->vShieldedOutput.push_back(odesc);
+    }
+    return MakeTransactionRef(mtx);
+}
+
+#endif // MARIA_TEST_UTIL_SAPLINGTREE_H
@@ -6,6 +6,8 @@
 #include "blockassembler.h"
 #include "primitives/transaction.h"
 #include "sapling/sapling_validation.h"
+#include "script/standard.h"
+#include "stakeinput.h"
 #include "test/librust/utiltest.h"
 #include "util/blockstatecatcher.h"
 #include "wallet/test/wallet_test_fixture.h"
@@ -159,4 +161,218 @@ BOOST_FIXTURE_TEST_CASE(zerocoin_rejection_tests, WalletRegTestingSetup)
     CheckMempoolZcRejection(mtx, "bad-txns-zc-public-spend");
 }
 
+static CMutableTransaction SpendCoinbase(const CTransaction& coinbase, const CKey& key, const CScript& scriptPubKey)
+{
+    const CScript& scriptCoinbase = coinbase.vout[0].scriptPubKey;
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(coinbase.GetHash(), 0));
+    spend.vout.emplace_back(coinbase.vout[0].nValue - 1 * CENT, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptCoinbase, spend, 0, SIGHASH_ALL, coinbase.vout[0].nValue, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+/*
+ * Cold-stake checks on a pruned node: the stake inputs must be found without reading
+ * the (pruned) blocks of their transactions, from the coins cache or, for a fork
+ * block, the undo data of the blocks above the fork point.
+ */
+BOOST_FIXTURE_TEST_CASE(pruned_node_cold_stake_inputs, TestChain100Setup)
+{
+    // keep mining PoW blocks past the pruning keep depth
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_POS, 600);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V3_4, 601);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Cap the first block file, so that the next blocks go to a new one, which is kept
+    const int nOldTipHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
+    WITH_LOCK(cs_main, GetBlockFileInfo(chainActive.Tip()->GetBlockPos().nFile)->nSize = MAX_BLOCKFILE_SIZE; );
+    for (int i = 0; i < (int)GetPruneKeepDepth() + 10; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+    // Spend the second coinbase in the last block
+    CreateAndProcessBlock({SpendCoinbase(coinbaseTxns[1], coinbaseKey, scriptPubKey)}, scriptPubKey);
+
+    // Prune the first file
+    fPruneMode = true;
+    PruneBlockFilesManual(nOldTipHeight);
+
+    LOCK(cs_main);
+    BOOST_CHECK(fHavePruned);
+    BOOST_CHECK(!(chainActive[1]->nStatus & BLOCK_HAVE_DATA));
+    BOOST_CHECK(!(chainActive[nOldTipHeight]->nStatus & BLOCK_HAVE_DATA));
+    BOOST_CHECK(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA);
+    const int nHeight = chainActive.Height() + 1;
+
+    // Unspent input created in a pruned block: from the coins cache
+    const COutPoint prevoutUnspent(coinbaseTxns[0].GetHash(), 0);
+    std::unique_ptr<CMariaStake> stake(CMariaStake::NewMariaStake(CTxIn(prevoutUnspent), nHeight, chainActive.Tip()->nTime, chainActive.Tip()));
+    BOOST_CHECK(stake && stake->GetIndexFrom() == chainActive[1]);
+
+    // Input spent in the last block, whose transaction is pruned: from the undo data,
+    // for a block forking below the spend only
+    const COutPoint prevoutSpent(coinbaseTxns[1].GetHash(), 0);
+    BOOST_CHECK(pcoinsTip->AccessCoin(prevoutSpent).IsSpent());
+    Coin coin;
+    BOOST_CHECK(!GetCoinSpentAfterFork(prevoutSpent, chainActive.Tip(), coin));
+    BOOST_CHECK(GetCoinSpentAfterFork(prevoutSpent, chainActive.Tip()->pprev, coin));
+    BOOST_CHECK_EQUAL(coin.nHeight, 2);
+    BOOST_CHECK(coin.out == coinbaseTxns[1].vout[0]);
+    stake.reset(CMariaStake::NewMariaStake(CTxIn(prevoutSpent), nHeight - 1, chainActive.Tip()->nTime, chainActive.Tip()->pprev));
+    BOOST_CHECK(stake && stake->GetIndexFrom() == chainActive[2]);
+    stake.reset(CMariaStake::NewMariaStake(CTxIn(prevoutSpent), nHeight, chainActive.Tip()->nTime, chainActive.Tip()));
+    BOOST_CHECK(!stake);
+
+    // Unknown output
+    BOOST_CHECK(!GetCoinSpentAfterFork(COutPoint(GetRandHash(), 0), chainActive.Tip()->pprev, coin));
+
+    // Cold-stake coinstake with a free last output, while the tier two sync is incomplete:
+    // the value of the pruned input is needed to check that the free output takes nothing.
+    CKey stakerKey, ownerKey;
+    stakerKey.MakeNewKey(true);
+    ownerKey.MakeNewKey(true);
+    const CScript scriptP2CS = GetScriptForStakeDelegationLOF(stakerKey.GetPubKey().GetID(), ownerKey.GetPubKey().GetID());
+    const CAmount nFree = GetMasternodePayment(nHeight) + 1;
+    CMutableTransaction coinstake;
+    coinstake.vin.emplace_back(prevoutUnspent);
+    coinstake.vout.emplace_back();
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout.emplace_back(coinbaseTxns[0].vout[0].nValue + GetBlockValue(nHeight), scriptP2CS);
+    coinstake.vout.emplace_back(nFree, scriptPubKey);
+    BOOST_CHECK(CTransaction(coinstake).IsCoinStake());
+    BOOST_CHECK(CheckColdStakeFreeOutput(CTransaction(coinstake), chainActive.Tip()));
+    // taking value from the stake is still rejected
+    coinstake.vout[1].nValue -= nFree;
+    BOOST_CHECK(!CheckColdStakeFreeOutput(CTransaction(coinstake), chainActive.Tip()));
+
+    fPruneMode = false;
+    fHavePruned = false;
+}
+
+// Headers, with no block, of a chain on top of prev
+static std::vector<CBlockHeader> HeadersOnTop(const CBlockHeader& prev, int nCount)
+{
+    std::vector<CBlockHeader> headers;
+    for (int i = 0; i < nCount; i++) {
+        CBlockHeader header;
+        header.nVersion = CBlockHeader::CURRENT_VERSION;
+        header.hashPrevBlock = headers.empty() ? prev.GetHash() : headers.back().GetHash();
+        header.nTime = prev.nTime + (i + 1) * Params().GetConsensus().nTargetSpacing;
+        header.nBits = prev.nBits;
+        headers.push_back(header);
+    }
+    return headers;
+}
+
+static void CheckBlockRejection(const CBlock& block, const std::string& expected_msg)
+{
+    BlockStateCatcher stateCatcher(block.GetHash());
+    stateCatcher.registerEvent();
+    ProcessNewBlock(std::make_shared<const CBlock>(block), nullptr);
+    BOOST_CHECK(stateCatcher.found && !stateCatcher.state.IsValid());
+    if (!expected_msg.empty()) BOOST_CHECK_EQUAL(stateCatcher.state.GetRejectReason(), expected_msg);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) != block.GetHash());
+}
+
+/*
+ * -assumevalid: the scripts and Sapling proofs of the ancestors of the assumed valid block are not
+ * verified once it is buried deep enough in the best headers chain. The blocks above it are.
+ */
+BOOST_FIXTURE_TEST_CASE(assumevalid_skipped_checks, TestChain100Setup)
+{
+    initZKSNARKS();
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    const libzcash::SaplingExtendedSpendingKey sk = GetTestMasterSaplingSpendingKey();
+
+    // Shielding tx whose binding signature (not covered by the transparent one) is invalid
+    auto ShieldWithBadProof = [&](const CTransaction& coinbase) {
+        const CTxOut& out = coinbase.vout[0];
+        CMutableTransaction mtx(*GetValidSaplingReceive(consensus, keystore, {{COutPoint(coinbase.GetHash(), 0), out.scriptPubKey, out.nValue}},
+                                                        {{sk, out.nValue}}).tx);
+        mtx.sapData->bindingSig[0] ^= 1;
+        return mtx;
+    };
+
+    // Block A spends a coinbase with a wrong key, block B on top of it has the bad proof
+    CBlock blockA = CreateBlock({SpendCoinbase(coinbaseTxns[0], otherKey, scriptPubKey)}, scriptPubKey);
+    CBlockIndex* pindexA = nullptr;
+    CValidationState state;
+    BOOST_CHECK(WITH_LOCK(cs_main, return AcceptBlockHeader(blockA, state, &pindexA); ));
+    CBlock blockB = CreateBlock({ShieldWithBadProof(coinbaseTxns[1])}, scriptPubKey, true, false, true, pindexA);
+
+    // B is the assumed valid block, with two weeks worth of headers on top of it
+    fCheckBlockIndex = false;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindex = nullptr;
+        BOOST_CHECK(AcceptBlockHeader(blockB, state, &pindex));
+        hashAssumeValid = blockB.GetHash();
+        for (const CBlockHeader& header : HeadersOnTop(blockB, ASSUMEVALID_MIN_BURIED_TIME / consensus.nTargetSpacing + 1)) {
+            BOOST_CHECK(AcceptBlockHeader(header, state, &pindex));
+        }
+        BOOST_CHECK(pindexBestHeader == pindex);
+    }
+    fCheckBlockIndex = true;
+
+    ProcessNewBlock(std::make_shared<const CBlock>(blockA), nullptr);
+    ProcessNewBlock(std::make_shared<const CBlock>(blockB), nullptr);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == blockB.GetHash());
+
+    // Above it, both are checked
+    CheckBlockRejection(CreateBlock({SpendCoinbase(coinbaseTxns[2], otherKey, scriptPubKey)}, scriptPubKey), "");
+    CheckBlockRejection(CreateBlock({ShieldWithBadProof(coinbaseTxns[2])}, scriptPubKey), "bad-txns-sapling-binding-signature-invalid");
+
+    hashAssumeValid.SetNull();
+}
+
+/*
+ * The headers leading to the assumed valid block are stored ahead of their blocks, without
+ * counting against the limit of PoS headers a peer can have stored before their blocks arrive.
+ */
+BOOST_FIXTURE_TEST_CASE(assumevalid_headers_path, TestChain100Setup)
+{
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_POS, 101);
+    const CBlockHeader tip = WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHeader(); );
+    const int nTipHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
+    const int nPathLength = MAX_UNCONNECTED_POS_HEADERS + 100;
+    std::vector<CBlockHeader> headers = HeadersOnTop(tip, nPathLength + MAX_UNCONNECTED_POS_HEADERS + 10);
+    hashAssumeValid = headers[nPathLength - 1].GetHash();
+    nAssumeValidHeight = nTipHeight + nPathLength;
+
+    fCheckBlockIndex = false;
+    std::vector<const CBlockIndex*> vPoSHeaders;
+    CValidationState state;
+    const CBlockIndex* pindexLast = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, &pindexLast, &vPoSHeaders));
+    BOOST_CHECK(WITH_LOCK(cs_main, return LookupBlockIndex(hashAssumeValid) != nullptr; ));
+    // only the headers past it count, up to the limit
+    BOOST_CHECK_EQUAL(vPoSHeaders.size(), MAX_UNCONNECTED_POS_HEADERS);
+    BOOST_CHECK(pindexLast && pindexLast->GetBlockHash() == headers[nPathLength + MAX_UNCONNECTED_POS_HEADERS - 1].GetHash());
+
+    // Once it is known, another branch counts against the limit from its first header
+    std::vector<CBlockHeader> fork = HeadersOnTop(headers[9], 2);
+    fork[0].nTime++;
+    fork[1].hashPrevBlock = fork[0].GetHash();
+    std::vector<const CBlockIndex*> vOtherPoSHeaders;
+    BOOST_CHECK(ProcessNewBlockHeaders(fork, state, &pindexLast, &vOtherPoSHeaders));
+    BOOST_CHECK_EQUAL(vOtherPoSHeaders.size(), 2U);
+    // while the first peer, at its limit, cannot extend it
+    const std::vector<CBlockHeader> next = HeadersOnTop(fork[1], 1);
+    BOOST_CHECK(ProcessNewBlockHeaders(next, state, nullptr, &vPoSHeaders));
+    BOOST_CHECK(WITH_LOCK(cs_main, return LookupBlockIndex(next[0].GetHash()) == nullptr; ));
+    fCheckBlockIndex = true;
+
+    hashAssumeValid.SetNull();
+    nAssumeValidHeight = 0;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
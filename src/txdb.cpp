@@ -12,6 +12,9 @@
 #include "util/system.h"
 #include "util/vector.h"
 
+#include <atomic>
+#include <future>
+#include <set>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -27,6 +30,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_HASH_CHECKPOINT = 'h';
+static const char DB_BLOCK_INDEX_UNVERIFIED = 'u';
 // static const char DB_MONEY_SUPPLY = 'M';
 
 namespace {
@@ -47,18 +52,50 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    if (threadFlush.joinable()) {
+        // The pending write, if any, is completed first
+        WITH_LOCK(cs_flush, fStopFlushThread = true; );
+        cvFlush.notify_all();
+        threadFlush.join();
+    }
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
+    {
+        LOCK(cs_flush);
+        if (pflushing) {
+            CCoinsMap::const_iterator it = pflushing->mapCoins.find(outpoint);
+            if (it != pflushing->mapCoins.end()) {
+                if (it->second.coin.IsSpent()) return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint& outpoint) const
 {
+    {
+        LOCK(cs_flush);
+        if (pflushing) {
+            CCoinsMap::const_iterator it = pflushing->mapCoins.find(outpoint);
+            if (it != pflushing->mapCoins.end()) return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
+    {
+        LOCK(cs_flush);
+        if (pflushing) return pflushing->hashBlock;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return UINT256_ZERO;
@@ -66,6 +103,8 @@ uint256 CCoinsViewDB::GetBestBlock() const
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    // Seen through the pending write, the db is consistent with its best block
+    if (WITH_LOCK(cs_flush, return pflushing != nullptr)) return std::vector<uint256>();
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -73,28 +112,64 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
+uint256 CCoinsViewDB::GetOldTip(const uint256& hashBlock) const
+{
+    uint256 old_tip = GetBestBlock();
+    if (old_tip.IsNull()) {
+        // We may be in the middle of replaying.
+        std::vector<uint256> old_heads = GetHeadBlocks();
+        if (old_heads.size() == 2) {
+            assert(old_heads[0] == hashBlock);
+            old_tip = old_heads[1];
+        }
+    }
+    return old_tip;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
                               const uint256& hashBlock,
                               const uint256& hashSaplingAnchor,
                               CAnchorsSaplingMap& mapSaplingAnchors,
                               CNullifiersMap& mapSaplingNullifiers)
+{
+    assert(!hashBlock.IsNull());
+    if (!threadFlush.joinable()) {
+        return WriteCoins(mapCoins, hashBlock, GetOldTip(hashBlock), hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers);
+    }
+
+    // One background write at a time
+    if (!WaitForFlush()) return false;
+    const uint256 old_tip = GetOldTip(hashBlock);
+
+    // Mark the database as being in the middle of a transition from old_tip to hashBlock
+    // before anything else (e.g. the evo db) is committed at hashBlock.
+    CDBBatch batch;
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
+    if (!db.WriteBatch(batch)) return false;
+
+    // Taking over the maps is all the caller waits for
+    std::unique_ptr<PendingFlush> pending = std::make_unique<PendingFlush>(mapCoins, mapSaplingAnchors, mapSaplingNullifiers);
+    pending->hashBlock = hashBlock;
+    pending->old_tip = old_tip;
+    pending->hashSaplingAnchor = hashSaplingAnchor;
+    WITH_LOCK(cs_flush, pflushing = std::move(pending); );
+    cvFlush.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap& mapCoins,
+                              const uint256& hashBlock,
+                              const uint256& old_tip,
+                              const uint256& hashSaplingAnchor,
+                              CAnchorsSaplingMap& mapSaplingAnchors,
+                              CNullifiersMap& mapSaplingNullifiers)
 {
     CDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
     size_t batch_size = (size_t) gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
-    assert(!hashBlock.IsNull());
-
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
-        // We may be in the middle of replaying.
-        std::vector<uint256> old_heads = GetHeadBlocks();
-        if (old_heads.size() == 2) {
-            assert(old_heads[0] == hashBlock);
-            old_tip = old_heads[1];
-        }
-    }
 
     // In the first batch, mark the database as being in the middle of a
     // transition from old_tip to hashBlock.
@@ -103,6 +178,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
+    // The entries of a background write stay readable until their batch is written
+    CCoinsMap::iterator itWritten = mapCoins.begin();
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
@@ -113,12 +190,15 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        it++;
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
             batch.Clear();
+            {
+                LOCK(cs_flush);
+                while (itWritten != it) itWritten = mapCoins.erase(itWritten);
+            }
             if (crash_simulate) {
                 static FastRandomContext rng;
                 if (rng.randrange(crash_simulate) == 0) {
@@ -138,10 +218,85 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
+    WITH_LOCK(cs_flush, mapCoins.clear(); );
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
+void CCoinsViewDB::ThreadFlush()
+{
+    while (true) {
+        PendingFlush* pending;
+        {
+            WAIT_LOCK(cs_flush, lock);
+            while ((!pflushing || fFlushFailed) && !fStopFlushThread) cvFlush.wait(lock);
+            if (!pflushing || fFlushFailed) return;
+            pending = pflushing.get();
+        }
+
+        const int64_t nTimeStart = GetTimeMicros();
+        const size_t nEntries = pending->mapCoins.size();
+        // The sapling maps are small and erased while written: keep them readable until the end
+        CAnchorsSaplingMap mapSaplingAnchors = pending->mapSaplingAnchors;
+        CNullifiersMap mapSaplingNullifiers = pending->mapSaplingNullifiers;
+        bool fOk = false;
+        try {
+            fOk = WriteCoins(pending->mapCoins, pending->hashBlock, pending->old_tip, pending->hashSaplingAnchor,
+                             mapSaplingAnchors, mapSaplingNullifiers);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!fOk) {
+            // Keep the pending entries readable: the node is shutting down on the error
+            LogPrintf("%s: failed to write to coin database\n", __func__);
+            WITH_LOCK(cs_flush, fFlushFailed = true; );
+            cvFlush.notify_all();
+            continue;
+        }
+        LogPrint(BCLog::COINDB, "Flushed %u coin cache entries at %s in the background in %.2fms\n", nEntries,
+                 pending->hashBlock.ToString(), (GetTimeMicros() - nTimeStart) * 0.001);
+
+        std::vector<std::function<void(CCoinsViewDB&)>> vCallbacks;
+        {
+            LOCK(cs_flush);
+            vCallbacks.swap(pflushing->vCallbacks);
+            pflushing.reset();
+        }
+        cvFlush.notify_all();
+        for (const auto& fn : vCallbacks) fn(*this);
+    }
+}
+
+void CCoinsViewDB::StartFlushThread()
+{
+    assert(!threadFlush.joinable());
+    threadFlush = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewDB::ThreadFlush, this)));
+}
+
+bool CCoinsViewDB::WaitForFlush() const
+{
+    WAIT_LOCK(cs_flush, lock);
+    while (pflushing && !fFlushFailed) cvFlush.wait(lock);
+    return !fFlushFailed;
+}
+
+bool CCoinsViewDB::FlushFailed() const
+{
+    return WITH_LOCK(cs_flush, return fFlushFailed);
+}
+
+void CCoinsViewDB::AfterFlush(std::function<void(CCoinsViewDB&)> fn)
+{
+    {
+        LOCK(cs_flush);
+        if (pflushing) {
+            pflushing->vCallbacks.push_back(std::move(fn));
+            return;
+        }
+    }
+    fn(*this);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -153,7 +308,10 @@ CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWra
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
-    return Write(std::make_pair(DB_BLOCK_INDEX, blockindex.GetBlockHash()), blockindex);
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_INDEX, blockindex.GetBlockHash()), blockindex);
+    batch.Write(std::make_pair(DB_BLOCK_INDEX_UNVERIFIED, blockindex.GetBlockHash()), '1');
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo& info)
@@ -182,6 +340,8 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The AfterFlush callbacks run on the flush thread, once its write is done
+    if (std::this_thread::get_id() != threadFlush.get_id()) WaitForFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -243,6 +403,8 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        // Not covered by the block hash checkpoint until the next load hashes it
+        batch.Write(std::make_pair(DB_BLOCK_INDEX_UNVERIFIED, (*it)->GetBlockHash()), '1');
     }
     return WriteBatch(batch, true);
 }
@@ -284,58 +446,226 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::ReadBlockHashCheckpoint(CBlockHashCheckpoint& checkpoint)
+{
+    return Read(DB_BLOCK_HASH_CHECKPOINT, checkpoint);
+}
+
+bool CBlockTreeDB::WriteBlockHashCheckpoint(const CBlockHashCheckpoint& checkpoint)
+{
+    return Write(DB_BLOCK_HASH_CHECKPOINT, checkpoint);
+}
+
+namespace {
+
+//! A block index record read from the db, decoded and checked off the cursor thread
+struct BlockIndexRecord
+{
+    uint256 hashKey;
+    CDataStream ssValue{SER_DISK, CLIENT_VERSION};
+    CDiskBlockIndex diskindex;
+    //! Header hash, or hashKey if the entry is covered by the hash checkpoint
+    uint256 hashBlock;
+    arith_uint256 nProof;
+    bool fTrusted{false};
+    std::string strError;
+};
+
+//! Run fn(i) for each i in [0, n) on up to nThreads threads, the calling one included
+template <typename Fn>
+void ParallelFor(size_t n, int nThreads, const Fn& fn)
+{
+    if (n < MIN_BLOCK_INDEX_LOAD_PARALLEL) nThreads = 1;
+    // A few chunks per thread keeps the threads busy until the end of the batch
+    const size_t nChunk = std::max<size_t>(1, n / (nThreads * 4));
+    std::atomic<size_t> nNextChunk{0};
+
+    auto worker = [&]() {
+        for (size_t nBegin = nNextChunk.fetch_add(nChunk); nBegin < n; nBegin = nNextChunk.fetch_add(nChunk)) {
+            const size_t nEnd = std::min(n, nBegin + nChunk);
+            for (size_t i = nBegin; i < nEnd; i++) fn(i);
+        }
+    };
+
+    std::vector<std::future<void>> vWorkers;
+    for (int i = 1; i < nThreads; i++) {
+        vWorkers.emplace_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto& w : vWorkers) w.get();
+}
+
+} // anonymous namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fVerifyAllHashes)
 {
+    const Consensus::Params& consensus = Params().GetConsensus();
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+
+    CBlockHashCheckpoint checkpoint;
+    if (fVerifyAllHashes || !ReadBlockHashCheckpoint(checkpoint)) {
+        checkpoint = CBlockHashCheckpoint();
+    }
+    // Entries written since the last load, whatever their height
+    std::set<uint256> setUnverified;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX_UNVERIFIED, UINT256_ZERO));
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX_UNVERIFIED) break;
+        setUnverified.insert(key.second);
+        pcursor->Next();
+    }
+    // Entries keyed by their stored hash, verified at the end if the checkpoint turns out to be stale
+    std::vector<CBlockIndex*> vTrusted;
+    const CBlockIndex* pindexCheckpoint = nullptr;
+    const CBlockIndex* pindexNextCheckpoint = nullptr;
+    std::atomic<size_t> nHashed{0};
+    size_t nLoaded = 0;
+    int64_t nTimeRead = 0, nTimeCheck = 0, nTimeInsert = 0;
+
+    // Decode, hash and check a record: only touches the record itself
+    auto checkRecord = [&](BlockIndexRecord& rec) {
+        rec.strError.clear();
+        rec.diskindex = CDiskBlockIndex();
+        try {
+            rec.ssValue >> rec.diskindex;
+        } catch (const std::exception& e) {
+            rec.strError = strprintf("failed to read value of block index entry %s", rec.hashKey.ToString());
+            return;
+        }
+        rec.fTrusted = rec.diskindex.nHeight <= checkpoint.nHeight && !setUnverified.count(rec.hashKey);
+        rec.hashBlock = rec.fTrusted ? rec.hashKey : rec.diskindex.GetBlockHash();
+        rec.nProof = GetBlockProof(rec.diskindex);
+        if (rec.fTrusted) return;
+
+        nHashed++;
+        if (rec.hashBlock != rec.hashKey) {
+            rec.strError = strprintf("block index entry %s has header hash %s", rec.hashKey.ToString(), rec.hashBlock.ToString());
+        } else if (!consensus.NetworkUpgradeActive(rec.diskindex.nHeight, Consensus::UPGRADE_POS) &&
+                   !CheckProofOfWork(rec.hashBlock, rec.diskindex.nBits)) {
+            rec.strError = strprintf("CheckProofOfWork failed: block %s at height %d", rec.hashBlock.ToString(), rec.diskindex.nHeight);
+        }
+    };
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, UINT256_ZERO));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    // Load mapBlockIndex, a batch at a time: the cursor and the insertions are serial,
+    // decoding, hashing and proof of work checks are spread over the threads.
+    std::vector<BlockIndexRecord> vBatch(BLOCK_INDEX_LOAD_BATCH_SIZE);
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                // sapling
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-
-                //Proof Of Stake
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->vStakeModifier = diskindex.vStakeModifier;
-
-                if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_POS)) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("%s : CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                }
+        int64_t nTimeStart = GetTimeMicros();
+        size_t nRecords = 0;
+        while (nRecords < vBatch.size()) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fDone = true;
+                break;
+            }
+            BlockIndexRecord& rec = vBatch[nRecords++];
+            rec.hashKey = key.second;
+            rec.ssValue = pcursor->GetValue();
+            pcursor->Next();
+        }
+        int64_t nTimeRecords = GetTimeMicros();
+        nTimeRead += nTimeRecords - nTimeStart;
+
+        ParallelFor(nRecords, nThreads, [&](size_t i) { checkRecord(vBatch[i]); });
+        int64_t nTimeChecked = GetTimeMicros();
+        nTimeCheck += nTimeChecked - nTimeRecords;
+
+        for (size_t i = 0; i < nRecords; i++) {
+            const BlockIndexRecord& rec = vBatch[i];
+            if (!rec.strError.empty())
+                return error("%s : %s", __func__, rec.strError);
+            const CDiskBlockIndex& diskindex = rec.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(rec.hashBlock);
+            pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+            pindexNew->nChainWork = rec.nProof;
+
+            // sapling
+            pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+            pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
+
+            //zerocoin
+            pindexNew->SetAccumulatorCheckpoint(diskindex.nAccumulatorCheckpoint);
+
+            //Proof Of Stake
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->vStakeModifier = diskindex.vStakeModifier;
+
+            if (rec.fTrusted) {
+                vTrusted.push_back(pindexNew);
+                if (checkpoint.Matches(pindexNew)) pindexCheckpoint = pindexNew;
+            }
+            if ((pindexNew->nStatus & BLOCK_HAVE_DATA) &&
+                    (!pindexNextCheckpoint || pindexNew->nHeight > pindexNextCheckpoint->nHeight)) {
+                pindexNextCheckpoint = pindexNew;
+            }
+        }
+        nLoaded += nRecords;
+        nTimeInsert += GetTimeMicros() - nTimeChecked;
+    }
 
-                pcursor->Next();
-            } else {
-                return error("%s : failed to read value", __func__);
+    if (!checkpoint.IsNull() && !pindexCheckpoint) {
+        // The checkpoint block is gone or moved: fall back to hashing everything it covered.
+        LogPrintf("%s: block hash checkpoint at height %d not found, verifying %u headers\n", __func__, checkpoint.nHeight, vTrusted.size());
+        boost::this_thread::interruption_point();
+        int64_t nTimeStart = GetTimeMicros();
+        std::vector<std::string> vErrors(vTrusted.size());
+        ParallelFor(vTrusted.size(), nThreads, [&](size_t i) {
+            const CBlockIndex* pindex = vTrusted[i];
+            const uint256 hashBlock = pindex->GetBlockHeader().GetHash();
+            if (hashBlock != pindex->GetBlockHash()) {
+                vErrors[i] = strprintf("block index entry %s has header hash %s", pindex->GetBlockHash().ToString(), hashBlock.ToString());
+            } else if (!consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_POS) &&
+                       !CheckProofOfWork(pindex->GetBlockHash(), pindex->nBits)) {
+                vErrors[i] = strprintf("CheckProofOfWork failed: %s", pindex->ToString());
             }
-        } else {
-            break;
+        });
+        for (const std::string& strError : vErrors) {
+            if (!strError.empty()) return error("%s : %s", __func__, strError);
         }
+        nHashed += vTrusted.size();
+        nTimeCheck += GetTimeMicros() - nTimeStart;
+    }
+    LogPrintf("%s: %u headers hashed (%u written since the last load), %u loaded from the block hash checkpoint\n", __func__,
+              nHashed.load(), setUnverified.size(), pindexCheckpoint ? vTrusted.size() : 0);
+    LogPrintf("%s: %u entries read in %.2fms, decoded and checked in %.2fms (%d threads), inserted in %.2fms\n", __func__,
+              nLoaded, nTimeRead * 0.001, nTimeCheck * 0.001, nThreads, nTimeInsert * 0.001);
+
+    // Every loaded header is verified now: move the checkpoint forward and
+    // clear the unverified marks, in one batch
+    CDBBatch batch;
+    for (const uint256& hash : setUnverified) {
+        batch.Erase(std::make_pair(DB_BLOCK_INDEX_UNVERIFIED, hash));
+    }
+    const bool fMoveCheckpoint = pindexNextCheckpoint && (!pindexCheckpoint || pindexNextCheckpoint->nHeight > checkpoint.nHeight);
+    if (fMoveCheckpoint) {
+        CBlockHashCheckpoint next;
+        next.nHeight = pindexNextCheckpoint->nHeight;
+        next.hashBlock = pindexNextCheckpoint->GetBlockHash();
+        next.nFile = pindexNextCheckpoint->nFile;
+        next.nDataPos = pindexNextCheckpoint->nDataPos;
+        batch.Write(DB_BLOCK_HASH_CHECKPOINT, next);
     }
+    if ((fMoveCheckpoint || !setUnverified.empty()) && !WriteBatch(batch, true))
+        return error("%s : failed to write block hash checkpoint", __func__);
 
     return true;
 }
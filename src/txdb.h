@@ -12,9 +12,14 @@
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "sync.h"
 
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,6 +32,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 300;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -39,6 +46,12 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max number of threads decoding and checking block index entries at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Block index entries read from the db before being decoded and checked together
+static const size_t BLOCK_INDEX_LOAD_BATCH_SIZE = 16384;
+//! Smaller batches are decoded and checked on the calling thread only
+static const size_t MIN_BLOCK_INDEX_LOAD_PARALLEL = 1024;
 
 struct CDiskTxPos : public FlatFilePos
 {
@@ -66,31 +79,112 @@ struct CDiskTxPos : public FlatFilePos
     }
 };
 
+/**
+ * Marks how far the block index entries have had their header hash checked
+ * against their database key. Entries at or below nHeight are loaded without
+ * re-hashing the header (Quark headers are expensive), unless they have been
+ * written since the last load: those are marked unverified in the db until
+ * they are hashed. The checkpoint is only trusted if the block it names is
+ * loaded back at the same height and disk position.
+ */
+struct CBlockHashCheckpoint
+{
+    int nHeight{-1};
+    uint256 hashBlock;
+    int nFile{0};
+    unsigned int nDataPos{0};
+
+    SERIALIZE_METHODS(CBlockHashCheckpoint, obj)
+    {
+        READWRITE(VARINT_MODE(obj.nHeight, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(obj.hashBlock);
+        READWRITE(VARINT_MODE(obj.nFile, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(obj.nDataPos));
+    }
+
+    bool IsNull() const { return nHeight < 0; }
+    bool Matches(const CBlockIndex* pindex) const
+    {
+        return pindex && pindex->nHeight == nHeight && pindex->GetBlockHash() == hashBlock &&
+               pindex->nFile == nFile && pindex->nDataPos == nDataPos;
+    }
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
 
+private:
+    //! A BatchWrite handed over to the flush thread
+    struct PendingFlush
+    {
+        //! Takes the maps over (the salted hashers make them non-swappable)
+        PendingFlush(CCoinsMap& mapCoinsIn, CAnchorsSaplingMap& mapSaplingAnchorsIn, CNullifiersMap& mapSaplingNullifiersIn) :
+            mapCoins(std::move(mapCoinsIn)),
+            mapSaplingAnchors(std::move(mapSaplingAnchorsIn)),
+            mapSaplingNullifiers(std::move(mapSaplingNullifiersIn)) {}
+
+        CCoinsMap mapCoins;
+        uint256 hashBlock;
+        uint256 old_tip;
+        uint256 hashSaplingAnchor;
+        CAnchorsSaplingMap mapSaplingAnchors;
+        CNullifiersMap mapSaplingNullifiers;
+        std::vector<std::function<void(CCoinsViewDB&)>> vCallbacks;
+    };
+
+    mutable Mutex cs_flush;
+    mutable std::condition_variable cvFlush;
+    //! Being written by the flush thread: the reads look it up before the db
+    std::unique_ptr<PendingFlush> pflushing GUARDED_BY(cs_flush);
+    bool fFlushFailed GUARDED_BY(cs_flush){false};
+    bool fStopFlushThread GUARDED_BY(cs_flush){false};
+    std::thread threadFlush;
+
+    //! The db best block (or the one it is moving from) before writing hashBlock
+    uint256 GetOldTip(const uint256& hashBlock) const;
+    //! Write the dirty entries to the db, erasing the coins from mapCoins once they are written
+    bool WriteCoins(CCoinsMap& mapCoins, const uint256& hashBlock, const uint256& old_tip, const uint256& hashSaplingAnchor,
+                    CAnchorsSaplingMap& mapSaplingAnchors, CNullifiersMap& mapSaplingNullifiers);
+    void ThreadFlush();
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
     bool HaveCoin(const COutPoint& outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
+    //! Waits for the background write in progress: the cursor reads the db only
     CCoinsViewCursor* Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 
+    /** With the flush thread running, the entries are handed over to it and written
+     * in the background, in batches of -dbbatchsize. The db is marked as moving to
+     * hashBlock (DB_HEAD_BLOCKS) before this returns: a crash in the middle of the
+     * write is recovered by ReplayBlocks, as for a synchronous one.
+     * Waits for the previous background write, if any. */
     bool BatchWrite(CCoinsMap& mapCoins,
                     const uint256& hashBlock,
                     const uint256& hashSaplingAnchor,
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
 
+    //! Write the next batches on a dedicated thread (-backgroundflush)
+    void StartFlushThread();
+    //! Wait for the background write in progress. Returns false if a background write failed
+    bool WaitForFlush() const;
+    bool FlushFailed() const;
+    //! Run fn on the flush thread once the pending write is done (right away if there is none).
+    //! WaitForFlush does not wait for it: the next write is not held back by a slow callback.
+    void AfterFlush(std::function<void(CCoinsViewDB&)> fn);
+
     // Sapling, the implementation of the following functions can be found in sapling_txdb.cpp.
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     bool GetNullifier(const uint256 &nf) const override;
@@ -144,7 +238,15 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
-    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool ReadBlockHashCheckpoint(CBlockHashCheckpoint& checkpoint);
+    bool WriteBlockHashCheckpoint(const CBlockHashCheckpoint& checkpoint);
+    /** Load every block index entry. Unless fVerifyAllHashes is set, headers
+     * covered by the block hash checkpoint, and not written since it was, are
+     * keyed by their stored hash instead of being hashed again.
+     * Entries are decoded, hashed and checked on up to MAX_BLOCK_INDEX_LOAD_THREADS
+     * threads, then inserted in db order. nChainWork is set to the proof of the
+     * block alone: the caller accumulates it in height order. */
+    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fVerifyAllHashes = false);
 };
 
 /** Zerocoin database (zerocoin/) */
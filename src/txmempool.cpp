@@ -30,7 +30,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
      spendsCoinbaseOrCoinstake(_spendsCoinbaseOrCoinstake), sigOpCount(_sigOps)
 {
     nTxSize = ::GetSerializeSize(*_tx, PROTOCOL_VERSION);
-    nUsageSize = _tx->DynamicMemoryUsage();
+    nUsageSize = memusage::RecursiveDynamicUsage(tx);
     hasZerocoins = _tx->ContainsZerocoins();
     m_isShielded = _tx->IsShieldedTx();
 
@@ -59,14 +59,14 @@ void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
     setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const LinkedEntries children = GetMemPoolChildren(updateIt);
+    stageEntries.insert(children.begin(), children.end());
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (const txiter& childEntry : setChildren) {
+        for (const txiter& childEntry : GetMemPoolChildren(cit)) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
@@ -168,8 +168,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     } else {
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
-        txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const LinkedEntries parents = GetMemPoolParents(mapTx.iterator_to(entry));
+        parentHashes.insert(parents.begin(), parents.end());
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -192,8 +192,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        for (const txiter& phash : setMemPoolParents) {
+        for (const txiter& phash : GetMemPoolParents(stageit)) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
                 parentHashes.insert(phash);
@@ -208,11 +207,33 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     return true;
 }
 
+bool CTxMemPool::CalculateClusterSize(const setEntries& setAncestors, uint64_t limitClusterCount, std::string& errString) const
+{
+    // The clusters of the ancestors are merged by the new transaction: walk
+    // them, up to the limit
+    setEntries setCluster(setAncestors);
+    std::vector<txiter> vToVisit(setAncestors.begin(), setAncestors.end());
+    while (!vToVisit.empty() && setCluster.size() < limitClusterCount) {
+        const txiter it = vToVisit.back();
+        vToVisit.pop_back();
+        for (const txiter& parent : GetMemPoolParents(it)) {
+            if (setCluster.insert(parent).second) vToVisit.emplace_back(parent);
+        }
+        for (const txiter& child : GetMemPoolChildren(it)) {
+            if (setCluster.insert(child).second) vToVisit.emplace_back(child);
+        }
+    }
+    if (setCluster.size() + 1 > limitClusterCount) {
+        errString = strprintf("too many transactions in the mempool cluster [limit: %u]", limitClusterCount);
+        return false;
+    }
+    return true;
+}
+
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
-    for (const txiter& piter : parentIters) {
+    for (const txiter& piter : GetMemPoolParents(it)) {
         UpdateChild(piter, it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
@@ -239,8 +260,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    for (const txiter& updateIt : setMemPoolChildren) {
+    for (const txiter& updateIt : GetMemPoolChildren(it)) {
         UpdateParent(updateIt, it, false);
     }
 }
@@ -254,7 +274,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not the entry links (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         for (const txiter& removeIt : entriesToRemove) {
@@ -279,16 +299,16 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of
+        // of ancestors reachable via the links will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then the links will
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
+        // and it's important that we use the links' notion of ancestor
         // transactions as the set of things to update for removal.
         CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
         // Note that UpdateAncestorsOf severs the child links that point to
@@ -324,7 +344,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-        nTransactionsUpdated(0)
+        nTransactionsUpdated(0),
+        mapTx(indexed_transaction_set::ctor_args_list(), indexed_transaction_set::allocator_type(&nMapTxUsage))
 {
     _clear();   // lock-free clear
 
@@ -418,7 +439,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // Used by AcceptToMemoryPool(), which DOES do all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    setUnclustered.insert(newit);
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -562,8 +583,9 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    cachedInnerUsage -= memusage::DynamicUsage(it->parents) + memusage::DynamicUsage(it->children);
+    DissolveCluster(it);
+    setUnclustered.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(tx.GetHash());
@@ -589,8 +611,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        for (const txiter& childiter : setChildren) {
+        for (const txiter& childiter : GetMemPoolChildren(it)) {
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
             }
@@ -871,7 +892,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    mapClusters.clear();
+    setChunksByFeeRate.clear();
+    setUnclustered.clear();
     mapTx.clear();
     mapNextTx.clear();
     mapProTxAddresses.clear();
@@ -912,10 +935,10 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += memusage::DynamicUsage(it->parents) + memusage::DynamicUsage(it->children);
+        // Either linearized with its cluster, or waiting to be
+        assert((it->nCluster != 0) != (setUnclustered.count(it) != 0));
+        assert(it->nCluster == 0 || mapClusters.count(it->nCluster));
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -949,7 +972,8 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
                 assert(!pcoins->GetNullifier(sd.nullifier));
             }
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        const LinkedEntries parents = GetMemPoolParents(it);
+        assert(setParentCheck == setEntries(parents.begin(), parents.end()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -982,7 +1006,8 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        const LinkedEntries children = GetMemPoolChildren(it);
+        assert(setChildrenCheck == setEntries(children.begin(), children.end()));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= (uint64_t)(childSizes + it->GetTxSize()));
@@ -1249,6 +1274,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
+            DissolveCluster(it);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1327,12 +1353,14 @@ bool CCoinsViewMemPool::GetNullifier(const uint256& nullifier) const
 size_t CTxMemPool::DynamicMemoryUsage() const
 {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for
-    // boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() +
+    // The nodes and buckets of mapTx are counted by its allocator, the parent
+    // and child links which do not fit in the entries by cachedInnerUsage
+    return nMapTxUsage +
             memusage::DynamicUsage(mapNextTx) +
             memusage::DynamicUsage(mapDeltas) +
-            memusage::DynamicUsage(mapLinks) +
+            // The cluster linearization, counted at its maximum (a chunk per transaction)
+            // whether it is up to date or not
+            (memusage::IncrementalDynamicUsage(setChunksByFeeRate) + sizeof(TxChunk) + sizeof(txiter)) * mapTx.size() +
             cachedInnerUsage +
             memusage::DynamicUsage(mapSaplingNullifiers);
 }
@@ -1373,40 +1401,270 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
+// Adds, or removes, link to links, kept sorted by txid like setEntries
+static void UpdateLinks(CTxMemPoolEntry::Links& links, const CTxMemPoolEntry* link, bool add)
+{
+    auto it = std::lower_bound(links.begin(), links.end(), link, [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    });
+    const bool fLinked = (it != links.end() && *it == link);
+    if (add && !fLinked) {
+        links.insert(it, link);
+    } else if (!add && fLinked) {
+        links.erase(it);
+    }
+}
+
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    // A removed link belongs to a removed transaction, whose removal dissolves
+    // the cluster (unless TrimToSize already took it off the cluster)
+    if (add) {
+        DissolveCluster(entry);
+        DissolveCluster(child);
     }
+    cachedInnerUsage -= memusage::DynamicUsage(entry->children);
+    UpdateLinks(entry->children, &*child, add);
+    cachedInnerUsage += memusage::DynamicUsage(entry->children);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    if (add) {
+        DissolveCluster(entry);
+        DissolveCluster(parent);
     }
+    cachedInnerUsage -= memusage::DynamicUsage(entry->parents);
+    UpdateLinks(entry->parents, &*parent, add);
+    cachedInnerUsage += memusage::DynamicUsage(entry->parents);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+CTxMemPool::LinkedEntries CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return LinkedEntries(mapTx, entry->parents);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+CTxMemPool::LinkedEntries CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return LinkedEntries(mapTx, entry->children);
+}
+
+// Clusters above this size are linearized in ancestor count order, without
+// searching for the best packages
+static const size_t MAX_CLUSTER_LINEARIZATION_TXS = 500;
+
+static bool HigherFeeRate(CAmount nFeesA, uint64_t nSizeA, CAmount nFeesB, uint64_t nSizeB)
+{
+    return (double)nFeesA * nSizeB > (double)nFeesB * nSizeA;
+}
+
+bool CTxMemPool::CompareTxChunkByFeeRate::operator()(const TxChunk* a, const TxChunk* b) const
+{
+    if (HigherFeeRate(a->nModFees, a->nSize, b->nModFees, b->nSize))
+        return true;
+    if (HigherFeeRate(b->nModFees, b->nSize, a->nModFees, a->nSize))
+        return false;
+    if (a->nCluster != b->nCluster)
+        return a->nCluster < b->nCluster;
+    return a->nIndex < b->nIndex;
+}
+
+void CTxMemPool::DissolveCluster(txiter entry)
+{
+    AssertLockHeld(cs);
+    const uint64_t nCluster = entry->nCluster;
+    if (nCluster == 0)
+        return;
+    auto it = mapClusters.find(nCluster);
+    assert(it != mapClusters.end());
+    for (const TxChunk& chunk : it->second.vChunks) {
+        setChunksByFeeRate.erase(&chunk);
+    }
+    for (const txiter& tx : it->second.vTxs) {
+        tx->nCluster = 0;
+        setUnclustered.insert(tx);
+    }
+    mapClusters.erase(it);
+}
+
+void CTxMemPool::LinearizeCluster(std::vector<txiter> vTxs)
+{
+    AssertLockHeld(cs);
+    const size_t n = vTxs.size();
+    std::vector<txiter> vOrder;
+    vOrder.reserve(n);
+
+    if (n > MAX_CLUSTER_LINEARIZATION_TXS) {
+        // A transaction has more ancestors than any of its ancestors
+        std::sort(vTxs.begin(), vTxs.end(), [](const txiter& a, const txiter& b) {
+            if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+                return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+            return CompareIteratorByHash()(a, b);
+        });
+        vOrder = vTxs;
+    } else {
+        // Same selection as the block assembler used to make over the whole
+        // mempool: the package of remaining ancestors with the highest feerate
+        // goes next, then the ancestor state of its descendants is updated.
+        std::map<txiter, size_t, CompareIteratorByHash> mapIndex;
+        for (size_t i = 0; i < n; i++) {
+            mapIndex.emplace(vTxs[i], i);
+        }
+        std::vector<std::vector<size_t>> vAncestors(n);
+        std::vector<std::vector<size_t>> vDescendants(n);
+        std::vector<CAmount> vAncestorFees(n, 0);
+        std::vector<uint64_t> vAncestorSize(n, 0);
+        for (size_t i = 0; i < n; i++) {
+            // vAncestors[i] includes i
+            std::vector<size_t>& vAnc = vAncestors[i];
+            std::set<size_t> setSeen{i};
+            vAnc.emplace_back(i);
+            for (size_t j = 0; j < vAnc.size(); j++) {
+                for (const txiter& parent : GetMemPoolParents(vTxs[vAnc[j]])) {
+                    const size_t p = mapIndex.at(parent);
+                    if (setSeen.insert(p).second) vAnc.emplace_back(p);
+                }
+            }
+            for (size_t a : vAnc) {
+                vAncestorFees[i] += vTxs[a]->GetModifiedFee();
+                vAncestorSize[i] += vTxs[a]->GetTxSize();
+                if (a != i) vDescendants[a].emplace_back(i);
+            }
+        }
+
+        auto cmp = [&](size_t a, size_t b) {
+            if (HigherFeeRate(vAncestorFees[a], vAncestorSize[a], vAncestorFees[b], vAncestorSize[b]))
+                return true;
+            if (HigherFeeRate(vAncestorFees[b], vAncestorSize[b], vAncestorFees[a], vAncestorSize[a]))
+                return false;
+            return a < b;
+        };
+        std::set<size_t, decltype(cmp)> setCandidates(cmp);
+        for (size_t i = 0; i < n; i++) {
+            setCandidates.insert(i);
+        }
+        std::vector<bool> vDone(n, false);
+        while (!setCandidates.empty()) {
+            const size_t best = *setCandidates.begin();
+            std::vector<size_t> vPackage;
+            for (size_t a : vAncestors[best]) {
+                if (!vDone[a]) vPackage.emplace_back(a);
+            }
+            std::sort(vPackage.begin(), vPackage.end(), [&](size_t a, size_t b) {
+                if (vAncestors[a].size() != vAncestors[b].size())
+                    return vAncestors[a].size() < vAncestors[b].size();
+                return a < b;
+            });
+            for (size_t a : vPackage) {
+                setCandidates.erase(a);
+                vDone[a] = true;
+                vOrder.emplace_back(vTxs[a]);
+            }
+            for (size_t a : vPackage) {
+                for (size_t d : vDescendants[a]) {
+                    if (vDone[d]) continue;
+                    setCandidates.erase(d);
+                    vAncestorFees[d] -= vTxs[a]->GetModifiedFee();
+                    vAncestorSize[d] -= vTxs[a]->GetTxSize();
+                    setCandidates.insert(d);
+                }
+            }
+        }
+    }
+
+    const uint64_t nCluster = ++nLastClusterId;
+    TxCluster& cluster = mapClusters[nCluster];
+    cluster.vTxs = std::move(vOrder);
+    cluster.vChunks.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        cluster.vTxs[i]->nCluster = nCluster;
+        AppendToChunks(nCluster, cluster, i);
+    }
+}
+
+void CTxMemPool::AppendToChunks(uint64_t nCluster, TxCluster& cluster, size_t i)
+{
+    AssertLockHeld(cs);
+    // The transaction starts a chunk, merged into the previous chunk while it
+    // has a higher feerate.
+    std::vector<TxChunk>& vChunks = cluster.vChunks;
+    assert(vChunks.size() < vChunks.capacity());
+    const txiter* ptx = cluster.vTxs.data() + i;
+    vChunks.emplace_back();
+    TxChunk& chunk = vChunks.back();
+    chunk.nCluster = nCluster;
+    chunk.nIndex = vChunks.size() - 1;
+    chunk.nModFees = (*ptx)->GetModifiedFee();
+    chunk.nSize = (*ptx)->GetTxSize();
+    chunk.nSigOps = (*ptx)->GetSigOpCount();
+    chunk.pbegin = ptx;
+    chunk.pend = ptx + 1;
+    while (vChunks.size() > 1) {
+        TxChunk& last = vChunks[vChunks.size() - 1];
+        TxChunk& prev = vChunks[vChunks.size() - 2];
+        if (!HigherFeeRate(last.nModFees, last.nSize, prev.nModFees, prev.nSize))
+            break;
+        setChunksByFeeRate.erase(&prev);
+        prev.nModFees += last.nModFees;
+        prev.nSize += last.nSize;
+        prev.nSigOps += last.nSigOps;
+        prev.pend = last.pend;
+        vChunks.pop_back();
+    }
+    setChunksByFeeRate.insert(&vChunks.back());
+}
+
+void CTxMemPool::TrimCluster(const TxChunk* chunk, setEntries& stage)
+{
+    AssertLockHeld(cs);
+    const uint64_t nCluster = chunk->nCluster;
+    auto it = mapClusters.find(nCluster);
+    assert(it != mapClusters.end());
+    TxCluster& cluster = it->second;
+    assert(chunk == &cluster.vChunks.back());
+
+    // The last transaction of the linearization: its descendants come after it
+    const txiter tx = cluster.vTxs.back();
+    tx->nCluster = 0;
+    stage.insert(tx);
+
+    // The chunking of a linearization is built from the front, so the chunks
+    // before the last one stay the same: only the rest of the last chunk is
+    // chunked again (the pointers to vTxs stay valid, it doesn't reallocate).
+    const size_t nBegin = chunk->pbegin - cluster.vTxs.data();
+    setChunksByFeeRate.erase(chunk);
+    cluster.vChunks.pop_back();
+    cluster.vTxs.pop_back();
+    for (size_t i = nBegin; i < cluster.vTxs.size(); i++) {
+        AppendToChunks(nCluster, cluster, i);
+    }
+    if (cluster.vTxs.empty()) {
+        mapClusters.erase(it);
+    }
+}
+
+const CTxMemPool::setChunks& CTxMemPool::GetChunksByFeeRate()
+{
+    AssertLockHeld(cs);
+    while (!setUnclustered.empty()) {
+        // A cluster is dissolved as a whole: the transactions connected to an
+        // unclustered one are all unclustered
+        std::vector<txiter> vTxs{*setUnclustered.begin()};
+        setUnclustered.erase(setUnclustered.begin());
+        for (size_t i = 0; i < vTxs.size(); i++) {
+            const txiter tx = vTxs[i];
+            for (const txiter& parent : GetMemPoolParents(tx)) {
+                if (setUnclustered.erase(parent)) vTxs.emplace_back(parent);
+            }
+            for (const txiter& child : GetMemPoolChildren(tx)) {
+                if (setUnclustered.erase(child)) vTxs.emplace_back(child);
+            }
+        }
+        LinearizeCluster(std::move(vTxs));
+    }
+    return setChunksByFeeRate;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
@@ -1449,19 +1707,26 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        // The lowest feerate chunk is the last one of its cluster: evict the
+        // last transaction of the cluster linearization, which has no
+        // descendant, then look at the chunks of what remains of the cluster,
+        // without linearizing it again.
+        const setChunks& chunks = GetChunksByFeeRate();
+        if (chunks.empty())
+            break;
+        const TxChunk* worst = *chunks.rbegin();
 
-        // We set the new mempool min fee to the feerate of the removed set, plus the
+        // We set the new mempool min fee to the feerate of the removed chunk, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        CFeeRate removed(worst->nModFees, worst->nSize);
         removed += minReasonableRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        TrimCluster(worst, stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
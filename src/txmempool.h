@@ -20,6 +20,8 @@
 #include "sync.h"
 #include "random.h"
 #include "netaddress.h"
+#include "prevector.h"
+#include "support/allocators/counting.h"
 
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
@@ -53,6 +55,10 @@ class CTxMemPool;
  */
 class CTxMemPoolEntry
 {
+public:
+    //! In-mempool direct parents, or children, sorted by txid: mostly one or two
+    typedef prevector<2, const CTxMemPoolEntry*> Links;
+
 private:
     CTransactionRef tx;
     CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
@@ -82,6 +88,14 @@ private:
     CAmount nModFeesWithAncestors;
     unsigned int nSigOpCountWithAncestors;
 
+    // The links of the entry in the mempool, and its linearized cluster (or
+    // 0), kept by CTxMemPool in the mapTx nodes rather than in maps of their own
+    mutable Links parents;
+    mutable Links children;
+    mutable uint64_t nCluster{0};
+
+    friend class CTxMemPool;
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
             int64_t _nTime, unsigned int _entryHeight,
@@ -327,8 +341,9 @@ enum class MemPoolRemovalReason {
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the in-mempool direct parents and direct children of each CTxMemPoolEntry, in
+ * the entry itself.  Within each CTxMemPoolEntry, we also track the size and
+ * fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -360,10 +375,25 @@ enum class MemPoolRemovalReason {
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
+ * Clusters:
+ *
+ * The transactions connected by spending relations (in either direction) form
+ * a cluster. Each cluster is linearized: ordered parents first, picking the
+ * highest ancestor feerate package at each step, then split into chunks of
+ * decreasing feerate (a chunk is merged into the previous one while it pays a
+ * higher feerate, which makes a parent paid by its child a single chunk).
+ * The chunks of all the clusters, by feerate, are the order in which the block
+ * assembler mines the transactions, and the end of that order is where
+ * TrimToSize evicts them. The linearization is a cache: a cluster is dissolved
+ * when a transaction joins, leaves or changes it, and its transactions are
+ * linearized again when the chunks are next needed. The exception is eviction:
+ * the last transaction of a linearization has no descendant in its cluster, so
+ * TrimToSize takes it off, and only chunks again the rest of the last chunk.
+ *
  * Computational limits:
  *
  * Updating all in-mempool ancestors of a newly added transaction can be slow,
@@ -371,6 +401,9 @@ enum class MemPoolRemovalReason {
  * CalculateMemPoolAncestors() takes configurable limits that are designed to
  * prevent these calculations from being too CPU intensive.
  *
+ * Linearizing a cluster is quadratic in its size: CalculateClusterSize() is
+ * used to bound the size of the clusters that transactions join on admission.
+ *
  * Adding transactions from a disconnected block can be very time consuming,
  * because we don't have a way to limit the number of in-mempool descendants.
  * To bound CPU processing, we limit the amount of work we're willing to do
@@ -390,6 +423,7 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    size_t nMapTxUsage{0}; //! heap usage of mapTx, counted by its allocator
 
     CFeeRate minReasonableRelayFee;
 
@@ -438,7 +472,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        counting_allocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     /**
@@ -480,19 +515,86 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    /** The in-mempool direct parents, or children, of an entry, as iterators of mapTx */
+    class LinkedEntries
+    {
+    private:
+        const indexed_transaction_set& txs;
+        const CTxMemPoolEntry::Links& links;
+
+    public:
+        class const_iterator
+        {
+        private:
+            const indexed_transaction_set* ptxs;
+            CTxMemPoolEntry::Links::const_iterator it;
+
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef txiter value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const txiter* pointer;
+            typedef txiter reference;
+
+            const_iterator(const indexed_transaction_set* ptxsIn, CTxMemPoolEntry::Links::const_iterator itIn) : ptxs(ptxsIn), it(itIn) {}
+            txiter operator*() const { return ptxs->iterator_to(**it); }
+            const_iterator& operator++() { ++it; return *this; }
+            bool operator==(const const_iterator& other) const { return it == other.it; }
+            bool operator!=(const const_iterator& other) const { return it != other.it; }
+        };
+
+        LinkedEntries(const indexed_transaction_set& txsIn, const CTxMemPoolEntry::Links& linksIn) : txs(txsIn), links(linksIn) {}
+        const_iterator begin() const { return const_iterator(&txs, links.begin()); }
+        const_iterator end() const { return const_iterator(&txs, links.end()); }
+        size_t size() const { return links.size(); }
+        bool empty() const { return links.empty(); }
+    };
+
+    LinkedEntries GetMemPoolParents(txiter entry) const;
+    LinkedEntries GetMemPoolChildren(txiter entry) const;
+
+    /** A chunk of a cluster linearization: transactions mined, or evicted, together */
+    struct TxChunk {
+        uint64_t nCluster;
+        //! Position of the chunk in the cluster
+        size_t nIndex;
+        CAmount nModFees{0};
+        uint64_t nSize{0};
+        unsigned int nSigOps{0};
+        //! The transactions, in an order that is valid in a block
+        const txiter* pbegin;
+        const txiter* pend;
+
+        const txiter* begin() const { return pbegin; }
+        const txiter* end() const { return pend; }
+    };
+
+    /** Sorts chunks by decreasing feerate, then by position in their cluster */
+    struct CompareTxChunkByFeeRate {
+        bool operator()(const TxChunk* a, const TxChunk* b) const;
+    };
+    typedef std::set<const TxChunk*, CompareTxChunkByFeeRate> setChunks;
+
+    /** The chunks of all the clusters, by decreasing feerate: the order to mine
+     *  them, whose end is the order to evict them. Linearizes the clusters
+     *  changed since the last call. */
+    const setChunks& GetChunksByFeeRate();
 
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    struct TxCluster {
+        //! The linearization
+        std::vector<txiter> vTxs;
+        //! Ranges of vTxs, pointed to by setChunksByFeeRate: its capacity is
+        //! reserved for a chunk per transaction
+        std::vector<TxChunk> vChunks;
     };
-
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    std::map<uint64_t, TxCluster> mapClusters;
+    uint64_t nLastClusterId{0};
+    setChunks setChunksByFeeRate;
+    //! Transactions waiting to be linearized with the rest of their cluster
+    setEntries setUnclustered;
 
     std::multimap<uint256, uint256> mapProTxRefs; // proTxHash -> transaction (all TXs that refer to an existing proTx)
     std::map<CService, uint256> mapProTxAddresses;
@@ -503,6 +605,16 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Mark the transactions of the cluster of entry as unclustered */
+    void DissolveCluster(txiter entry);
+    /** Linearize vTxs, a cluster of unclustered transactions */
+    void LinearizeCluster(std::vector<txiter> vTxs);
+    /** Append the transaction at position i of the linearization to the chunks of the cluster */
+    void AppendToChunks(uint64_t nCluster, TxCluster& cluster, size_t i);
+    /** Take the last transaction off the linearization of the cluster of chunk, its
+     *  last chunk, and add it to stage. The transaction is left to be removed. */
+    void TrimCluster(const TxChunk* chunk, setEntries& stage);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
 public:
@@ -591,10 +703,17 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry links. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
 
+    /** Check that entry, with setAncestors its in-mempool ancestors as calculated
+     *  by CalculateMemPoolAncestors(), would join a cluster of at most
+     *  limitClusterCount transactions (itself included).
+     *  errString = populated with error reason if the limit is hit
+     */
+    bool CalculateClusterSize(const setEntries& setAncestors, uint64_t limitClusterCount, std::string& errString) const;
+
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
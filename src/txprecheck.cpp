@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "txprecheck.h"
+
+#include "sync.h"
+#include "util/system.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace {
+
+Mutex cs_precheck;
+std::condition_variable cvPreCheck;
+std::deque<std::shared_ptr<CTxPreCheck>> queuePreCheck GUARDED_BY(cs_precheck);
+bool fStopPreCheck GUARDED_BY(cs_precheck){false};
+std::vector<std::thread> vPreCheckThreads;
+std::function<void()> notifyPreCheck;
+
+std::atomic<uint64_t> nPreChecked{0};
+std::atomic<int64_t> nTimeQueued{0};
+std::atomic<int64_t> nTimePreCheck{0};
+std::atomic<uint64_t> nCommitted{0};
+std::atomic<int64_t> nTimeCommit{0};
+
+} // anon namespace
+
+static void ThreadTxPreCheck()
+{
+    while (true) {
+        std::shared_ptr<CTxPreCheck> pcheck;
+        {
+            WAIT_LOCK(cs_precheck, lock);
+            cvPreCheck.wait(lock, [] { return fStopPreCheck || !queuePreCheck.empty(); });
+            if (fStopPreCheck) return;
+            pcheck = std::move(queuePreCheck.front());
+            queuePreCheck.pop_front();
+        }
+        const int64_t nTimeStart = GetTimeMicros();
+        PreCheckTransaction(pcheck->tx);
+        const int64_t nTimeEnd = GetTimeMicros();
+        nPreChecked++;
+        nTimeQueued += nTimeStart - pcheck->nTimeQueued;
+        nTimePreCheck += nTimeEnd - nTimeStart;
+        pcheck->fDone = true;
+        notifyPreCheck();
+    }
+}
+
+void StartTxPreCheckThreads(int nThreads, std::function<void()> notify)
+{
+    assert(vPreCheckThreads.empty());
+    WITH_LOCK(cs_precheck, fStopPreCheck = false; );
+    notifyPreCheck = std::move(notify);
+    for (int i = 0; i < nThreads; i++) {
+        vPreCheckThreads.emplace_back(&TraceThread<std::function<void()>>, strprintf("txprecheck.%d", i), std::function<void()>(ThreadTxPreCheck));
+    }
+    if (nThreads > 0) LogPrintf("Transaction pre-check threads: %d\n", nThreads);
+}
+
+void StopTxPreCheckThreads()
+{
+    {
+        LOCK(cs_precheck);
+        fStopPreCheck = true;
+        queuePreCheck.clear();
+    }
+    cvPreCheck.notify_all();
+    for (std::thread& thread : vPreCheckThreads) thread.join();
+    vPreCheckThreads.clear();
+}
+
+std::shared_ptr<CTxPreCheck> QueueTxPreCheck(const CTransactionRef& tx)
+{
+    if (vPreCheckThreads.empty()) return nullptr;
+    auto pcheck = std::make_shared<CTxPreCheck>(tx, GetTimeMicros());
+    WITH_LOCK(cs_precheck, queuePreCheck.emplace_back(pcheck); );
+    cvPreCheck.notify_one();
+    return pcheck;
+}
+
+void RecordTxCommit(int64_t nTime)
+{
+    nCommitted++;
+    nTimeCommit += nTime;
+}
+
+TxAdmissionStats GetTxAdmissionStats()
+{
+    TxAdmissionStats stats;
+    stats.nPreChecked = nPreChecked;
+    stats.nTimeQueued = nTimeQueued;
+    stats.nTimePreCheck = nTimePreCheck;
+    stats.nCommitted = nCommitted;
+    stats.nTimeCommit = nTimeCommit;
+    return stats;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2021 The MARIA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MARIA_TXPRECHECK_H
+#define MARIA_TXPRECHECK_H
+
+#include "primitives/transaction.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/** Default for -txprecheckthreads */
+static const int DEFAULT_TXPRECHECK_THREADS = 2;
+/** Maximum number of transaction pre-check threads */
+static const int MAX_TXPRECHECK_THREADS = 8;
+/** Number of transactions of a peer waiting for their pre-check above which its messages are no longer processed */
+static const unsigned int MAX_PENDING_TXS_PER_PEER = 100;
+
+/**
+ * Loose transaction admission in two stages: the signatures and Sapling proofs
+ * are verified by PreCheckTransaction on a pool of worker threads, without
+ * cs_main, then AcceptToMemoryPool commits the transaction in the message
+ * handler thread, finding them in the signature and proof caches.
+ */
+struct CTxPreCheck
+{
+    const CTransactionRef tx;
+    const int64_t nTimeQueued;
+    std::atomic<bool> fDone{false};
+
+    CTxPreCheck(const CTransactionRef& txIn, int64_t nTimeQueuedIn) : tx(txIn), nTimeQueued(nTimeQueuedIn) {}
+};
+
+struct TxAdmissionStats
+{
+    //! Transactions pre-checked
+    uint64_t nPreChecked{0};
+    //! Time they waited for a pre-check thread (us)
+    int64_t nTimeQueued{0};
+    //! Time spent pre-checking them (us)
+    int64_t nTimePreCheck{0};
+    //! Transactions committed (passed to AcceptToMemoryPool)
+    uint64_t nCommitted{0};
+    //! Time spent committing them, under cs_main (us)
+    int64_t nTimeCommit{0};
+};
+
+/** Start nThreads pre-check threads, calling notify after each pre-check (no thread if nThreads is 0) */
+void StartTxPreCheckThreads(int nThreads, std::function<void()> notify);
+/** Stop the pre-check threads: the queued transactions are never pre-checked */
+void StopTxPreCheckThreads();
+/** Queue the pre-check of tx, or return nullptr if there is no pre-check thread */
+std::shared_ptr<CTxPreCheck> QueueTxPreCheck(const CTransactionRef& tx);
+/** Record the commit of a transaction, which took nTime us */
+void RecordTxCommit(int64_t nTime);
+TxAdmissionStats GetTxAdmissionStats();
+
+#endif // MARIA_TXPRECHECK_H
@@ -31,9 +31,11 @@
 #include "kernel.h"
 #include "masternode-payments.h"
 #include "masternodeman.h"
+#include "memusage.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "shutdown.h"
 #include "spork.h"
@@ -54,6 +56,7 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 #include <atomic>
+#include <deque>
 #include <queue>
 
 
@@ -79,6 +82,8 @@
 RecursiveMutex cs_main;
 
 BlockMap mapBlockIndex;
+//! Storage of the entries of mapBlockIndex
+static CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
 
@@ -92,8 +97,14 @@ int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
 bool fTxIndex = true;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+uint256 hashAssumeValid;
+int nAssumeValidHeight = 0;
+arith_uint256 nMinimumChainWork;
 size_t nCoinCacheUsage = 5000 * 300;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -174,6 +185,9 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are block/undo files that should be deleted. */
+bool fCheckForPruning = false;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -215,7 +229,7 @@ enum FlushStateMode {
 };
 
 // See definition for documentation
-bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode);
+bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int nManualPruneHeight = 0);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
@@ -363,6 +377,18 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+// Transactions whose Sapling proofs PreCheckTransaction verified, so that
+// AcceptToMemoryPool does not verify them again (the hash commits to the proofs)
+static const size_t MAX_VERIFIED_SAPLING_PROOFS = 10000;
+static Mutex cs_verified_sapling_proofs;
+static std::set<uint256> setVerifiedSaplingProofs GUARDED_BY(cs_verified_sapling_proofs);
+
+static bool TakeVerifiedSaplingProofs(const uint256& hash)
+{
+    LOCK(cs_verified_sapling_proofs);
+    return setVerifiedSaplingProofs.erase(hash) > 0;
+}
+
 static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef& _tx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
                               std::vector<COutPoint>& coins_to_uncache) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -401,7 +427,8 @@ static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state,
 
     int nextBlockHeight = chainHeight + 1;
     // Check transaction contextually against consensus rules at block height
-    if (!ContextualCheckTransaction(_tx, state, params, nextBlockHeight, false /* isMined */, IsInitialBlockDownload())) {
+    const bool fCheckSaplingProofs = !tx.IsShieldedTx() || !TakeVerifiedSaplingProofs(tx.GetHash());
+    if (!ContextualCheckTransaction(_tx, state, params, nextBlockHeight, false /* isMined */, IsInitialBlockDownload(), fCheckSaplingProofs)) {
         return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
     }
 
@@ -565,6 +592,11 @@ static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state,
         if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
             return state.DoS(0, error("%s : %s", __func__, errString), REJECT_NONSTANDARD, "too-long-mempool-chain", false);
         }
+        // The cluster is linearized again under the mempool lock whenever it changes
+        size_t nLimitCluster = gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT);
+        if (!pool.CalculateClusterSize(setAncestors, nLimitCluster, errString)) {
+            return state.DoS(0, error("%s : %s", __func__, errString), REJECT_NONSTANDARD, "too-large-mempool-cluster", false);
+        }
 
         bool fCLTVIsActivated = consensus.NetworkUpgradeActive(chainHeight, Consensus::UPGRADE_BIP65);
 
@@ -646,14 +678,83 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectInsaneFee, ignoreFees);
 }
 
+void PreCheckTransaction(const CTransactionRef& _tx)
+{
+    AssertLockNotHeld(cs_main);
+    const CTransaction& tx = *_tx;
+    if (tx.IsCoinBase() || tx.IsCoinStake() || tx.IsQuorumCommitmentTx() || tx.ContainsZerocoins())
+        return;
+
+    CValidationState state;
+    const bool fColdStakingActive = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE);
+    if (!CheckTransaction(tx, state, fColdStakingActive))
+        return;
+
+    // Sapling proofs
+    if (tx.IsShieldedTx()) {
+        if (sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE) || !SaplingValidation::CheckSaplingProofs(tx, state, 0))
+            return;
+        LOCK(cs_verified_sapling_proofs);
+        if (setVerifiedSaplingProofs.size() >= MAX_VERIFIED_SAPLING_PROOFS) setVerifiedSaplingProofs.clear();
+        setVerifiedSaplingProofs.emplace(tx.GetHash());
+    }
+
+    // Snapshot of the spent outputs: the mempool and the coins cache are read
+    // under the locks, the misses from the coins db after releasing them (and
+    // without caching them, the tx may never be accepted).
+    std::vector<CTxOut> vSpent(tx.vin.size());
+    std::vector<size_t> vMissing;
+    bool fCLTVIsActivated;
+    {
+        LOCK2(cs_main, mempool.cs);
+        fCLTVIsActivated = Params().GetConsensus().NetworkUpgradeActive(chainActive.Height(), Consensus::UPGRADE_BIP65);
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            const COutPoint& prevout = tx.vin[i].prevout;
+            CTransactionRef ptxPrev = mempool.get(prevout.hash);
+            if (ptxPrev) {
+                if (prevout.n >= ptxPrev->vout.size()) return;
+                vSpent[i] = ptxPrev->vout[prevout.n];
+            } else if (pcoinsTip->HaveCoinInCache(prevout)) {
+                vSpent[i] = pcoinsTip->AccessCoin(prevout).out;
+            } else {
+                vMissing.emplace_back(i);
+            }
+        }
+    }
+    for (size_t i : vMissing) {
+        Coin coin;
+        if (!pcoinsdbview->GetCoin(tx.vin[i].prevout, coin)) return;
+        vSpent[i] = coin.out;
+    }
+
+    // Input scripts, with the flags of AcceptToMemoryPool: the valid signatures
+    // are stored in the signature cache, where CheckInputs will find them.
+    int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (fCLTVIsActivated)
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    PrecomputedTransactionData precomTxData(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        CScriptCheck check(vSpent[i], tx, i, flags, true, &precomTxData);
+        if (!check()) return;
+    }
+}
+
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out)
 {
+    {
+        LOCK(cs_main);
+        const Coin& coin = pcoinsTip->AccessCoin(COutPoint(hash, index));
+        if (!coin.IsSpent()) {
+            out = coin.out;
+            return true;
+        }
+    }
     CTransactionRef txPrev;
     uint256 hashBlock;
     if (!GetTransaction(hash, txPrev, hashBlock, true)) {
         return state.DoS(100, error("Output not found"));
     }
-    if (index > txPrev->vout.size()) {
+    if (index >= txPrev->vout.size()) {
         return state.DoS(100, error("Output not found, invalid index %d for %s",index, hash.GetHex()));
     }
     out = txPrev->vout[index];
@@ -907,6 +1008,8 @@ bool IsInitialBlockDownload()
     const int chainHeight = chainActive.Height();
     if (fImporting || fReindex || chainHeight < Checkpoints::GetTotalBlocksEstimate())
         return true;
+    if (chainActive.Tip()->nChainWork < nMinimumChainWork)
+        return true;
     bool state = (chainHeight < pindexBestHeader->nHeight - 24 * 6 ||
             pindexBestHeader->GetBlockTime() < GetTime() - nMaxTipAge);
     if (!state)
@@ -1270,6 +1373,44 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const FlatFilePos& pos, const uint2
 
 } // anon namespace
 
+bool GetCoinSpentAfterFork(const COutPoint& prevout, const CBlockIndex* pindexPrev, Coin& coin)
+{
+    LOCK(cs_main);
+    if (!pindexPrev) return false;
+
+    // Only the blocks above the fork point can have spent an output that pindexPrev
+    // still has. They are at most -maxreorg deep, and pruning keeps them (see GetPruneKeepDepth).
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+    const int nMaxDepth = gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH);
+    for (const CBlockIndex* pindex = chainActive.Tip();
+         pindex && pindex != pindexFork && pindex->pprev && chainActive.Height() - pindex->nHeight <= nMaxDepth;
+         pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo blockUndo;
+        const FlatFilePos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !ReadBlockFromDisk(block, pindex) ||
+                !UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
+            return error("%s: block or undo data %s not on disk", __func__, pindex->GetBlockHash().GetHex());
+        }
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data %s inconsistent", __func__, pindex->GetBlockHash().GetHex());
+        }
+        // vtxundo[i] holds the coins spent by vtx[i + 1], input by input (UpdateCoins)
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) continue;
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                if (tx.vin[j].prevout == prevout) {
+                    coin = txundo.vprevout[j];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1440,7 +1581,7 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CBlockCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck()
 {
@@ -1448,6 +1589,23 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/** Whether pindex is an ancestor of the -assumevalid block, buried deep enough under our best header */
+static bool IsAssumedValid(const CBlockIndex* pindex, const Consensus::Params& consensus) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (hashAssumeValid.IsNull()) return false;
+    // The assumed valid block must be in our headers tree (until it is received, everything is
+    // checked): with its height known, the headers leading to it are stored ahead of the blocks
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end()) return false;
+    const CBlockIndex* pindexAssumeValid = it->second;
+    if (pindexAssumeValid->GetAncestor(pindex->nHeight) != pindex) return false;
+    // pindex must be in the best headers chain, with enough work on top of it
+    // to make a fake chain built around the assumed valid block too expensive
+    if (!pindexBestHeader || pindexBestHeader->GetAncestor(pindex->nHeight) != pindex) return false;
+    if (pindexBestHeader->nChainWork < nMinimumChainWork) return false;
+    return GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensus) > ASSUMEVALID_MIN_BURIED_TIME;
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeProcessSpecial = 0;
 static int64_t nTimeConnect = 0;
@@ -1521,14 +1679,19 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // However, the miner and mining RPCs may not have populated this
     // value and will call `TestBlockValidity`. So, we act
     // conditionally.
-    if (pindex->nChainSaplingValue) {
-        if (*pindex->nChainSaplingValue < 0) {
-            return state.DoS(100, error("%s: turnstile violation in Sapling shielded value pool: val: %d", __func__, *pindex->nChainSaplingValue),
+    const Optional<CAmount> nChainSaplingValue = pindex->GetChainSaplingValue();
+    if (nChainSaplingValue) {
+        if (*nChainSaplingValue < 0) {
+            return state.DoS(100, error("%s: turnstile violation in Sapling shielded value pool: val: %d", __func__, *nChainSaplingValue),
                              REJECT_INVALID, "turnstile-violation-sapling-shielded-pool");
         }
     }
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    // Scripts and Sapling proofs of ancestors of the assumed valid block are not
+    // verified (all the other checks, amounts and stake included, still are)
+    bool fAssumeValid = IsAssumedValid(pindex, consensus);
+    bool fScriptChecks = !fAssumeValid && pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    bool fSaplingProofChecks = !fAssumeValid;
 
     // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
     bool fCLTVIsActivated = false;
@@ -1536,7 +1699,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         fCLTVIsActivated = consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_BIP65);
     }
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // The queue is used whenever there are worker threads: even if scripts are
+    // not checked, the Sapling proofs of the block may still be verified.
+    CCheckQueueControl<CBlockCheck> control(nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -1555,6 +1720,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // Sapling
     SaplingMerkleTree sapling_tree;
     assert(view.GetSaplingAnchorAt(view.GetBestAnchor(), sapling_tree));
+    SaplingProofChecks saplingProofs;
 
     std::vector<PrecomputedTransactionData> precomTxData;
     precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
@@ -1615,7 +1781,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            std::vector<CBlockCheck> vBlockChecks;
+            vBlockChecks.reserve(vChecks.size());
+            for (CScriptCheck& check : vChecks) {
+                vBlockChecks.emplace_back(check);
+            }
+            control.Add(vBlockChecks);
         }
         nValueOut += txValueOut;
 
@@ -1626,6 +1797,17 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         const bool fSkipInvalid = SkipInvalidUTXOS(pindex->nHeight);
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, fSkipInvalid);
 
+        // Sapling proofs, verified by the check queue alongside the input scripts
+        if (fSaplingProofChecks && tx.hasSaplingData()) {
+            saplingProofs.Add(block.vtx[i]);
+            if (nScriptCheckThreads) {
+                CSaplingProofCheck saplingCheck(block.vtx[i]);
+                std::vector<CBlockCheck> vBlockChecks;
+                vBlockChecks.emplace_back(saplingCheck);
+                control.Add(vBlockChecks);
+            }
+        }
+
         // Sapling update tree
         if (tx.IsShieldedTx() && !tx.sapData->vShieldedOutput.empty()) {
             for(const OutputDescription &outputDescription : tx.sapData->vShieldedOutput) {
@@ -1640,6 +1822,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // Push new tree anchor
     view.PushAnchor(sapling_tree);
 
+    // Without worker threads, verify the Sapling proofs of the block here
+    if (!nScriptCheckThreads && !saplingProofs.empty()) {
+        int64_t nTimeSaplingStart = GetTimeMicros();
+        if (!saplingProofs.Verify(state, 100)) {
+            return error("%s: Sapling proofs verification failed with %s", __func__, FormatStateMessage(state));
+        }
+        LogPrint(BCLog::BENCHMARK, "      - Verify Sapling proofs of %u transactions: %.2fms\n", (unsigned)saplingProofs.size(), 0.001 * (GetTimeMicros() - nTimeSaplingStart));
+    }
+
     // Verify header correctness
     if (isV5UpgradeEnforced) {
         // If Sapling is active, block.hashFinalSaplingRoot must be the
@@ -1687,8 +1878,14 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         return false;
     }
 
-    if (!control.Wait())
+    if (!control.Wait()) {
+        // The queue doesn't tell which check failed. Re-verify the Sapling proofs
+        // serially to find the culprit (if any) and report its rejection reason.
+        if (!saplingProofs.empty() && !saplingProofs.Verify(state, 100)) {
+            return error("%s: Sapling proofs verification failed with %s", __func__, FormatStateMessage(state));
+        }
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    }
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCHMARK, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -1761,20 +1958,208 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+unsigned int GetPruneKeepDepth()
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    int64_t nKeep = std::max<int64_t>(MIN_BLOCKS_TO_KEEP, gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH) + 1);
+    for (const auto& it : consensus.llmqs) {
+        nKeep = std::max<int64_t>(nKeep, (int64_t)it.second.dkgInterval * it.second.signingActiveQuorumCount);
+    }
+    return (unsigned int)nKeep;
+}
+
+int GetPruneHeight()
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindex = chainActive.Tip();
+    if (!pindex) return 0;
+    while (pindex->pprev && (pindex->pprev->nStatus & BLOCK_HAVE_DATA)) {
+        pindex = pindex->pprev;
+    }
+    return pindex->nHeight;
+}
+
+uint64_t CalculateCurrentUsage()
+{
+    LOCK(cs_LastBlockFile);
+
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+/* Mark the blocks of a block file as no longer on disk, and reset the file info */
+static void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    LOCK(cs_LastBlockFile);
+
+    for (const auto& entry : mapBlockIndex) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile != fileNumber || !(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO))) {
+            continue;
+        }
+        pindex->nStatus &= ~BLOCK_HAVE_DATA;
+        pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+        pindex->nFile = 0;
+        pindex->nDataPos = 0;
+        pindex->nUndoPos = 0;
+        setDirtyBlockIndex.insert(pindex);
+
+        // Prune from mapBlocksUnlinked -- any block we prune would have
+        // to be downloaded again in order to consider its chain, at which
+        // point it would be considered as a candidate for
+        // mapBlocksUnlinked or setBlockIndexCandidates.
+        auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        while (range.first != range.second) {
+            auto it = range.first++;
+            if (it->second == pindex) {
+                mapBlocksUnlinked.erase(it);
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+static void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (const int nFile : setFilesToPrune) {
+        FlatFilePos pos(nFile, 0);
+        fs::remove(BlockFileSeq().FileName(pos));
+        fs::remove(UndoFileSeq().FileName(pos));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+/* Calculate the block/rev files to delete based on the height specified by the user with RPC command pruneblockchain */
+static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    assert(fPruneMode && nManualPruneHeight > 0);
+
+    LOCK(cs_LastBlockFile);
+    const unsigned int nKeepDepth = GetPruneKeepDepth();
+    if (chainActive.Tip() == nullptr || (unsigned int)chainActive.Height() <= nKeepDepth) {
+        return;
+    }
+
+    // last block to prune is the lesser of (user-specified height, keep depth from the tip)
+    const unsigned int nLastBlockWeCanPrune = std::min((unsigned int)nManualPruneHeight, chainActive.Height() - nKeepDepth);
+    int count = 0;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune) {
+            continue;
+        }
+        PruneOneBlockFile(fileNumber);
+        setFilesToPrune.insert(fileNumber);
+        count++;
+    }
+    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
+}
+
+/**
+ * Prune block and undo files (blk???.dat and undo???.dat) so that the disk space used is less than a user-defined target.
+ * The user sets the target (in MB) on the command line or in config file.  This will be run on startup and whenever new
+ * space is allocated in a block or undo file, staying below the target. Changing back to unpruned requires a reindex
+ * (which in this case means the blockchain must be re-downloaded.)
+ *
+ * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
+ * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
+ * Pruning cannot take place until the longest chain is at least a certain length (100000 on mainnet, 1000 on testnet, 1000 on regtest).
+ * Pruning will never delete a block within GetPruneKeepDepth() blocks of the current tip.
+ * The block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that were stored in the deleted files.
+ * A db flag records the fact that at least some block files have been pruned.
+ *
+ * @param[out]   setFilesToPrune   The set of file indices that can be unlinked will be returned
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    LOCK(cs_LastBlockFile);
+    const unsigned int nKeepDepth = GetPruneKeepDepth();
+    if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
+        return;
+    }
+    if ((uint64_t)chainActive.Height() <= nPruneAfterHeight || (unsigned int)chainActive.Height() <= nKeepDepth) {
+        return;
+    }
+
+    const unsigned int nLastBlockWeCanPrune = chainActive.Height() - nKeepDepth;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    const uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            const uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0) {
+                continue;
+            }
+            // are we below our target?
+            if (nCurrentUsage + nBuffer < nPruneTarget) {
+                break;
+            }
+            // don't prune files that could have a block within the keep depth of the main chain's tip but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune) {
+                continue;
+            }
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+           nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
+           ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
+           nLastBlockWeCanPrune, count);
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
  * Full flush also updates the money supply from disk (except during shutdown)
+ * In prune mode, block and undo files are deleted here (see FindFilesToPrune), or up to
+ * nManualPruneHeight when called from pruneblockchain.
  */
-bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
+bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode, int nManualPruneHeight)
 {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
+        // A background write of the coins failed since the last call
+        if (pcoinsdbview && pcoinsdbview->FlushFailed()) {
+            return AbortNode(state, "Failed to write to coin database");
+        }
+        if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
+            if (nManualPruneHeight > 0) {
+                FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
+            } else {
+                FindFilesToPrune(setFilesToPrune, Params().PruneAfterHeight());
+                fCheckForPruning = false;
+            }
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -1802,7 +2187,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -1848,15 +2233,28 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // The coins may still be being written on the flush thread: the explicit full
+            // flushes (shutdown, RPC) wait for them, and so does pruning (below).
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsdbview->WaitForFlush())
+                return AbortNode(state, "Failed to write to coin database");
             if (!evoDb->CommitRootTransaction()) {
                 return AbortNode(state, "Failed to commit EvoDB");
             }
             nLastFlush = nNow;
             // Update money supply on memory, reading data from disk
+            // once it is written, without holding cs_main.
             if (!ShutdownRequested() && !IsInitialBlockDownload()) {
-                MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
+                const int nHeight = chainActive.Height();
+                pcoinsdbview->AfterFlush([nHeight](CCoinsViewDB& coinsdb) {
+                    MoneySupply.Update(CCoinsViewCache(&coinsdb).GetTotalAmount(), nHeight);
+                });
             }
         }
+        // Finally remove any pruned files, once the coins are on disk: until then,
+        // ReplayBlocks may need their blocks after a crash.
+        if (fFlushForPrune) {
+            UnlinkPrunedFiles(setFilesToPrune);
+        }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
             // Update best block in wallet (so we can detect restored wallets).
             GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -1875,6 +2273,19 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
+void PruneBlockFilesManual(int nManualPruneHeight)
+{
+    CValidationState state;
+    FlushStateToDisk(state, FLUSH_STATE_NONE, nManualPruneHeight);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -2474,7 +2885,7 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
-static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
 
@@ -2485,7 +2896,7 @@ static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRE
         return pindex;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2498,16 +2909,8 @@ static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRE
         pindexNew->pprev = pprev;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
-
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        // The stake modifier needs the block data (the coinstake prevout): it is set
+        // in ReceivedBlockTransactions.
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2525,6 +2928,17 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
 {
     if (block.IsProofOfStake())
         pindexNew->SetProofOfStake();
+    if (pindexNew->pprev) {
+        // Blocks are received in order (the parent has already got its modifier)
+        if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
+            // compute and set new V1 stake modifier (entropy bits)
+            pindexNew->SetNewStakeModifier();
+
+        } else {
+            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+        }
+    }
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
 
@@ -2540,7 +2954,7 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
         }
     }
     pindexNew->nSaplingValue = saplingValue;
-    pindexNew->nChainSaplingValue = nullopt;
+    pindexNew->SetChainSaplingValue(nullopt);
 
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
@@ -2623,11 +3037,13 @@ bool FindBlockPos(CValidationState& state, FlatFilePos& pos, unsigned int nAddSi
 
     if (!fKnown) {
         bool out_of_space;
-        BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
+        size_t bytes_allocated = BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
         if (out_of_space) {
             return AbortNode("Disk space is low!", _("Error: Disk space is low!"));
         }
-        // future: add prunning flag check
+        if (bytes_allocated != 0 && fPruneMode) {
+            fCheckForPruning = true;
+        }
     }
 
     setDirtyFileInfo.insert(nFile);
@@ -2645,18 +3061,21 @@ bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned
     setDirtyFileInfo.insert(nFile);
 
     bool out_of_space;
-    UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
+    size_t bytes_allocated = UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
     if (out_of_space) {
         return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
     }
-    // future: add prunning flag check
+    if (bytes_allocated != 0 && fPruneMode) {
+        fCheckForPruning = true;
+    }
 
     return true;
 }
 
-bool CheckColdStakeFreeOutput(const CTransaction& tx, const int nHeight)
+bool CheckColdStakeFreeOutput(const CTransaction& tx, const CBlockIndex* pindexPrev)
 {
     assert(tx.IsCoinStake());
+    const int nHeight = pindexPrev->nHeight + 1;
     // This check applies only to coinstakes spending a P2CS_LOF script.
     // The script-check ensures that all but the first and the last output
     // (if the coinstake has more than 3 outputs) have the same scriptPubKey.
@@ -2680,11 +3099,19 @@ bool CheckColdStakeFreeOutput(const CTransaction& tx, const int nHeight)
         // if mnsync is incomplete, we cannot verify if this is a budget block.
         // so we check that the staker is not transferring value to the free output
         if (!g_tiertwo_sync_state.IsSynced()) {
-            // First try finding the previous transaction in database
-            CTransactionRef txPrev; uint256 hashBlock;
-            if (!GetTransaction(tx.vin[0].prevout.hash, txPrev, hashBlock, true))
-                return error("%s : read txPrev failed: %s",  __func__, tx.vin[0].prevout.hash.GetHex());
-            CAmount amtIn = txPrev->vout[tx.vin[0].prevout.n].nValue + GetBlockValue(nHeight);
+            // Find the value of the stake input: coins cache, then previous transaction in database,
+            // then (pruned node, input spent after the fork of the block) undo data
+            const COutPoint& prevout = tx.vin[0].prevout;
+            Coin coinPrev = WITH_LOCK(cs_main, return pcoinsTip->AccessCoin(prevout); );
+            if (coinPrev.IsSpent()) {
+                CTransactionRef txPrev; uint256 hashBlock;
+                if (GetTransaction(prevout.hash, txPrev, hashBlock, true)) {
+                    coinPrev.out = txPrev->vout[prevout.n];
+                } else if (!fHavePruned || !GetCoinSpentAfterFork(prevout, pindexPrev, coinPrev)) {
+                    return error("%s : read txPrev failed: %s",  __func__, prevout.hash.GetHex());
+                }
+            }
+            CAmount amtIn = coinPrev.out.nValue + GetBlockValue(nHeight);
             CAmount amtOut = 0;
             for (unsigned int i = 1; i < outs-1; i++) amtOut += tx.vout[i].nValue;
             if (amtOut != amtIn)
@@ -2786,7 +3213,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     if (pindexPrev != nullptr && block.hashPrevBlock != UINT256_ZERO) {
         if (pindexPrev->GetBlockHash() != block.hashPrevBlock) {
             //out of order
-            CBlockIndex* pindexPrev = LookupBlockIndex(block.hashPrevBlock);
+            pindexPrev = LookupBlockIndex(block.hashPrevBlock);
             if (!pindexPrev) {
                 return state.Error("blk-out-of-order");
             }
@@ -2801,7 +3228,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         // that this block is invalid, so don't issue an outright ban.
         if (nHeight != 0 && !IsInitialBlockDownload()) {
             // Last output of Cold-Stake is not abused
-            if (IsPoS && !CheckColdStakeFreeOutput(*(block.vtx[1]), nHeight)) {
+            if (IsPoS && !CheckColdStakeFreeOutput(*(block.vtx[1]), pindexPrev)) {
                 mapRejectedBlocks.emplace(block.GetHash(), GetTime());
                 return state.DoS(0, false, REJECT_INVALID, "bad-p2cs-outs", false, "invalid cold-stake output");
             }
@@ -2850,14 +3277,16 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlockHeader& block, const CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().GetHex());
 
     unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev, &block);
 
-    if (!Params().IsRegTestNet() && block.IsProofOfWork() && (pindexPrev->nHeight + 1 <= 68589)) {
+    // Only the header is known here: before the PoS upgrade all blocks are PoW
+    const bool fPoWHeight = !Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS);
+    if (!Params().IsRegTestNet() && fPoWHeight && (pindexPrev->nHeight + 1 <= 68589)) {
         double n1 = ConvertBitsToDouble(block.nBits);
         double n2 = ConvertBitsToDouble(nBitsRequired);
 
@@ -2983,8 +3412,9 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
-        // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        // Check transaction contextually against consensus rules at block height.
+        // Sapling proofs are verified later, transaction by transaction, in ConnectBlock.
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload(), false /* fCheckSaplingProofs */)) {
             return false;
         }
 
@@ -3021,7 +3451,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 }
 
 // Get the index of previous block of given CBlock
-static bool GetPrevIndex(const CBlock& block, CBlockIndex** pindexPrevRet, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static bool GetPrevIndex(const CBlockHeader& block, CBlockIndex** pindexPrevRet, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
 
@@ -3051,7 +3481,7 @@ static bool GetPrevIndex(const CBlock& block, CBlockIndex** pindexPrevRet, CVali
     return true;
 }
 
-bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, CBlockIndex* pindexPrev)
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, CBlockIndex* pindexPrev)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3288,6 +3718,12 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!GetPrevIndex(block, &pindexPrev, state))
         return false;
 
+    // The stake modifier, and the stake input checks, need the parent block data:
+    // a block whose parent is only known by its header can't be accepted yet.
+    if (pindexPrev && pindexPrev->nTx == 0)
+        return state.DoS(0, error("%s : prev block %s not received yet", __func__, block.hashPrevBlock.GetHex()), 0,
+                         "prevblk-not-received");
+
     if (block.GetHash() != consensus.hashGenesisBlock && !CheckWork(block, pindexPrev))
         return state.DoS(100, false, REJECT_INVALID);
 
@@ -3421,6 +3857,64 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     return true;
 }
 
+bool CheckBlockHeaderWork(const CBlockHeader& header, CValidationState& state, const CBlockIndex* pindexPrev)
+{
+    if (!CheckWork(header, pindexPrev))
+        return state.DoS(100, false, REJECT_INVALID, "bad-diffbits", false, "incorrect proof of work");
+    // The proof of stake needs the coinstake: it is checked when the block arrives
+    const bool fPoWHeight = !Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS);
+    if (fPoWHeight && !CheckProofOfWork(header.GetHash(), header.nBits))
+        return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
+    return true;
+}
+
+/**
+ * Whether a new header extends the best headers chain towards the -assumevalid block, which makes its
+ * ancestors skip their checks once it is known (see IsAssumedValid). These headers are stored whatever
+ * their source: they form a single chain, up to the height of the assumed valid block, which it must end with.
+ */
+static bool IsAssumedValidPath(const CBlockHeader& header, const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    if (hashAssumeValid.IsNull() || nHeight > nAssumeValidHeight || pindexPrev != pindexBestHeader)
+        return false;
+    if (mapBlockIndex.count(hashAssumeValid))
+        return false;
+    return nHeight < nAssumeValidHeight || header.GetHash() == hashAssumeValid;
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex, std::vector<const CBlockIndex*>* pvPoSHeaders)
+{
+    AssertLockNotHeld(cs_main);
+
+    LOCK(cs_main);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const CBlockHeader& header : headers) {
+        CBlockIndex* pindex = LookupBlockIndex(header.GetHash());
+        CBlockIndex* pindexPrev = nullptr;
+        bool fNewPoSHeader = false;
+        if (!pindex) {
+            if (!GetPrevIndex(header, &pindexPrev, state))
+                return false;
+            // A PoS header costs nothing to make, and its stake and signature are in the block:
+            // a source can only have so many of them stored before their blocks arrive.
+            fNewPoSHeader = consensus.NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS) &&
+                            !IsAssumedValidPath(header, pindexPrev);
+            if (fNewPoSHeader && (!pvPoSHeaders || pvPoSHeaders->size() >= MAX_UNCONNECTED_POS_HEADERS))
+                break;
+            if (!CheckBlockHeaderWork(header, state, pindexPrev))
+                return false;
+        }
+        if (!AcceptBlockHeader(header, state, &pindex, pindexPrev))
+            return false;
+        if (fNewPoSHeader)
+            pvPoSHeaders->push_back(pindex);
+        if (ppindex)
+            *ppindex = pindex;
+    }
+    return true;
+}
+
 bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp)
 {
     AssertLockNotHeld(cs_main);
@@ -3528,7 +4022,7 @@ CBlockIndex* InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.emplace(hash, pindexNew).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -3536,16 +4030,35 @@ CBlockIndex* InsertBlockIndex(const uint256& hash)
     return pindexNew;
 }
 
+BlockIndexMemoryStats GetBlockIndexMemoryStats()
+{
+    AssertLockHeld(cs_main);
+
+    BlockIndexMemoryStats stats;
+    stats.nEntries = blockIndexArena.Size();
+    stats.nUsage = blockIndexArena.DynamicMemoryUsage() + AccumulatorCheckpointsDynamicUsage() +
+                   mapBlockIndex.DynamicMemoryUsage();
+    return stats;
+}
+
 bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
 
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    int64_t nTimeStart = GetTimeMicros();
+    // Size the map for the stored headers at once: the hash checkpoint is close to the best one
+    CBlockHashCheckpoint hashCheckpoint;
+    if (pblocktree->ReadBlockHashCheckpoint(hashCheckpoint) && !hashCheckpoint.IsNull()) {
+        mapBlockIndex.reserve(hashCheckpoint.nHeight + 1);
+    }
+    // With consistency checks enabled, re-hash every header instead of trusting the hash checkpoint
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, fCheckBlockIndex))
         return false;
+    int64_t nTimeGuts = GetTimeMicros();
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
+    // Calculate nChainWork: the only pass which has to follow the height order
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
@@ -3553,32 +4066,31 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
         vSortedByHeight.emplace_back(pindex->nHeight, pindex);
     }
     std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    int64_t nTimeSort = GetTimeMicros();
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
 
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        // LoadBlockIndexGuts left the proof of the block alone in nChainWork
+        if (pindex->pprev) pindex->nChainWork += pindex->pprev->nChainWork;
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
                     // Sapling, calculate chain index value
-                    if (pindex->pprev->nChainSaplingValue) {
-                        pindex->nChainSaplingValue = *pindex->pprev->nChainSaplingValue + pindex->nSaplingValue;
-                    } else {
-                        pindex->nChainSaplingValue = nullopt;
-                    }
-
+                    pindex->SetChainSaplingValue();
                 } else {
                     pindex->nChainTx = 0;
-                    pindex->nChainSaplingValue = nullopt;
+                    pindex->SetChainSaplingValue(nullopt);
                     mapBlocksUnlinked.emplace(pindex->pprev, pindex);
                 }
             } else {
                 pindex->nChainTx = pindex->nTx;
-                pindex->nChainSaplingValue = pindex->nSaplingValue;
+                pindex->SetChainSaplingValue();
             }
         }
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == NULL))
@@ -3590,6 +4102,7 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nTimeChainWork = GetTimeMicros();
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3623,6 +4136,10 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
             return false;
         }
     }
+    int64_t nTimeBlockFiles = GetTimeMicros();
+    LogPrintf("%s: loaded %u block index entries in %.2fms (index db %.2fms, sort %.2fms, chain work %.2fms, block files %.2fms)\n", __func__,
+              mapBlockIndex.size(), (nTimeBlockFiles - nTimeStart) * 0.001, (nTimeGuts - nTimeStart) * 0.001,
+              (nTimeSort - nTimeGuts) * 0.001, (nTimeChainWork - nTimeSort) * 0.001, (nTimeBlockFiles - nTimeChainWork) * 0.001);
 
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
@@ -3634,6 +4151,11 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
     pblocktree->ReadReindexing(fReindexing);
     if (fReindexing) fReindex = true;
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check whether we have a transaction index
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
@@ -3724,6 +4246,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainHeight - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3899,10 +4426,8 @@ void UnloadBlockIndex()
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -3964,117 +4489,260 @@ bool LoadGenesisBlock()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
+namespace {
+
+//! A block read from a block file, with its header hash
+struct ExternalBlock
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    std::shared_ptr<const CBlock> block;
+    uint256 hash;
+    //! Null for files outside of the blocks directory
+    FlatFilePos pos;
+};
+
+/**
+ * Read the blocks of fileIn (taking it over), calling fn on each of them until
+ * it returns false. Blocks which fail to deserialize are skipped.
+ * Throws std::runtime_error on I/O failure.
+ */
+template <typename Fn>
+void ReadBlockFile(FILE* fileIn, const FlatFilePos* dbp, Fn fn)
+{
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
 
+        blkdat.SetPos(nRewind);
+        nRewind++;         // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> buf;
+            if (memcmp(buf, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            blkdat >> *pblock;
+            nRewind = blkdat.GetPos();
+
+            ExternalBlock ext;
+            ext.hash = pblock->GetHash();
+            ext.block = std::move(pblock);
+            if (dbp) ext.pos = FlatFilePos(dbp->nFile, nBlockPos);
+            if (!fn(std::move(ext))) break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+}
+
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+
+//! Connect stage of the block imports: hands the blocks, in file order, to ProcessNewBlock
+class ExternalBlockImporter
+{
+private:
     // Block checked event listener
-    BlockStateCatcher stateCatcher(UINT256_ZERO);
-    stateCatcher.registerEvent();
+    BlockStateCatcher stateCatcher{UINT256_ZERO};
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+public:
+    int nLoaded{0};
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+    ExternalBlockImporter() { stateCatcher.registerEvent(); }
+
+    //! Returns false if the rest of the file must be skipped
+    bool Import(const ExternalBlock& ext)
+    {
+        const FlatFilePos* dbp = ext.pos.IsNull() ? nullptr : &ext.pos;
+        const uint256& hash = ext.hash;
+        CBlockIndex* pindex{nullptr};
+        {
+            LOCK(cs_main);
+            // detect out of order blocks, and store them for later
+            if (hash != Params().GetConsensus().hashGenesisBlock && !LookupBlockIndex(ext.block->hashPrevBlock)) {
+                LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                        hash.ToString(), ext.block->hashPrevBlock.ToString());
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                CBlockIndex* pindex{nullptr};
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != Params().GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                                hash.ToString(), block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.emplace(block.hashPrevBlock, *dbp);
-                        continue;
-                    }
+                    mapBlocksUnknownParent.emplace(ext.block->hashPrevBlock, *dbp);
+                return true;
+            }
 
-                    pindex = LookupBlockIndex(hash);
-                }
+            pindex = LookupBlockIndex(hash);
+        }
+
+        // process in case the block isn't known yet
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+            stateCatcher.setBlockHash(hash);
+            if (ProcessNewBlock(ext.block, dbp)) {
+                nLoaded++;
+            }
+            if (stateCatcher.stateErrorFound()) {
+                return false;
+            }
+        } else if (hash != Params().GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+        }
 
-                // process in case the block isn't known yet
-                if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+        // Recursively process earlier encountered successors of this block
+        std::deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                CBlock block;
+                if (ReadBlockFromDisk(block, it->second)) {
+                    LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        head.ToString());
                     std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                    stateCatcher.setBlockHash(block_ptr->GetHash());
-                    if (ProcessNewBlock(block_ptr, dbp)) {
+                    if (ProcessNewBlock(block_ptr, &it->second)) {
                         nLoaded++;
+                        queue.emplace_back(block.GetHash());
                     }
-                    if (stateCatcher.stateErrorFound()) {
-                        break;
-                    }
-                } else if (hash != Params().GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
                 }
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                            if (ProcessNewBlock(block_ptr, &it->second)) {
-                                nLoaded++;
-                                queue.emplace_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
-            } catch (const std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
             }
         }
+        return true;
+    }
+};
+
+//! The blocks of a blk?????.dat file, read by a reindex scan thread
+struct ScannedBlockFile
+{
+    bool fFound{false};
+    std::vector<ExternalBlock> vBlocks;
+    uint64_t nBytes{0};
+    int64_t nTimeScan{0};
+    //! Set if reading the file failed
+    std::string strError;
+};
+
+ScannedBlockFile ScanBlockFile(int nFile)
+{
+    ScannedBlockFile scanned;
+    int64_t nTimeStart = GetTimeMillis();
+    FlatFilePos pos(nFile, 0);
+    FILE* file = OpenBlockFile(pos, true);
+    if (!file) return scanned; // This error is logged in OpenBlockFile
+    scanned.fFound = true;
+    try {
+        scanned.nBytes = fs::file_size(GetBlockPosFilename(pos));
+        ReadBlockFile(file, &pos, [&scanned](ExternalBlock&& ext) {
+            scanned.vBlocks.emplace_back(std::move(ext));
+            return !ShutdownRequested();
+        });
+    } catch (const std::exception& e) {
+        scanned.strError = e.what();
+    }
+    scanned.nTimeScan = GetTimeMillis() - nTimeStart;
+    return scanned;
+}
+
+} // anonymous namespace
+
+bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+    ExternalBlockImporter importer;
+    try {
+        ReadBlockFile(fileIn, dbp, [&](ExternalBlock&& ext) {
+            if (dbp) *dbp = ext.pos;
+            return importer.Import(ext);
+        });
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+    if (importer.nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", importer.nLoaded, GetTimeMillis() - nStart);
+    return importer.nLoaded > 0;
+}
+
+bool ReindexBlockFiles()
+{
+    int nFiles = 0;
+    while (fs::exists(GetBlockPosFilename(FlatFilePos(nFiles, 0)))) nFiles++;
+    const int nScanThreads = std::max(1, std::min(GetNumCores(), MAX_REINDEX_SCAN_THREADS));
+    const uint64_t nMaxReadAhead = std::min<uint64_t>((uint64_t)nScanThreads * MAX_BLOCKFILE_SIZE,
+                                                      (uint64_t)std::max<int64_t>(0, gArgs.GetArg("-reindexreadahead", DEFAULT_REINDEX_READAHEAD)) << 20);
+    LogPrintf("Reindexing %d block files (%d scan threads, %d MiB read-ahead)...\n", nFiles, nScanThreads, nMaxReadAhead >> 20);
+    uiInterface.ShowProgress(_("Reindexing blocks..."), 0);
+
+    // The next files are read and deserialized while the current one is connected,
+    // as long as their total size fits in the read-ahead budget
+    std::deque<std::pair<std::future<ScannedBlockFile>, uint64_t>> qScans;
+    uint64_t nReadAheadBytes = 0;
+    int nNextScan = 0;
+    auto startScans = [&]() {
+        while (nNextScan < nFiles && (int)qScans.size() < nScanThreads) {
+            boost::system::error_code ec;
+            uint64_t nSize = fs::file_size(GetBlockPosFilename(FlatFilePos(nNextScan, 0)), ec);
+            if (ec) nSize = 0; // Reported by the scan of the file
+            if (!qScans.empty() && nReadAheadBytes + nSize > nMaxReadAhead) break;
+            qScans.emplace_back(std::async(std::launch::async, ScanBlockFile, nNextScan++), nSize);
+            nReadAheadBytes += nSize;
+        }
+    };
+
+    ExternalBlockImporter importer;
+    const int64_t nStart = GetTimeMillis();
+    uint64_t nBytesDone = 0;
+    for (int nFile = 0; nFile < nFiles; nFile++) {
+        startScans();
+        int64_t nTimeWait = GetTimeMillis();
+        ScannedBlockFile scanned = qScans.front().first.get();
+        nReadAheadBytes -= qScans.front().second;
+        qScans.pop_front();
+        startScans();
+        nTimeWait = GetTimeMillis() - nTimeWait;
+        if (!scanned.strError.empty()) {
+            AbortNode(std::string("System error: ") + scanned.strError);
+            break;
+        }
+        if (!scanned.fFound) break;
+
+        const int64_t nTimeConnect = GetTimeMillis();
+        const int nLoadedBefore = importer.nLoaded;
+        for (const ExternalBlock& ext : scanned.vBlocks) {
+            boost::this_thread::interruption_point();
+            if (!importer.Import(ext)) break;
+        }
+        nBytesDone += scanned.nBytes;
+        const int64_t nNow = GetTimeMillis();
+        const double nElapsed = std::max<int64_t>(1, nNow - nStart) * 0.001;
+        LogPrintf("Reindexed block file blk%05u.dat: %u blocks read in %dms, %d connected in %dms (waited %dms), height=%d, %.1f blocks/s, %.2f MB/s\n",
+                  (unsigned int)nFile, scanned.vBlocks.size(), scanned.nTimeScan, importer.nLoaded - nLoadedBefore,
+                  nNow - nTimeConnect, nTimeWait, WITH_LOCK(cs_main, return chainActive.Height()),
+                  importer.nLoaded / nElapsed, nBytesDone / nElapsed / (1 << 20));
+        uiInterface.ShowProgress(_("Reindexing blocks..."), (nFile + 1) * 100 / nFiles);
+    }
+    uiInterface.ShowProgress("", 100);
+    if (importer.nLoaded > 0)
+        LogPrintf("Reindexed %d blocks in %dms\n", importer.nLoaded, GetTimeMillis() - nStart);
+    // The scan threads stop early on shutdown: the files may not have been read entirely
+    return !ShutdownRequested();
 }
 
 void static CheckBlockIndex()
@@ -4113,6 +4781,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4120,6 +4789,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4130,12 +4800,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().GetConsensus().hashGenesisBlock); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0)); // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4147,11 +4826,20 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates.  chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
-        } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
+        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
         }
         // Check whether this block is in mapBlocksUnlinked.
@@ -4165,12 +4853,24 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if it has a descendant that at some point had more
+            // work than the tip, and we tried switching to it but were missing data for some intermediate block.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4190,6 +4890,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4376,10 +5077,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
 
@@ -16,12 +16,14 @@
 #endif
 
 #include "amount.h"
+#include "blockindexmap.h"
 #include "chain.h"
 #include "coins.h"
 #include "consensus/validation.h"
 #include "fs.h"
 #include "moneysupply.h"
 #include "policy/feerate.h"
+#include "sapling/sapling_validation.h"
 #include "script/script_error.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -64,6 +66,8 @@ static const bool DEFAULT_PERSIST_MEMPOOL = true;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a mempool cluster */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 100;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** Default for -txindex */
@@ -85,6 +89,12 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** Maximum number of block files read in parallel ahead of the connect stage during -reindex */
+static const int MAX_REINDEX_SCAN_THREADS = 3;
+/** Default for -reindexreadahead, maximum size in MiB of the block files read ahead of the
+ *  connect stage during -reindex: enough for MAX_REINDEX_SCAN_THREADS full files.
+ *  They are held deserialized in memory until connected, which takes a few times their size. */
+static const int64_t DEFAULT_REINDEX_READAHEAD = MAX_REINDEX_SCAN_THREADS * (MAX_BLOCKFILE_SIZE >> 20);
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
@@ -99,6 +109,10 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of PoS headers a peer can have us store before their blocks arrive. A PoS header costs
+ *  nothing to make (its stake and signature are in the block): this bounds what headers alone can add to the
+ *  block index, while leaving more than BLOCK_DOWNLOAD_WINDOW headers to download the blocks of. */
+static const unsigned int MAX_UNCONNECTED_POS_HEADERS = MAX_HEADERS_RESULTS;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -116,14 +130,19 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Maximum age of our tip in seconds for us to be considered current for fee estimation */
 static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 
-struct BlockHasher {
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Number of recent blocks a NODE_NETWORK_LIMITED peer is expected to serve (BIP159) */
+static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
+/** Minimum -prune target (in bytes): the kept blocks with their undo data, plus the block file being filled */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+/** Work on top of a block (in seconds at the tip's difficulty) before -assumevalid skips its script and proof checks */
+static const int64_t ASSUMEVALID_MIN_BURIED_TIME = 60 * 60 * 24 * 7 * 2;
 
 extern CScript COINBASE_FLAGS;
 extern RecursiveMutex cs_main;
 extern CTxMemPool mempool;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -139,8 +158,21 @@ extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Pruning-related variables and constants */
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of bytes of block and undo files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Block hash whose ancestors we will assume to have valid scripts and Sapling proofs without checking them. */
+extern uint256 hashAssumeValid;
+/** Height of hashAssumeValid, if known (0 otherwise): the headers leading to it are stored ahead of their blocks. */
+extern int nAssumeValidHeight;
+/** Minimum work we will assume exists on some valid chain. */
+extern arith_uint256 nMinimumChainWork;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
@@ -173,6 +205,22 @@ extern CBlockIndex* pindexBestHeader;
  */
 bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp);
 
+/**
+ * Process incoming block headers. Only the difficulty (and, before the PoS upgrade, the proof
+ * of work) can be checked without the block data: the proof of stake is checked when the block
+ * itself is processed, so the new PoS headers of a source are stored up to a limit only.
+ *
+ * @param[in]     headers       The block headers themselves, each one connecting to the previous
+ * @param[out]    state         This may be set to an Error state if any error occurred processing them
+ * @param[out]    ppindex       If set, the pointer will be set to point to the last block index object stored or known for the given headers
+ * @param[in,out] pvPoSHeaders  The PoS headers stored for the same source whose block we don't have yet. New PoS headers are
+ *                              added to it while it has less than MAX_UNCONNECTED_POS_HEADERS, processing stops at the first
+ *                              one past that. If not set, no new PoS header is stored. The headers leading to the
+ *                              -assumevalid block, up to nAssumeValidHeight, are stored without counting.
+ * @return False if a header was invalid
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex = nullptr, std::vector<const CBlockIndex*>* pvPoSHeaders = nullptr);
+
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
@@ -181,6 +229,11 @@ FILE* OpenUndoFile(const FlatFilePos& pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp = NULL);
+/** Import the blk?????.dat files (-reindex): up to MAX_REINDEX_SCAN_THREADS files, and
+ *  -reindexreadahead MiB, are read and deserialized ahead of the one being connected
+ *  (a file bigger than that is read ahead alone).
+ *  Returns false if interrupted by shutdown. */
+bool ReindexBlockFiles();
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock();
 /** Load the block tree and coins database from disk,
@@ -201,6 +254,15 @@ bool IsInitialBlockDownload();
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
+/**
+ * Retrieve an output, with its height, that a block on top of pindexPrev can spend but that was
+ * spent on the active chain after their fork point: from the undo data of the blocks above it.
+ * For pruned nodes, where GetTransaction cannot read the block of the transaction anymore.
+ */
+bool GetCoinSpentAfterFork(const COutPoint& prevout, const CBlockIndex* pindexPrev, Coin& coin);
+/** Check that the free last output of a cold-stake coinstake, in a block on top of pindexPrev,
+ *  is a masternode/budget payment */
+bool CheckColdStakeFreeOutput(const CTransaction& tx, const CBlockIndex* pindexPrev);
 
 double ConvertBitsToDouble(unsigned int nBits);
 int64_t GetMasternodePayment(int nHeight);
@@ -211,8 +273,30 @@ CAmount GetBlockValue(int nHeight);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** Memory used by the entries of the block index */
+struct BlockIndexMemoryStats {
+    size_t nEntries{0};
+    //! Arena of the entries, side tables and mapBlockIndex
+    size_t nUsage{0};
+};
+BlockIndexMemoryStats GetBlockIndexMemoryStats() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Prune block files up to a given height (capped to keep GetPruneKeepDepth() blocks) */
+void PruneBlockFilesManual(int nManualPruneHeight);
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/**
+ * Number of blocks below the tip that a pruned node keeps on disk: at least
+ * MIN_BLOCKS_TO_KEEP, deeper than -maxreorg (disconnects and the Sapling
+ * witness cache) and than the longest LLMQ signing window.
+ */
+unsigned int GetPruneKeepDepth();
+/** Lowest height of the active chain whose block is still stored (0 if nothing was pruned) */
+int GetPruneHeight() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 
 /** (try to) add transaction to memory pool **/
@@ -225,6 +309,14 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                                 bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit = false,
                                 bool fRejectInsaneFee = false, bool ignoreFees = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Verify the signatures and Sapling proofs of a transaction received from a peer,
+ * against a snapshot of the coins it spends, without holding cs_main.
+ * The results are only cached, for AcceptToMemoryPool to skip the verifications
+ * that succeeded: it still runs every check itself.
+ */
+void PreCheckTransaction(const CTransactionRef& tx);
+
 CAmount GetMinRelayFee(const CTransaction& tx, const CTxMemPool& pool, unsigned int nBytes);
 CAmount GetMinRelayFee(unsigned int nBytes);
 /**
@@ -306,6 +398,33 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Unit of work of the block validation queue. Wraps either a transparent input
+ * script check or the Sapling proofs check of a shielded transaction, so that
+ * both kinds of verification are spread over the same worker threads.
+ */
+class CBlockCheck
+{
+private:
+    CScriptCheck scriptCheck;
+    CSaplingProofCheck saplingCheck;
+    bool fSapling;
+
+public:
+    CBlockCheck() : fSapling(false) {}
+    explicit CBlockCheck(CScriptCheck& check) : fSapling(false) { scriptCheck.swap(check); }
+    explicit CBlockCheck(CSaplingProofCheck& check) : fSapling(true) { saplingCheck.swap(check); }
+
+    bool operator()() { return fSapling ? saplingCheck() : scriptCheck(); }
+
+    void swap(CBlockCheck& check)
+    {
+        scriptCheck.swap(check.scriptCheck);
+        saplingCheck.swap(check.saplingCheck);
+        std::swap(fSapling, check.fSapling);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
@@ -317,7 +436,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
-bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev);
+bool CheckWork(const CBlockHeader& block, const CBlockIndex* const pindexPrev);
+/** Check the difficulty of a header on top of pindexPrev, and its proof of work before the PoS upgrade */
+bool CheckBlockHeaderWork(const CBlockHeader& header, CValidationState& state, const CBlockIndex* pindexPrev);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -326,7 +447,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckBlockSig = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex = nullptr, CBlockIndex* pindexPrev = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex = nullptr, CBlockIndex* pindexPrev = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
@@ -107,6 +107,10 @@ UniValue importprivkey(const JSONRPCRequest& request)
     const std::string strLabel = (request.params.size() > 1 ? request.params[1].get_str() : "");
     const bool fRescan = (request.params.size() > 2 ? request.params[2].get_bool() : true);
 
+    if (fRescan && fPruneMode) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
+    }
+
     WalletRescanReserver reserver(pwallet);
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
@@ -232,6 +236,10 @@ UniValue importaddress(const JSONRPCRequest& request)
     // Whether to perform rescan after import
     const bool fRescan = (request.params.size() > 2 ? request.params[2].get_bool() : true);
 
+    if (fRescan && fPruneMode) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
+    }
+
     WalletRescanReserver reserver(pwallet);
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
@@ -298,6 +306,10 @@ UniValue importpubkey(const JSONRPCRequest& request)
     // Whether to perform rescan after import
     const bool fRescan = (request.params.size() > 2 ? request.params[2].get_bool() : true);
 
+    if (fRescan && fPruneMode) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
+    }
+
     WalletRescanReserver reserver(pwallet);
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
@@ -348,6 +360,10 @@ UniValue importwallet(const JSONRPCRequest& request)
             "\nImport using the json rpc call\n" +
             HelpExampleRpc("importwallet", "\"test\""));
 
+    if (fPruneMode) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Importing wallets is disabled in pruned mode");
+    }
+
     fsbridge::ifstream file;
     file.open(request.params[0].get_str(), std::ios::in | std::ios::ate);
     if (!file.is_open()) {
@@ -1205,6 +1221,9 @@ UniValue bip38decrypt(const JSONRPCRequest& request)
     if (!key.IsValid())
         throw JSONRPCError(RPC_WALLET_ERROR, "Private Key Not Valid");
 
+    if (fPruneMode)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
+
     WalletRescanReserver reserver(pwallet);
     if (!reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
@@ -1310,6 +1329,9 @@ UniValue importsaplingkey(const JSONRPCRequest& request)
         if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
         }
+        if (fRescan && fPruneMode && nRescanHeight < GetPruneHeight()) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+        }
 
         std::string strSecret = request.params[0].get_str();
         auto spendingkey = KeyIO::DecodeSpendingKey(strSecret);
@@ -1413,6 +1435,9 @@ UniValue importsaplingviewingkey(const JSONRPCRequest& request)
         if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
         }
+        if (fRescan && fPruneMode && nRescanHeight < GetPruneHeight()) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+        }
 
         std::string strVKey = request.params[0].get_str();
         libzcash::ViewingKey viewingkey = KeyIO::DecodeViewingKey(strVKey);
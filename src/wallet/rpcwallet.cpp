@@ -2813,8 +2813,9 @@ UniValue listreceivedbyshieldaddress(const JSONRPCRequest& request)
         auto it = pwallet->mapWallet.find(entry.op.hash);
         if (it != pwallet->mapWallet.end()) {
             const CWalletTx& wtx = it->second;
-            if (!wtx.m_confirm.hashBlock.IsNull())
-                height = mapBlockIndex[wtx.m_confirm.hashBlock]->nHeight;
+            const CBlockIndex* pindex = wtx.m_confirm.hashBlock.IsNull() ? nullptr : LookupBlockIndex(wtx.m_confirm.hashBlock);
+            if (pindex)
+                height = pindex->nHeight;
             index = wtx.m_confirm.nIndex;
             time = wtx.GetTxTime();
         }
@@ -4241,6 +4242,15 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"paytxfee\": x.xxxx                       (numeric) the transaction fee configuration, set in MARIA/kB\n"
             "  \"hdseedid\": \"<hash160>\"                (string, optional) the Hash160 of the HD seed (only present when HD is enabled)\n"
             "  \"last_processed_block\": xxxxx,          (numeric) the last block processed block height\n"
+            "  \"scanning\":                             (json object) current scanning details, or false if no scan is in progress\n"
+            "    {\n"
+            "      \"duration\": xxxx,                     (numeric) elapsed seconds since scan start\n"
+            "      \"progress\": x.xxxx,                   (numeric) scanning progress percentage [0.0, 1.0]\n"
+            "      \"height\": xxxx,                       (numeric) height of the last scanned block\n"
+            "      \"blocks\": xxxx,                       (numeric) number of blocks scanned so far\n"
+            "      \"transactions\": xxxx,                 (numeric) number of transactions scanned so far\n"
+            "      \"blocks_per_sec\": x.xx,               (numeric) average scanning throughput\n"
+            "    }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -4289,6 +4299,19 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
         obj.pushKV("unlocked_until", pwallet->nRelockTime);
     obj.pushKV("paytxfee", ValueFromAmount(payTxFee.GetFeePerK()));
     obj.pushKV("last_processed_block", pwallet->GetLastBlockHeight());
+    if (pwallet->IsScanning()) {
+        const int64_t nDuration = pwallet->ScanningDuration();
+        UniValue scanning(UniValue::VOBJ);
+        scanning.pushKV("duration", nDuration / 1000);
+        scanning.pushKV("progress", pwallet->ScanningProgress());
+        scanning.pushKV("height", pwallet->ScanningHeight());
+        scanning.pushKV("blocks", pwallet->ScanningBlocks());
+        scanning.pushKV("transactions", pwallet->ScanningTransactions());
+        scanning.pushKV("blocks_per_sec", nDuration > 0 ? 1000.0 * pwallet->ScanningBlocks() / nDuration : 0.0);
+        obj.pushKV("scanning", scanning);
+    } else {
+        obj.pushKV("scanning", false);
+    }
     return obj;
 }
 
@@ -4351,6 +4374,9 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             "  \"lastattempt_hash\": xxx            (hex string) hash of the block on top of which the last stake attempt was made\n"
             "  \"lastattempt_coins\": n             (numeric) number of stakeable coins available during last stake attempt\n"
             "  \"lastattempt_tries\": n             (numeric) number of stakeable coins checked during last stake attempt\n"
+            "  \"lastattempt_tries_per_sec\": n     (numeric) stake kernels hashed per second during last stake attempt\n"
+            "  \"coinsindex_size\": n               (numeric) number of wallet outputs tracked by the stakeable coins index\n"
+            "  \"coinsindex_update_ms\": n.nnn      (numeric) duration of the last update of the stakeable coins index, in milliseconds\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -4381,6 +4407,9 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             obj.pushKV("lastattempt_hash", ss->GetLastHash().GetHex());
             obj.pushKV("lastattempt_coins", ss->GetLastCoins());
             obj.pushKV("lastattempt_tries", ss->GetLastTries());
+            obj.pushKV("lastattempt_tries_per_sec", ss->GetLastTriesPerSec());
+            obj.pushKV("coinsindex_size", ss->GetIndexSize());
+            obj.pushKV("coinsindex_update_ms", 0.001 * ss->GetIndexUpdateMicros());
         }
         return obj;
     }
@@ -4684,6 +4713,11 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
             }
         }
+
+        // We can't rescan beyond non-pruned blocks, stop and throw an error
+        if (fPruneMode && pindexStart->nHeight < GetPruneHeight()) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+        }
     }
 
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, reserver, true);
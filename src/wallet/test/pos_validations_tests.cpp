@@ -438,4 +438,59 @@ BOOST_FIXTURE_TEST_CASE(created_on_fork_tests, TestPoSChainSetup)
     BOOST_CHECK(ProcessNewBlock(pblockI, nullptr));
 }
 
+// The stakeable coins, scanning the whole wallet
+static std::set<COutPoint> ScanStakeableCoins(CWallet* pwallet)
+{
+    CWallet::AvailableCoinsFilter coinsFilter(false, // fIncludeDelegated
+                                              true,  // fIncludeColdStaking
+                                              true,  // fOnlySafe
+                                              true,  // fOnlySpendable
+                                              nullptr,
+                                              Params().GetConsensus().nStakeMinDepth);
+    std::vector<COutput> vCoins;
+    pwallet->AvailableCoins(&vCoins, nullptr, coinsFilter);
+    std::set<COutPoint> ret;
+    for (const COutput& out : vCoins) ret.emplace(out.tx->GetHash(), out.i);
+    return ret;
+}
+
+static std::set<COutPoint> IndexedStakeableCoins(CWallet* pwallet)
+{
+    std::vector<CStakeableOutput> vCoins;
+    pwallet->StakeableCoins(&vCoins);
+    std::set<COutPoint> ret;
+    for (const CStakeableOutput& out : vCoins) {
+        BOOST_CHECK(out.pindex && out.pindex->GetBlockHash() == out.tx->m_confirm.hashBlock);
+        ret.emplace(out.tx->GetHash(), out.i);
+    }
+    BOOST_CHECK_EQUAL(ret.size(), vCoins.size());
+    return ret;
+}
+
+BOOST_FIXTURE_TEST_CASE(stakeable_coins_index, TestPoSChainSetup)
+{
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(IndexedStakeableCoins(pwalletMain.get()) == ScanStakeableCoins(pwalletMain.get()));
+    BOOST_CHECK(pwalletMain->pStakerStatus->GetIndexSize() > 0);
+
+    // Spend in the mempool, then lock a coin
+    auto tx = CreateAndCommitTx(pwalletMain.get(), *pwalletMain->getNewAddress("").getObjResult(), 249 * COIN);
+    BOOST_CHECK(IndexedStakeableCoins(pwalletMain.get()) == ScanStakeableCoins(pwalletMain.get()));
+    const COutPoint lockedOut = *ScanStakeableCoins(pwalletMain.get()).begin();
+    WITH_LOCK(pwalletMain->cs_wallet, pwalletMain->LockCoin(lockedOut));
+    std::set<COutPoint> setCoins = IndexedStakeableCoins(pwalletMain.get());
+    BOOST_CHECK(!setCoins.count(lockedOut));
+    BOOST_CHECK(setCoins == ScanStakeableCoins(pwalletMain.get()));
+    WITH_LOCK(pwalletMain->cs_wallet, pwalletMain->UnlockCoin(lockedOut));
+
+    // Confirm the spend and stake a few blocks: coinstakes and new outputs mature by height
+    for (int i = 0; i < 5; i++) {
+        std::shared_ptr<CBlock> pblock = CreateBlockInternal(pwalletMain.get(), i == 0 ? std::vector<CMutableTransaction>{CMutableTransaction(tx)}
+                                                                                      : std::vector<CMutableTransaction>{});
+        BOOST_CHECK(ProcessNewBlock(pblock, nullptr));
+        SyncWithValidationInterfaceQueue();
+        BOOST_CHECK(IndexedStakeableCoins(pwalletMain.get()) == ScanStakeableCoins(pwalletMain.get()));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -284,6 +284,9 @@ struct FakeBlock
     CBlockIndex* pindex;
 };
 
+// Entries of the fake blocks: mapBlockIndex doesn't own them
+static std::vector<std::unique_ptr<CBlockIndex>> vFakeBlockIndexes;
+
 FakeBlock SimpleFakeMine(CWalletTx& wtx, SaplingMerkleTree& currentTree, CWallet& wallet)
 {
     FakeBlock fakeBlock;
@@ -294,7 +297,8 @@ FakeBlock SimpleFakeMine(CWalletTx& wtx, SaplingMerkleTree& currentTree, CWallet
         currentTree.append(out.cmu);
     }
     fakeBlock.block.hashFinalSaplingRoot = currentTree.root();
-    fakeBlock.pindex = new CBlockIndex(fakeBlock.block);
+    vFakeBlockIndexes.emplace_back(std::make_unique<CBlockIndex>(fakeBlock.block));
+    fakeBlock.pindex = vFakeBlockIndexes.back().get();
     mapBlockIndex.insert(std::make_pair(fakeBlock.block.GetHash(), fakeBlock.pindex));
     fakeBlock.pindex->phashBlock = &mapBlockIndex.find(fakeBlock.block.GetHash())->first;
     chainActive.SetTip(fakeBlock.pindex);
@@ -368,6 +368,20 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
         BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 500 * COIN);
     }
 
+    // Verify a rescan spanning several pipeline batches commits every block
+    // in order and finds all the coinbase outputs paying the key.
+    {
+        CWallet wallet("dummy", WalletDatabase::CreateDummy());
+        WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(newTip); );
+        AddKey(wallet, coinbaseKey);
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr, reserver));
+        BOOST_CHECK_EQUAL(wallet.ScanningBlocks(), newTip->nHeight + 1);
+        BOOST_CHECK_EQUAL(wallet.ScanningHeight(), newTip->nHeight);
+        BOOST_CHECK_EQUAL(WITH_LOCK(wallet.cs_wallet, return wallet.mapWallet.size(); ), (size_t)newTip->nHeight);
+    }
+
     // !TODO: Prune the older block file.
     /*
     PruneOneBlockFile(oldTip->GetBlockPos().nFile);
@@ -490,6 +504,9 @@ void removeTxFromMempool(CWalletTx& wtx)
     }
 }
 
+// Entries of the fake blocks: mapBlockIndex doesn't own them
+static std::vector<std::unique_ptr<CBlockIndex>> vFakeBlockIndexes;
+
 /**
  * Mimic block creation.
  */
@@ -499,7 +516,8 @@ CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CWallet &wallet, CBlockIndex* pprev
     block.vtx.emplace_back(wtx.tx);
     block.hashMerkleRoot = BlockMerkleRoot(block);
     if (pprev) block.hashPrevBlock = pprev->GetBlockHash();
-    CBlockIndex* fakeIndex = new CBlockIndex(block);
+    vFakeBlockIndexes.emplace_back(std::make_unique<CBlockIndex>(block));
+    CBlockIndex* fakeIndex = vFakeBlockIndexes.back().get();
     fakeIndex->pprev = pprev;
     mapBlockIndex.emplace(block.GetHash(), fakeIndex);
     fakeIndex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
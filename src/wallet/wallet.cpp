@@ -17,6 +17,7 @@
 #include "guiinterfaceutil.h"
 #include "policy/policy.h"
 #include "sapling/key_io_sapling.h"
+#include "sapling/trialdecryption.h"
 #include "script/sign.h"
 #include "scheduler.h"
 #include "shutdown.h"
@@ -1312,12 +1313,15 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         m_last_block_processed = pindex->GetBlockHash();
         m_last_block_processed_time = pindex->GetBlockTime();
         m_last_block_processed_height = pindex->nHeight;
+        // Sapling: trial-decrypt the whole block at once, instead of tx by tx
+        if (HasSaplingSPKM()) m_sspk_man->PrecomputeSaplingNotes(pblock->vtx);
         for (size_t index = 0; index < pblock->vtx.size(); index++) {
             CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, m_last_block_processed_height,
                                             m_last_block_processed, index);
             SyncTransaction(pblock->vtx[index], confirm);
             TransactionRemovedFromMempool(pblock->vtx[index], MemPoolRemovalReason::BLOCK);
         }
+        if (HasSaplingSPKM()) m_sspk_man->ClearPrecomputedSaplingNotes();
 
         // Sapling: notify about the connected block
         // Get prev block tree anchor
@@ -1426,8 +1430,10 @@ void CWallet::EraseFromWallet(const uint256& hash)
 {
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             WalletBatch(*database).EraseTx(hash);
+            MarkStakeableCoinsDirty(hash);
+        }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
@@ -1819,6 +1825,70 @@ bool CWallet::Upgrade(std::string& error, const int prevVersion)
     return true;
 }
 
+namespace {
+//! Blocks read and matched by the rescan workers ahead of the commit
+static const size_t RESCAN_BATCH_SIZE = 32;
+//! Maximum number of rescan worker threads
+static const int MAX_RESCAN_THREADS = 8;
+
+/** A block of the rescan, read from disk and matched by a worker */
+struct RescanBlock
+{
+    CBlockIndex* pindex{nullptr};
+    //! null if the block could not be read
+    std::shared_ptr<const CBlock> pblock;
+    //! per transaction, see CWallet::MayBeMineByOutputs
+    std::vector<bool> vMaybeMine;
+    //! Sapling notes trial-decrypted with the batch ivks
+    SaplingDecryptedNotesMap notes;
+};
+
+struct RescanBatch
+{
+    std::vector<RescanBlock> vBlocks;
+    //! CWallet::KeyStoreSize() and Sapling ivks when the batch was handed to the workers
+    size_t nKeyStoreSize{0};
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    std::atomic<size_t> nNext{0};
+    std::vector<std::future<void>> vWorkers;
+
+    void Wait()
+    {
+        for (auto& worker : vWorkers) worker.get();
+        vWorkers.clear();
+    }
+};
+} // anon namespace
+
+size_t CWallet::KeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapWatchKeys.size() + mapScripts.size() +
+           setWatchOnly.size() + mapSaplingFullViewingKeys.size();
+}
+
+bool CWallet::MayBeMineByOutputs(const CTransactionRef& tx) const
+{
+    // Rare enough to always take the full AddToWalletIfInvolvingMe path
+    if (tx->IsProRegTx() || tx->HasZerocoinSpendInputs()) return true;
+    return IsMine(tx);
+}
+
+bool CWallet::IsRelevantByInputs(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (mapWallet.count(tx.GetHash())) return true;
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) return true;
+    }
+    if (tx.IsShieldedTx()) {
+        for (const SpendDescription& spend : tx.sapData->vShieldedSpend) {
+            if (m_sspk_man->IsSaplingNullifierFromMe(spend.nullifier)) return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Scan active chain for relevant transactions after importing keys. This should
  * be called whenever new keys are added to the wallet, with the oldest key
@@ -1875,6 +1945,11 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
 
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
+    m_scanning_start = GetTimeMillis();
+    m_scanning_progress = 0;
+    m_scanning_height = pindexStart ? pindexStart->nHeight : 0;
+    m_scanning_blocks = 0;
+    m_scanning_txs = 0;
     {
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         CBlockIndex* tip = nullptr;
@@ -1887,65 +1962,134 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
         }
 
-        std::vector<uint256> myTxHashes;
-        while (pindex && !fAbortRescan) {
-            double gvp = 0;
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-                gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            }
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
+        // The scan is pipelined: worker threads read the blocks of the next batch from
+        // disk and match their transactions by outputs, while this thread commits the
+        // current batch in chain order, taking cs_main and cs_wallet once per block.
+        const int nWorkers = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        CBlockIndex* pindexNext = pindexStart; // first block not handed to the workers yet
+        auto StartBatch = [&]() -> std::unique_ptr<RescanBatch> {
+            auto batch = std::make_unique<RescanBatch>();
+            {
+                LOCK(cs_main);
+                while (pindexNext && batch->vBlocks.size() < RESCAN_BATCH_SIZE) {
+                    batch->vBlocks.emplace_back();
+                    batch->vBlocks.back().pindex = pindexNext;
+                    pindexNext = pindexNext == pindexStop ? nullptr : chainActive.Next(pindexNext);
+                }
             }
-            if (fromStartup && ShutdownRequested()) {
-                break;
+            if (batch->vBlocks.empty()) return nullptr;
+            batch->nKeyStoreSize = KeyStoreSize();
+            if (HasSaplingSPKM()) batch->ivks = m_sspk_man->GetIncomingViewingKeys();
+            RescanBatch* b = batch.get();
+            for (int i = 0; i < nWorkers; i++) {
+                b->vWorkers.emplace_back(std::async(std::launch::async, [this, b, fromStartup] {
+                    for (size_t n = b->nNext++; n < b->vBlocks.size(); n = b->nNext++) {
+                        if (fAbortRescan || (fromStartup && ShutdownRequested())) return;
+                        RescanBlock& rb = b->vBlocks[n];
+                        auto pblock = std::make_shared<CBlock>();
+                        if (!ReadBlockFromDisk(*pblock, rb.pindex)) continue;
+                        // One decryption thread per block, the workers already run in parallel
+                        rb.notes = SaplingTrialDecrypt(pblock->vtx, b->ivks, 1);
+                        rb.vMaybeMine.reserve(pblock->vtx.size());
+                        for (const CTransactionRef& tx : pblock->vtx) {
+                            auto it = rb.notes.find(tx->GetHash());
+                            rb.vMaybeMine.push_back(MayBeMineByOutputs(tx) || (it != rb.notes.end() && !it->second.empty()));
+                        }
+                        rb.pblock = std::move(pblock);
+                    }
+                }));
             }
+            return batch;
+        };
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex)) {
-                LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
-                     // Abort scan if current block is no longer active, to prevent
-                     // marking transactions as coming from the wrong block.
-                     ret = pindex;
-                     break;
-                 }
-                for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
-                    const auto& tx = block.vtx[posInBlock];
-                    CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
-                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
-                        myTxHashes.push_back(tx->GetHash());
-                    }
+        std::vector<uint256> myTxHashes;
+        std::unique_ptr<RescanBatch> scan = StartBatch();
+        bool fStop = false;
+        while (scan && !fStop) {
+            scan->Wait();
+            std::unique_ptr<RescanBatch> scanNext = StartBatch();
+
+            // Set once keys were added since the scan was matched (e.g. keypool top-up)
+            bool fRematch = false;
+            for (RescanBlock& rb : scan->vBlocks) {
+                pindex = rb.pindex;
+                if (fAbortRescan || (fromStartup && ShutdownRequested())) {
+                    fStop = true;
+                    break;
+                }
+                double gvp = 0;
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                    gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
+                    m_scanning_progress = (gvp - dProgressStart) / (dProgressTip - dProgressStart);
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(m_scanning_progress * 100))));
+                }
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f (%.1f blocks/s)\n", pindex->nHeight, gvp,
+                              1000.0 * m_scanning_blocks / std::max<int64_t>(1, GetTimeMillis() - m_scanning_start));
                 }
 
-                // Sapling
-                // This should never fail: we should always be able to get the tree
-                // state on the path to the tip of our chain
-                if (pindex->pprev) {
-                    if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
-                        SaplingMerkleTree saplingTree;
-                        assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
-                        // Increment note witness caches
-                        ChainTipAdded(pindex, &block, saplingTree);
+                if (rb.pblock) {
+                    LOCK2(cs_main, cs_wallet);
+                    if (!chainActive.Contains(pindex)) {
+                        // Abort scan if current block is no longer active, to prevent
+                        // marking transactions as coming from the wrong block.
+                        ret = pindex;
+                        fStop = true;
+                        break;
+                    }
+                    const CBlock& block = *rb.pblock;
+                    if (HasSaplingSPKM()) m_sspk_man->SetPrecomputedSaplingNotes(std::move(rb.notes), scan->ivks.size());
+                    for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
+                        const auto& tx = block.vtx[posInBlock];
+                        fRematch = fRematch || KeyStoreSize() != scan->nKeyStoreSize;
+                        bool fMaybeMine = rb.vMaybeMine[posInBlock];
+                        if (fRematch && !fMaybeMine) {
+                            // New Sapling keys make the precomputed notes stale, FindMySaplingNotes decrypts again
+                            fMaybeMine = MayBeMineByOutputs(tx) || tx->IsShieldedTx();
+                        }
+                        if (!fMaybeMine && !IsRelevantByInputs(*tx)) {
+                            continue;
+                        }
+                        CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
+                        if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
+                            myTxHashes.push_back(tx->GetHash());
+                        }
+                    }
+                    if (HasSaplingSPKM()) m_sspk_man->ClearPrecomputedSaplingNotes();
+
+                    // Sapling
+                    // This should never fail: we should always be able to get the tree
+                    // state on the path to the tip of our chain
+                    if (pindex->pprev) {
+                        if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
+                            SaplingMerkleTree saplingTree;
+                            assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                            // Increment note witness caches
+                            ChainTipAdded(pindex, &block, saplingTree);
+                        }
                     }
+                    m_scanning_txs += block.vtx.size();
+                } else {
+                    ret = pindex;
                 }
-            } else {
-                ret = pindex;
-            }
-            if (pindex == pindexStop) {
-                break;
+                m_scanning_height = pindex->nHeight;
+                m_scanning_blocks++;
             }
-            {
+            if (!fStop) {
                 LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
                 if (tip != chainActive.Tip()) {
                     tip = chainActive.Tip();
                     // in case the tip has changed, update progress max
                     dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
                 }
             }
+            scan = std::move(scanNext);
         }
+        // Let the workers of a batch that was not committed finish
+        if (scan) scan->Wait();
+        LogPrintf("%s: scanned %d blocks (%d transactions) in %.2fs using %d threads\n", __func__,
+                  m_scanning_blocks.load(), m_scanning_txs.load(), (GetTimeMillis() - m_scanning_start) * 0.001, nWorkers);
 
         // Sapling
         // After rescanning, persist Sapling note data that might have changed, e.g. nullifiers.
@@ -2650,6 +2794,54 @@ static void ApproximateBestSubset(const std::vector<std::pair<CAmount, std::pair
     }
 }
 
+void CWallet::MarkStakeableCoinsDirty(const uint256& txid) const
+{
+    LOCK(cs_stakeable_dirty);
+    setStakeableDirty.insert(txid);
+}
+
+void CWallet::UpdateStakeableCoins()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    std::set<uint256> setDirty;
+    WITH_LOCK(cs_stakeable_dirty, setDirty.swap(setStakeableDirty); );
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const uint256& txid : setDirty) {
+        auto it = mapStakeableCoins.lower_bound(COutPoint(txid, 0));
+        while (it != mapStakeableCoins.end() && it->first.hash == txid) {
+            it = mapStakeableCoins.erase(it);
+        }
+
+        const CWalletTx* pcoin = GetWalletTx(txid);
+        if (!pcoin || !pcoin->isConfirmed() || pcoin->GetDepthInMainChain() <= 0) continue;
+        const CBlockIndex* pindex = LookupBlockIndex(pcoin->m_confirm.hashBlock);
+        if (!pindex) continue;
+
+        // Min depth requirement for stake inputs, and coinbase/coinstake maturity
+        int nMinDepth = consensus.nStakeMinDepth;
+        if (pcoin->IsCoinBase() || pcoin->IsCoinStake()) {
+            nMinDepth = std::max(nMinDepth, consensus.nCoinbaseMaturity + 1);
+        }
+        const int nStakeableHeight = pcoin->m_confirm.block_height + nMinDepth - 1;
+
+        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+            const CTxOut& out = pcoin->tx->vout[i];
+            if (out.nValue <= 0 || IsMine(out) == ISMINE_NO) continue;
+            // Spends that are not confirmed yet are checked by StakeableCoins
+            bool fSpent = false;
+            auto range = mapTxSpends.equal_range(COutPoint(txid, i));
+            for (auto sit = range.first; !fSpent && sit != range.second; sit++) {
+                const CWalletTx* pspend = GetWalletTx(sit->second);
+                fSpent = pspend && pspend->GetDepthInMainChain() > 0;
+            }
+            if (fSpent) continue;
+            mapStakeableCoins.emplace(COutPoint(txid, i), StakeableCoinEntry{pindex, nStakeableHeight});
+        }
+    }
+}
+
 bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
 {
     const bool fIncludeColdStaking = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE) &&
@@ -2658,39 +2850,38 @@ bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
     if (pCoins) pCoins->clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
-
-        // Check if the tx is selectable
-        int nDepth = 0;
-        bool safeTx = false;
-        if (!CheckTXAvailability(pcoin, true, nDepth, safeTx))
-            continue;
+    const int64_t nTimeStart = GetTimeMicros();
+    UpdateStakeableCoins();
+    if (pStakerStatus) {
+        pStakerStatus->SetIndexUpdate((int) mapStakeableCoins.size(), GetTimeMicros() - nTimeStart);
+    }
 
-        // Check min depth requirement for stake inputs
-        if (nDepth < Params().GetConsensus().nStakeMinDepth) continue;
+    const int nHeight = GetLastBlockHeight();
+    for (const auto& it : mapStakeableCoins) {
+        const COutPoint& outpoint = it.first;
+        const StakeableCoinEntry& entry = it.second;
 
-        const CBlockIndex* pindex = nullptr;
-        for (unsigned int index = 0; index < pcoin->tx->vout.size(); index++) {
+        // Check depth and maturity requirements for stake inputs
+        if (nHeight < entry.nStakeableHeight) continue;
 
-            auto res = CheckOutputAvailability(
-                    pcoin->tx->vout[index],
-                    index,
-                    wtxid,
-                    nullptr, // coin control
-                    false,   // fIncludeDelegated
-                    fIncludeColdStaking,
-                    false,
-                    false);   // fIncludeLocked
+        const CWalletTx* pcoin = GetWalletTx(outpoint.hash);
+        auto res = CheckOutputAvailability(
+                pcoin->tx->vout[outpoint.n],
+                outpoint.n,
+                outpoint.hash,
+                nullptr, // coin control
+                false,   // fIncludeDelegated
+                fIncludeColdStaking,
+                false,
+                false);   // fIncludeLocked
 
-            if (!res.available || !res.spendable) continue;
+        if (!res.available || !res.spendable) continue;
 
-            // found valid coin
-            if (!pCoins) return true;
-            if (!pindex) pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
-            pCoins->emplace_back(pcoin, (int) index, nDepth, pindex);
-        }
+        // found valid coin
+        if (!pCoins) return true;
+        const int nDepth = nHeight - pcoin->m_confirm.block_height + 1;
+        const CBlockIndex* pindex = entry.pindex;
+        pCoins->emplace_back(pcoin, (int) outpoint.n, nDepth, pindex);
     }
     return (pCoins && !pCoins->empty());
 }
@@ -3308,6 +3499,10 @@ bool CWallet::CreateCoinstakeOuts(const CMariaStake& stakeInput, std::vector<CTx
     return true;
 }
 
+// Split the stake kernel search across threads above this many coins
+static const size_t MIN_STAKE_SEARCH_PARALLEL_COINS = 2048;
+static const int MAX_STAKE_SEARCH_THREADS = 4;
+
 bool CWallet::CreateCoinStake(
         const CBlockIndex* pindexPrev,
         unsigned int nBits,
@@ -3330,47 +3525,82 @@ bool CWallet::CreateCoinStake(
     pStakerStatus->SetLastTip(pindexPrev);
     pStakerStatus->SetLastCoins((int) availableCoins->size());
 
-    // Kernel Search
-    CAmount nCredit;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
-        COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CMariaStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
-
-        // New block came in, move on
-        if (stopOnNewBlock && GetLastBlockHeightLockWallet() != pindexPrev->nHeight) return false;
-
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested()) return false;
-
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
+    // Get the new time slot (and verify it's not the same as previous block)
+    const bool fRegTest = Params().IsRegTestNet();
+    nTxNewTime = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    if (nTxNewTime <= pindexPrev->nTime && !fRegTest) {
+        pStakerStatus->SetLastTime(nTxNewTime);
+        return false;
+    }
 
-        nCredit = 0;
+    LOCK(cs_stake_search);
+
+    // The kernels only depend on the tip and the coins: compute them once, then each
+    // time slot only hashes the block time
+    bool fSameCoins = stakeSearch.GetPrev() == pindexPrev && stakeSearch.GetBits() == nBits &&
+                      vStakeSearchOutpoints.size() == availableCoins->size();
+    for (size_t i = 0; fSameCoins && i < availableCoins->size(); i++) {
+        const CStakeableOutput& out = (*availableCoins)[i];
+        fSameCoins = vStakeSearchOutpoints[i] == COutPoint(out.tx->GetHash(), out.i);
+    }
+    if (!fSameCoins) {
+        const int64_t nTimeStart = GetTimeMicros();
+        stakeSearch.Reset(pindexPrev, nBits);
+        vStakeSearchOutpoints.clear();
+        for (const CStakeableOutput& out : *availableCoins) {
+            const COutPoint outPoint(out.tx->GetHash(), out.i);
+            CMariaStake stakeInput(out.tx->tx->vout[out.i], outPoint, out.pindex);
+            stakeSearch.Add(&stakeInput);
+            vStakeSearchOutpoints.push_back(outPoint);
+        }
+        LogPrint(BCLog::STAKING, "%s: computed %d stake kernels on top of block %d in %.2fms\n", __func__,
+                 stakeSearch.Size(), pindexPrev->nHeight, 0.001 * (GetTimeMicros() - nTimeStart));
+    }
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+    // New block came in, move on
+    if (stopOnNewBlock && GetLastBlockHeightLockWallet() != pindexPrev->nHeight) return false;
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested()) return false;
 
-        if (!fKernelFound) {
-            it++;
-            continue;
+    // Kernel Search
+    const int64_t nTimeStart = GetTimeMicros();
+    const int nThreads = availableCoins->size() < MIN_STAKE_SEARCH_PARALLEL_COINS ? 1 :
+                         std::max(1, std::min(GetNumCores(), MAX_STAKE_SEARCH_THREADS));
+    const std::vector<size_t> vFound = stakeSearch.Search((int) nTxNewTime, nThreads);
+    const int nAttempts = (int) stakeSearch.Size();
+
+    // update staker status (time, attempts)
+    pStakerStatus->SetLastTime(nTxNewTime);
+    pStakerStatus->SetLastTries(nAttempts);
+    pStakerStatus->SetLastTriesPerSec(nAttempts * 1000000LL / std::max<int64_t>(1, GetTimeMicros() - nTimeStart));
+
+    // Make sure the stake inputs found haven't been spent since last check,
+    // and remove the spent ones from the available coins (highest index first)
+    std::vector<CStakeableOutput> vKernelCoins;
+    {
+        LOCK(cs_wallet);
+        for (auto it = vFound.rbegin(); it != vFound.rend(); it++) {
+            const CStakeableOutput& out = (*availableCoins)[*it];
+            if (!IsSpent(COutPoint(out.tx->GetHash(), out.i))) {
+                vKernelCoins.insert(vKernelCoins.begin(), out);
+                continue;
+            }
+            availableCoins->erase(availableCoins->begin() + *it);
+            stakeSearch.Erase(*it);
+            vStakeSearchOutpoints.erase(vStakeSearchOutpoints.begin() + *it);
         }
+    }
+
+    bool fKernelFound = false;
+    for (const CStakeableOutput& out : vKernelCoins) {
+        CMariaStake stakeInput(out.tx->tx->vout[out.i],
+                             COutPoint(out.tx->GetHash(), out.i),
+                             out.pindex);
 
         // Found a kernel
         LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+        CAmount nCredit = stakeInput.GetValue();
 
         // Add block reward to the credit
         nCredit += GetBlockValue(pindexPrev->nHeight + 1);
@@ -3379,7 +3609,6 @@ bool CWallet::CreateCoinStake(
         std::vector<CTxOut> vout;
         if (!CreateCoinstakeOuts(stakeInput, vout, nCredit)) {
             LogPrintf("%s : failed to create output\n", __func__);
-            it++;
             continue;
         }
         txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
@@ -3407,9 +3636,11 @@ bool CWallet::CreateCoinStake(
         if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
             return error("%s : exceeded coinstake size limit", __func__);
 
+        fKernelFound = true;
         break;
     }
-    LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
+    LogPrint(BCLog::STAKING, "%s: attempted staking %d times (%d tries/s)\n", __func__, nAttempts,
+             pStakerStatus->GetLastTriesPerSec());
 
     return fKernelFound;
 }
@@ -4307,6 +4538,21 @@ CWallet* CWallet::CreateWalletFromFile(const std::string& name, const fs::path&
                 pindexRescan->GetBlockTime() < (walletInstance->nTimeFirstKey - TIMESTAMP_WINDOW)) {
             pindexRescan = chainActive.Next(pindexRescan);
         }
+
+        // We can't rescan beyond non-pruned blocks, stop and throw an error.
+        // This might happen if a user uses an old wallet within a pruned node
+        // or if they ran -disablewallet for a longer time, then decided to re-enable.
+        if (fPruneMode && pindexRescan) {
+            const CBlockIndex* block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block) {
+                block = block->pprev;
+            }
+            if (pindexRescan != block) {
+                UIError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+                return nullptr;
+            }
+        }
+
         const int64_t nWalletRescanTime = GetTimeMillis();
         {
             WalletRescanReserver reserver(walletInstance);
@@ -4747,6 +4993,8 @@ void CWalletTx::MarkDirty()
     nShieldedChangeCached = 0;
     fShieldedChangeCached = false;
     fStakeDelegationVoided = false;
+    // Whatever changed may change the stakeable outputs too
+    if (pwallet && tx) pwallet->MarkStakeableCoinsDirty(GetHash());
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
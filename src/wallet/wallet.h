@@ -180,6 +180,9 @@ public:
  *  - nTime          time slot of last attempt
  *  - nTries         number of UTXOs hashed during last attempt
  *  - nCoins         number of stakeable utxos during last attempt
+ *  - nTriesPerSec   kernel hashing rate during last attempt
+ *  - nIndexSize     outputs in the stakeable coins index after its last update
+ *  - nIndexUpdateMicros  duration of the last update of the stakeable coins index
 **/
 class CStakerStatus
 {
@@ -188,6 +191,9 @@ private:
     int64_t nTime{0};
     int nTries{0};
     int nCoins{0};
+    int64_t nTriesPerSec{0};
+    int nIndexSize{0};
+    int64_t nIndexUpdateMicros{0};
 
 public:
     // Get
@@ -196,16 +202,23 @@ public:
     int GetLastHeight() const { return (GetLastTip() == nullptr ? 0 : GetLastTip()->nHeight); }
     int GetLastCoins() const { return nCoins; }
     int GetLastTries() const { return nTries; }
+    int64_t GetLastTriesPerSec() const { return nTriesPerSec; }
+    int GetIndexSize() const { return nIndexSize; }
+    int64_t GetIndexUpdateMicros() const { return nIndexUpdateMicros; }
     int64_t GetLastTime() const { return nTime; }
     // Set
     void SetLastCoins(const int coins) { nCoins = coins; }
     void SetLastTries(const int tries) { nTries = tries; }
+    void SetLastTriesPerSec(const int64_t triesPerSec) { nTriesPerSec = triesPerSec; }
+    void SetIndexUpdate(const int size, const int64_t micros) { nIndexSize = size; nIndexUpdateMicros = micros; }
     void SetLastTip(const CBlockIndex* lastTip) { tipBlock = lastTip; }
     void SetLastTime(const uint64_t lastTime) { nTime = lastTime; }
     void SetNull()
     {
         SetLastCoins(0);
         SetLastTries(0);
+        SetLastTriesPerSec(0);
+        SetIndexUpdate(0, 0);
         SetLastTip(nullptr);
         SetLastTime(0);
     }
@@ -580,6 +593,14 @@ private:
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet; //controlled by WalletRescanReserver
     std::mutex mutexScanning;
+    //! Rescan progress counters, readable while ScanForWalletTransactions runs
+    std::atomic<int64_t> m_scanning_start{0};
+    std::atomic<double> m_scanning_progress{0};
+    std::atomic<int> m_scanning_height{0};
+    std::atomic<int64_t> m_scanning_blocks{0};
+    std::atomic<int64_t> m_scanning_txs{0};
+    //! Number of keys, scripts and viewing keys IsMine() can match against
+    size_t KeyStoreSize() const;
     friend class WalletRescanReserver;
 
 
@@ -658,6 +679,24 @@ private:
         bool spendable{false};
     };
 
+    /**
+     * Stakeable coins index: outputs of confirmed wallet transactions that are mine, not
+     * spent by a confirmed transaction, with the index of their block and the wallet
+     * height from which they are deep and mature enough to stake. Transactions marked
+     * dirty since the last StakeableCoins call (see CWalletTx::MarkDirty) are indexed
+     * again there, so a staking round only walks the index, not the whole mapWallet.
+     */
+    struct StakeableCoinEntry
+    {
+        const CBlockIndex* pindex;
+        int nStakeableHeight;
+    };
+    std::map<COutPoint, StakeableCoinEntry> mapStakeableCoins GUARDED_BY(cs_wallet);
+    mutable Mutex cs_stakeable_dirty;
+    mutable std::set<uint256> setStakeableDirty GUARDED_BY(cs_stakeable_dirty);
+    //! Re-index the dirty transactions
+    void UpdateStakeableCoins() EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
     OutputAvailabilityResult CheckOutputAvailability(const CTxOut& output,
                                                      const unsigned int outIndex,
                                                      const uint256& wtxid,
@@ -734,6 +773,10 @@ public:
     static CAmount minStakeSplitThreshold;
     // Staker status (last hashed block and time)
     CStakerStatus* pStakerStatus = nullptr;
+    // Stake kernels of the coins passed to CreateCoinStake, reused until the tip or the coins change
+    mutable Mutex cs_stake_search;
+    mutable CStakeKernelSearch stakeSearch GUARDED_BY(cs_stake_search);
+    mutable std::vector<COutPoint> vStakeSearchOutpoints GUARDED_BY(cs_stake_search);
 
     // User-defined fee MARIA/kb
     bool fUseCustomFee;
@@ -834,6 +877,8 @@ public:
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     //! >> Available coins (staking)
     bool StakeableCoins(std::vector<CStakeableOutput>* pCoins = nullptr);
+    //! Queue the outputs of txid for re-indexing by the next StakeableCoins call
+    void MarkStakeableCoinsDirty(const uint256& txid) const;
     //! >> Available coins (P2CS)
     void GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const;
 
@@ -872,6 +917,11 @@ public:
     void AbortRescan() { fAbortRescan = true; }
     bool IsAbortingRescan() { return fAbortRescan; }
     bool IsScanning() { return fScanningWallet; }
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - m_scanning_start : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double) m_scanning_progress : 0; }
+    int ScanningHeight() const { return m_scanning_height; }
+    int64_t ScanningBlocks() const { return m_scanning_blocks; }
+    int64_t ScanningTransactions() const { return m_scanning_txs; }
 
     /*
      * Stake Split threshold
@@ -1026,6 +1076,14 @@ public:
     bool ActivateSaplingWallet(bool memOnly = false);
 
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
+    /**
+     * Whether tx may involve the wallet, judged by its transparent outputs only
+     * (Sapling outputs are matched by SaplingTrialDecrypt). Needs no cs_wallet,
+     * so the rescan runs it on worker threads ahead of the ordered commit.
+     */
+    bool MayBeMineByOutputs(const CTransactionRef& tx) const;
+    /** Whether tx spends, conflicts with or already is a wallet transaction */
+    bool IsRelevantByInputs(const CTransaction& tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false, bool fromStartup = false);
     void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) override;
     void ReacceptWalletTransactions(bool fFirstLoad = false);
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016-2017 The Bitcoin Core developers
+# Copyright (c) 2021 The MARIA developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test compact block relay (BIP152-style).
+
+- a peer that sent sendcmpct(announce=True) gets new blocks pushed as cmpctblock,
+  with the coinbase prefilled.
+- getblocktxn is answered with the requested transactions of the block.
+- two nodes relay blocks with cmpctblock/getblocktxn and report it in getpeerinfo.
+- a cmpctblock with an invalid header gets the peer punished, without any getblocktxn.
+"""
+
+from test_framework.messages import (
+    BlockTransactionsRequest,
+    HeaderAndShortIDs,
+    msg_cmpctblock,
+    msg_getblocktxn,
+    msg_sendcmpct,
+    P2PHeaderAndShortIDs,
+)
+from test_framework.mininode import (
+    mininode_lock,
+    P2PInterface,
+)
+from test_framework.test_framework import MariaTestFramework
+from test_framework.util import (
+    assert_equal,
+    wait_until,
+)
+
+
+class CompactBlocksTestNode(P2PInterface):
+    def clear_block_announcements(self):
+        with mininode_lock:
+            self.last_message.pop("cmpctblock", None)
+            self.last_message.pop("inv", None)
+
+    def wait_for_cmpctblock(self, blockhash, timeout=60):
+        def test_function():
+            if "cmpctblock" not in self.last_message:
+                return False
+            header = self.last_message["cmpctblock"].header_and_shortids.header
+            header.calc_sha256()
+            return header.sha256 == blockhash
+        wait_until(test_function, timeout=timeout, lock=mininode_lock)
+
+
+class CompactBlocksTest(MariaTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+
+    def test_cmpctblock_announcement(self, node, p2p):
+        self.log.info("Check that new blocks are announced with a cmpctblock in high-bandwidth mode")
+        msg = msg_sendcmpct()
+        msg.announce = True
+        msg.version = 1
+        p2p.send_and_ping(msg)
+        p2p.clear_block_announcements()
+
+        blockhash = int(node.generate(1)[0], 16)
+        p2p.wait_for_cmpctblock(blockhash)
+
+        with mininode_lock:
+            cmpct = HeaderAndShortIDs(p2p.last_message["cmpctblock"].header_and_shortids)
+        block = node.getblock("%064x" % blockhash)
+        assert_equal(len(cmpct.prefilled_txn) + len(cmpct.shortids), len(block["tx"]))
+        # The coinbase is never in our mempool: it always comes with the announcement
+        assert_equal(cmpct.prefilled_txn[0].index, 0)
+        cmpct.prefilled_txn[0].tx.calc_sha256()
+        assert_equal("%064x" % cmpct.prefilled_txn[0].tx.sha256, block["tx"][0])
+        return blockhash
+
+    def test_getblocktxn(self, node, p2p, blockhash):
+        self.log.info("Check that getblocktxn is answered with a blocktxn")
+        block = node.getblock("%064x" % blockhash)
+        msg = msg_getblocktxn()
+        msg.block_txn_request = BlockTransactionsRequest(blockhash, [])
+        msg.block_txn_request.from_absolute(list(range(len(block["tx"]))))
+        p2p.send_message(msg)
+        wait_until(lambda: "blocktxn" in p2p.last_message, timeout=30, lock=mininode_lock)
+
+        with mininode_lock:
+            resp = p2p.last_message["blocktxn"].block_transactions
+        assert_equal(resp.blockhash, blockhash)
+        assert_equal(len(resp.transactions), len(block["tx"]))
+        for tx, txid in zip(resp.transactions, block["tx"]):
+            tx.calc_sha256()
+            assert_equal("%064x" % tx.sha256, txid)
+
+    def test_node_relay(self):
+        self.log.info("Check that blocks are relayed between nodes with compact blocks")
+        addr = self.nodes[1].getnewaddress()
+        for _ in range(3):
+            self.nodes[0].sendtoaddress(addr, 1)
+            self.sync_mempools()
+            self.nodes[0].generate(1)
+            self.sync_blocks()
+
+        def cmpct_stats():
+            return [p["cmpctblocks"] for p in self.nodes[1].getpeerinfo() if "cmpctblocks" in p]
+
+        wait_until(lambda: any(s["reconstructed"] > 0 for s in cmpct_stats()), timeout=30)
+        for stats in cmpct_stats():
+            assert stats["provides"]
+            assert stats["reconstructed"] <= stats["received"]
+            assert 0 <= stats["hit_rate"] <= 1
+            assert 0 <= stats["mempool_hit_rate"] <= 1
+
+    def test_invalid_header(self, node):
+        self.log.info("Check that a cmpctblock with an invalid header is rejected before reconstruction")
+        p2p = node.add_p2p_connection(CompactBlocksTestNode())
+        p2p.wait_for_verack()
+        tip = node.getblock(node.getbestblockhash())
+        cmpct = P2PHeaderAndShortIDs()
+        cmpct.header.nVersion = tip["version"]
+        cmpct.header.hashPrevBlock = int(tip["hash"], 16)
+        cmpct.header.nTime = tip["time"] + 1
+        cmpct.header.nBits = 0x1d00ffff  # not the required difficulty
+        cmpct.shortids = [1, 2, 3]
+        cmpct.shortids_length = len(cmpct.shortids)
+        p2p.send_message(msg_cmpctblock(cmpct))
+        p2p.wait_for_disconnect()
+        assert "getblocktxn" not in p2p.last_message
+
+    def run_test(self):
+        node = self.nodes[0]
+        p2p = node.add_p2p_connection(CompactBlocksTestNode())
+        p2p.wait_for_verack()
+
+        blockhash = self.test_cmpctblock_announcement(node, p2p)
+        self.test_getblocktxn(node, p2p, blockhash)
+        self.sync_blocks()
+        self.test_node_relay()
+        self.test_invalid_header(node)
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The MARIA developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test headers-first synchronization with parallel block download.
+
+- a node that was offline syncs the headers first, then downloads the blocks
+  (PoW and PoS) from more than one of its peers and connects them in order.
+- a peer can have at most MAX_UNCONNECTED_POS_HEADERS PoS headers stored
+  before their blocks arrive: the next ones are not stored, unless they come
+  from another peer.
+- getpeerinfo reports the blocks downloaded from each peer.
+- a getheaders request is answered with the headers of the active chain.
+"""
+
+from test_framework.messages import (
+    CBlockHeader,
+    msg_getheaders,
+    msg_headers,
+)
+from test_framework.mininode import (
+    mininode_lock,
+    P2PInterface,
+)
+from test_framework.test_framework import MariaTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    assert_greater_than_or_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    wait_until,
+)
+
+NEW_BLOCKS = 80
+MAX_UNCONNECTED_POS_HEADERS = 2000
+
+
+class HeadersSyncTest(MariaTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+
+    def setup_network(self):
+        # node2 stays offline while node0 mines
+        self.setup_nodes()
+        connect_nodes(self.nodes[1], 0)
+        self.sync_all(self.nodes[0:2])
+
+    def test_sync(self):
+        self.log.info("Mine %d blocks (crossing the PoS upgrade) while node2 is offline" % NEW_BLOCKS)
+        start_height = self.nodes[2].getblockcount()
+        self.nodes[0].generate(NEW_BLOCKS)
+        self.sync_blocks(self.nodes[0:2])
+
+        self.log.info("Check that node2 syncs the headers first, then the blocks from both peers")
+        connect_nodes(self.nodes[2], 0)
+        connect_nodes(self.nodes[2], 1)
+        self.sync_blocks()
+        info = self.nodes[2].getblockchaininfo()
+        assert_equal(info["blocks"], start_height + NEW_BLOCKS)
+        assert_equal(info["headers"], info["blocks"])
+
+        downloads = [p["blockdownload"] for p in self.nodes[2].getpeerinfo()]
+        assert_equal(sum(d["blocks"] for d in downloads), NEW_BLOCKS)
+        assert_greater_than(len([d for d in downloads if d["blocks"] > 0]), 1)
+        for d in downloads:
+            assert_greater_than_or_equal(d["bytes"], d["blocks"])
+            assert_greater_than_or_equal(d["rate"], 0)
+
+    def test_getheaders(self):
+        self.log.info("Check that getheaders is answered with the headers of the active chain")
+        node = self.nodes[0]
+        p2p = node.add_p2p_connection(P2PInterface())
+        p2p.wait_for_verack()
+
+        start_hash = node.getblockhash(node.getblockcount() - 10)
+        msg = msg_getheaders()
+        msg.locator.vHave = [int(start_hash, 16)]
+        msg.hashstop = 0
+        p2p.send_message(msg)
+        wait_until(lambda: "headers" in p2p.last_message, timeout=30, lock=mininode_lock)
+
+        with mininode_lock:
+            headers = p2p.last_message["headers"].headers
+        assert_equal(len(headers), 10)
+        for i, header in enumerate(headers):
+            header.calc_sha256()
+            assert_equal("%064x" % header.sha256, node.getblockhash(node.getblockcount() - 9 + i))
+
+    def test_pos_headers(self):
+        self.log.info("Check that a peer can only have so many PoS headers stored without their block")
+        node = self.nodes[0]
+        p2p = node.add_p2p_connection(P2PInterface())
+        p2p.wait_for_verack()
+
+        # Regtest doesn't retarget nor check the block times: the headers only need the tip's nBits
+        tip = node.getblock(node.getbestblockhash())
+        headers = []
+        prev_hash = int(tip["hash"], 16)
+        for i in range(MAX_UNCONNECTED_POS_HEADERS + 1):
+            header = CBlockHeader()
+            header.nVersion = tip["version"]
+            header.hashPrevBlock = prev_hash
+            header.nTime = tip["time"] + i + 1
+            header.nBits = int(tip["bits"], 16)
+            header.calc_sha256()
+            headers.append(header)
+            prev_hash = header.sha256
+
+        p2p.send_message(msg_headers(headers[:MAX_UNCONNECTED_POS_HEADERS]))
+        p2p.sync_with_ping()
+        assert_equal(node.getblockheader(headers[-2].hash)["height"], tip["height"] + MAX_UNCONNECTED_POS_HEADERS)
+        assert_equal(node.getblockchaininfo()["headers"], tip["height"] + MAX_UNCONNECTED_POS_HEADERS)
+
+        self.log.info("Check that the next PoS header is not stored, without disconnecting the peer")
+        p2p.send_message(msg_headers(headers[-1:]))
+        p2p.sync_with_ping()
+        assert_raises_rpc_error(-5, "Block not found", node.getblockheader, headers[-1].hash)
+        assert p2p.is_connected
+
+        self.log.info("Check that the limit is per peer")
+        p2p2 = node.add_p2p_connection(P2PInterface())
+        p2p2.wait_for_verack()
+        p2p2.send_message(msg_headers(headers[-1:]))
+        p2p2.sync_with_ping()
+        assert_equal(node.getblockheader(headers[-1].hash)["height"], tip["height"] + MAX_UNCONNECTED_POS_HEADERS + 1)
+
+    def run_test(self):
+        self.test_sync()
+        self.test_getheaders()
+        self.test_pos_headers()
+
+
+if __name__ == '__main__':
+    HeadersSyncTest().main()
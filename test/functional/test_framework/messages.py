@@ -741,6 +741,7 @@ class P2PHeaderAndShortIDs:
         self.shortids = []
         self.prefilled_txn_length = 0
         self.prefilled_txn = []
+        self.vchBlockSig = b""
 
     def deserialize(self, f):
         self.header.deserialize(f)
@@ -752,6 +753,7 @@ class P2PHeaderAndShortIDs:
             self.shortids.append(struct.unpack("<Q", f.read(6) + b'\x00\x00')[0])
         self.prefilled_txn = deser_vector(f, PrefilledTransaction)
         self.prefilled_txn_length = len(self.prefilled_txn)
+        self.vchBlockSig = deser_string(f)
 
     # When using version 2 compact blocks, we must serialize with_witness.
     def serialize(self, with_witness=False):
@@ -766,6 +768,7 @@ class P2PHeaderAndShortIDs:
             r += ser_vector(self.prefilled_txn, "serialize_with_witness")
         else:
             r += ser_vector(self.prefilled_txn, "serialize_without_witness")
+        r += ser_string(self.vchBlockSig)
         return r
 
     def __repr__(self):
@@ -791,11 +794,13 @@ class HeaderAndShortIDs:
         self.nonce = 0
         self.shortids = []
         self.prefilled_txn = []
+        self.vchBlockSig = b""
         self.use_witness = False
 
         if p2pheaders_and_shortids is not None:
             self.header = p2pheaders_and_shortids.header
             self.nonce = p2pheaders_and_shortids.nonce
+            self.vchBlockSig = p2pheaders_and_shortids.vchBlockSig
             self.shortids = p2pheaders_and_shortids.shortids
             last_index = -1
             for x in p2pheaders_and_shortids.prefilled_txn:
@@ -809,6 +814,7 @@ class HeaderAndShortIDs:
             ret = P2PHeaderAndShortIDs()
         ret.header = self.header
         ret.nonce = self.nonce
+        ret.vchBlockSig = self.vchBlockSig
         ret.shortids_length = len(self.shortids)
         ret.shortids = self.shortids
         ret.prefilled_txn_length = len(self.prefilled_txn)
@@ -831,6 +837,7 @@ class HeaderAndShortIDs:
     def initialize_from_block(self, block, nonce=0, prefill_list = [0], use_witness = False):
         self.header = CBlockHeader(block)
         self.nonce = nonce
+        self.vchBlockSig = getattr(block, 'vchBlockSig', b"")
         self.prefilled_txn = [ PrefilledTransaction(i, block.vtx[i]) for i in prefill_list ]
         self.shortids = []
         self.use_witness = use_witness
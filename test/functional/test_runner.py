@@ -141,6 +141,8 @@ BASE_SCRIPTS= [
     'mining_v5_upgrade.py',                     # ~ 48 sec
     'p2p_timeouts.py',
     'p2p_mempool.py',                           # ~ 46 sec
+    'p2p_compactblocks.py',
+    'p2p_headers_sync.py',
     'rpc_named_arguments.py',                   # ~ 45 sec
     'feature_help.py',                          # ~ 30 sec
 